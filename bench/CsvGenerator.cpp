@@ -0,0 +1,534 @@
+#include "CsvGenerator.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Column names, with something Windows-1252 can hold for the ones it can't
+struct ColumnName
+{
+	const char* utf8;
+	const char* latin;
+};
+
+const ColumnName columnNames[] = {
+	{"row", "row"},
+	{"sine", "sine"},
+	{"noise", "noise"},
+	{"walk", "walk"},
+	{"temp °C", "temp °C"},
+	{"naïve", "naïve"},
+	{"price €", "price €"},
+	{"level µV", "level µV"},
+	{"mood \U0001F600", "mood :)"},
+	{"日付", "date"},
+};
+const int numColumnNames = sizeof(columnNames) / sizeof(columnNames[0]);
+
+// Cells that aren't numbers, or only look a bit like them. All of them can
+// be written in Windows-1252.
+const char* const words[] = {
+	"n/a", "null", "-", "NaN", "inf", "x1", "1x", "5\" tall", "café", "€5", "1.2.3", "--1", "0x1A", "1e", "#1",
+};
+const int numWords = sizeof(words) / sizeof(words[0]);
+
+// Windows-1252 bytes 0x80 to 0x9f, 0 where there isn't a character
+const uint16_t windows1252High[32] = {
+	0x20ac, 0, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021, 0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0, 0x017d, 0,
+	0, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014, 0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0, 0x017e, 0x0178,
+};
+
+double parseNumber(const std::string& key, const std::string& value)
+{
+	char* end;
+	double x = std::strtod(value.c_str(), &end);
+	if (value.empty() || *end)
+		throw std::runtime_error("bad number for " + key + ": " + value);
+	return x;
+}
+
+double parseFraction(const std::string& key, const std::string& value)
+{
+	double x = parseNumber(key, value);
+	if (!(x >= 0.0 && x <= 1.0))
+		throw std::runtime_error(key + " has to be from 0 to 1");
+	return x;
+}
+
+// Writes out the rows as UTF-8, handing it over a line at a time once there's
+// a fair amount of it
+struct TextWriter
+{
+	const CsvSpec& spec;
+	const std::function<void(const std::string& text)>& flush;
+	CsvRandom random;
+	std::string text;
+	std::vector<double> walks;
+
+	TextWriter(const CsvSpec& spec, const std::function<void(const std::string& text)>& flush)
+		: spec(spec)
+		, flush(flush)
+		, random(spec.seed)
+		, walks(spec.columns + 2, 0.0) // ragged rows can have two extra cells
+	{
+	}
+
+	void run()
+	{
+		for (int c = 0; c < spec.columns; c++)
+		{
+			if (c > 0)
+				text += spec.separator;
+			addName(c);
+		}
+		for (int64_t r = 0; r < spec.rows; r++)
+		{
+			endLine();
+			if (random.chance(spec.blank))
+				endLine();
+			if (random.chance(spec.comment)) {
+				text += "# a comment";
+				text += spec.separator;
+				text += " not a row";
+				endLine();
+			}
+
+			int count = spec.columns;
+			if (random.chance(spec.ragged))
+				count = random.chance(0.5) ? random.below(spec.columns) : spec.columns + 1 + random.below(2);
+			for (int c = 0; c < count; c++)
+			{
+				if (c > 0)
+					text += spec.separator;
+				addCell(c, r);
+			}
+		}
+		if (spec.finalNewline)
+			endLine();
+		if (!text.empty())
+			flush(text);
+	}
+
+	void endLine()
+	{
+		bool crlf = (spec.eol == CsvSpec::EOL_CRLF) || (spec.eol == CsvSpec::EOL_MIXED && random.chance(0.5));
+		text += crlf ? "\r\n" : "\n";
+		if (text.size() >= (1 << 16)) {
+			flush(text);
+			text.clear();
+		}
+	}
+
+	void addName(int c)
+	{
+		std::string name;
+		if (c < numColumnNames) {
+			const ColumnName& n = columnNames[c];
+			name = (spec.encoding == ENCODING_WINDOWS1252) ? n.latin : n.utf8;
+		} else {
+			name = "column " + std::to_string(c);
+		}
+		if (random.chance(spec.quote)) {
+			if (random.chance(0.5)) {
+				name += spec.separator;
+				name += " total";
+			}
+			addQuoted(name);
+		} else {
+			text += name;
+		}
+	}
+
+	void addCell(int c, int64_t r)
+	{
+		std::string cell;
+		bool word = false;
+		if (random.chance(spec.nan)) {
+		} else if (random.chance(spec.text)) {
+			cell = words[random.below(numWords)];
+			word = true;
+		} else {
+			cell = makeNumber(c, r);
+		}
+
+		bool quoted = random.chance(spec.quote) || cell.find(spec.separator) != std::string::npos;
+		bool padded = random.chance(spec.spaces);
+		if (padded)
+			text += (spec.separator != '\t' && random.chance(0.5)) ? " \t" : " ";
+		if (quoted) {
+			if (word && random.chance(0.5)) {
+				// What quotes are for
+				cell += spec.separator;
+				cell += random.chance(0.5) ? " and \"more\"" : " and more";
+			}
+			if (word && random.chance(spec.linebreak)) {
+				// Not in the middle of a character
+				size_t middle = cell.size() / 2;
+				while (middle > 0 && (cell[middle] & 0xc0) == 0x80)
+					middle--;
+				cell.insert(middle, (spec.eol == CsvSpec::EOL_LF) ? "\n" : "\r\n");
+			}
+			addQuoted(cell);
+		} else {
+			text += cell;
+		}
+		if (padded)
+			text += random.chance(0.5) ? " " : "  ";
+	}
+
+	void addQuoted(const std::string& cell)
+	{
+		text += '"';
+		for (char ch : cell)
+		{
+			text += ch;
+			if (ch == '"')
+				text += '"';
+		}
+		text += '"';
+	}
+
+	// The first four columns are like the benchmark files people load: an
+	// index, a smooth curve, noise written every which way and a random walk.
+	// The rest go round again at different speeds.
+	std::string makeNumber(int c, int64_t r)
+	{
+		char buffer[64];
+		double noise = random.next();
+		switch (c % 4)
+		{
+			case 0:
+				std::snprintf(buffer, sizeof(buffer), "%lld", (long long) r);
+				break;
+			case 1:
+				std::snprintf(buffer, sizeof(buffer), "%.6f", std::sin(r * 0.001 * (c / 4 + 1)));
+				break;
+			case 2:
+				switch (random.below(6))
+				{
+					case 0: std::snprintf(buffer, sizeof(buffer), "%.5f", noise); break;
+					case 1: std::snprintf(buffer, sizeof(buffer), "%g", noise * 1000.0); break;
+					case 2: std::snprintf(buffer, sizeof(buffer), "%.3e", noise * 1e-6); break;
+					case 3: std::snprintf(buffer, sizeof(buffer), "-%.2f", noise); break;
+					case 4: std::snprintf(buffer, sizeof(buffer), "+%.2f", noise); break;
+					default: std::snprintf(buffer, sizeof(buffer), "%.0f", noise * 1e9); break;
+				}
+				break;
+			default:
+				walks[c] += noise - 0.5;
+				std::snprintf(buffer, sizeof(buffer), "%.4f", walks[c]);
+				break;
+		}
+		std::string number = buffer;
+		if (spec.decimalPoint != '.') {
+			for (char& ch : number)
+			{
+				if (ch == '.')
+					ch = spec.decimalPoint;
+			}
+		}
+		return number;
+	}
+};
+
+// Encodes and compresses the text and passes it on
+struct Encoder
+{
+	const CsvSpec& spec;
+	const std::function<void(const char* data, size_t size)>& write;
+	std::string out;
+	uint32_t crc = 0xffffffffu;
+	uint32_t length = 0; // of the uncompressed data, modulo 2^32 as gzip has it
+
+	Encoder(const CsvSpec& spec, const std::function<void(const char* data, size_t size)>& write)
+		: spec(spec)
+		, write(write)
+	{
+	}
+
+	void begin()
+	{
+		if (spec.gzip) {
+			// No name, no time, unknown system
+			static const char header[10] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, '\xff'};
+			write(header, sizeof(header));
+		}
+		if (spec.encoding == ENCODING_UTF16LE)
+			emit("\xff\xfe", 2);
+		else if (spec.encoding == ENCODING_UTF16BE)
+			emit("\xfe\xff", 2);
+		else if (spec.encoding == ENCODING_UTF8 && spec.bom)
+			emit("\xef\xbb\xbf", 3);
+	}
+
+	void add(const std::string& text)
+	{
+		if (spec.encoding == ENCODING_UTF8) {
+			emit(text.data(), text.size());
+			return;
+		}
+		out.clear();
+		for (size_t i = 0; i < text.size();)
+		{
+			uint32_t cp = decodeUtf8(text, i);
+			if (spec.encoding == ENCODING_WINDOWS1252) {
+				out += toWindows1252(cp);
+			} else if (cp >= 0x10000) {
+				cp -= 0x10000;
+				addUtf16(0xd800 + (cp >> 10));
+				addUtf16(0xdc00 + (cp & 0x3ff));
+			} else {
+				addUtf16(cp);
+			}
+		}
+		emit(out.data(), out.size());
+	}
+
+	void finish()
+	{
+		if (!spec.gzip)
+			return;
+		// An empty last block, then the checksum and length
+		static const char last[5] = {1, 0, 0, '\xff', '\xff'};
+		write(last, sizeof(last));
+		char trailer[8];
+		uint32_t check = crc ^ 0xffffffffu;
+		for (int i = 0; i < 4; i++)
+		{
+			trailer[i] = static_cast<char>(check >> (8 * i));
+			trailer[4 + i] = static_cast<char>(length >> (8 * i));
+		}
+		write(trailer, sizeof(trailer));
+	}
+
+	// Compressed files are written as stored blocks. The reader still has to
+	// go through gzip and deflate, which is the point.
+	void emit(const char* data, size_t size)
+	{
+		if (!spec.gzip) {
+			write(data, size);
+			return;
+		}
+		updateCrc(data, size);
+		length += static_cast<uint32_t>(size);
+		while (size > 0)
+		{
+			size_t n = std::min<size_t>(size, 65535);
+			char header[5] = {0, static_cast<char>(n), static_cast<char>(n >> 8), static_cast<char>(~n), static_cast<char>(~n >> 8)};
+			write(header, sizeof(header));
+			write(data, n);
+			data += n;
+			size -= n;
+		}
+	}
+
+	void updateCrc(const char* data, size_t size)
+	{
+		static uint32_t table[256];
+		if (!table[1]) {
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				table[n] = c;
+			}
+		}
+		for (size_t i = 0; i < size; i++)
+			crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+	}
+
+	void addUtf16(uint32_t unit)
+	{
+		char a = static_cast<char>(unit & 0xff);
+		char b = static_cast<char>(unit >> 8);
+		if (spec.encoding == ENCODING_UTF16LE) {
+			out += a;
+			out += b;
+		} else {
+			out += b;
+			out += a;
+		}
+	}
+
+	// The text is all our own, so it's always valid
+	static uint32_t decodeUtf8(const std::string& text, size_t& i)
+	{
+		uint8_t b = text[i++];
+		if (b < 0x80)
+			return b;
+		int extra = (b >= 0xf0) ? 3 : (b >= 0xe0) ? 2 : 1;
+		uint32_t cp = b & (0x3f >> extra);
+		for (int k = 0; k < extra; k++)
+			cp = (cp << 6) | (text[i++] & 0x3f);
+		return cp;
+	}
+
+	static char toWindows1252(uint32_t cp)
+	{
+		if (cp < 0x80 || (cp >= 0xa0 && cp < 0x100))
+			return static_cast<char>(cp);
+		for (int k = 0; k < 32; k++)
+		{
+			if (windows1252High[k] == cp)
+				return static_cast<char>(0x80 + k);
+		}
+		return '?';
+	}
+};
+
+} // namespace
+
+
+CsvSpec parseCsvSpec(const std::string& text)
+{
+	CsvSpec spec;
+	size_t pos = 0;
+	while (pos < text.size())
+	{
+		size_t end = text.find_first_of(" \t\n", pos);
+		if (end == std::string::npos)
+			end = text.size();
+		std::string word = text.substr(pos, end - pos);
+		pos = end + 1;
+		if (word.empty())
+			continue;
+
+		size_t equals = word.find('=');
+		if (equals == std::string::npos)
+			throw std::runtime_error("expected key=value, got " + word);
+		std::string key = word.substr(0, equals);
+		std::string value = word.substr(equals + 1);
+		if (key == "seed") {
+			spec.seed = static_cast<uint64_t>(parseNumber(key, value));
+		} else if (key == "rows") {
+			spec.rows = static_cast<int64_t>(parseNumber(key, value));
+			if (spec.rows < 0)
+				throw std::runtime_error("rows can't be negative");
+		} else if (key == "columns") {
+			spec.columns = static_cast<int>(parseNumber(key, value));
+			if (spec.columns < 1)
+				throw std::runtime_error("there has to be a column");
+		} else if (key == "separator") {
+			if (value == "comma")
+				spec.separator = ',';
+			else if (value == "semicolon")
+				spec.separator = ';';
+			else if (value == "tab")
+				spec.separator = '\t';
+			else
+				throw std::runtime_error("separator has to be comma, semicolon or tab");
+		} else if (key == "decimal") {
+			if (value == "point")
+				spec.decimalPoint = '.';
+			else if (value == "comma")
+				spec.decimalPoint = ',';
+			else
+				throw std::runtime_error("decimal has to be point or comma");
+		} else if (key == "encoding") {
+			spec.bom = false;
+			if (value == "utf8") {
+				spec.encoding = ENCODING_UTF8;
+			} else if (value == "utf8bom") {
+				spec.encoding = ENCODING_UTF8;
+				spec.bom = true;
+			} else if (value == "utf16le") {
+				spec.encoding = ENCODING_UTF16LE;
+			} else if (value == "utf16be") {
+				spec.encoding = ENCODING_UTF16BE;
+			} else if (value == "cp1252") {
+				spec.encoding = ENCODING_WINDOWS1252;
+			} else {
+				throw std::runtime_error("encoding has to be utf8, utf8bom, utf16le, utf16be or cp1252");
+			}
+		} else if (key == "eol") {
+			if (value == "lf")
+				spec.eol = CsvSpec::EOL_LF;
+			else if (value == "crlf")
+				spec.eol = CsvSpec::EOL_CRLF;
+			else if (value == "mixed")
+				spec.eol = CsvSpec::EOL_MIXED;
+			else
+				throw std::runtime_error("eol has to be lf, crlf or mixed");
+		} else if (key == "final") {
+			spec.finalNewline = parseNumber(key, value) != 0.0;
+		} else if (key == "gzip") {
+			spec.gzip = parseNumber(key, value) != 0.0;
+		} else if (key == "nan") {
+			spec.nan = parseFraction(key, value);
+		} else if (key == "text") {
+			spec.text = parseFraction(key, value);
+		} else if (key == "quote") {
+			spec.quote = parseFraction(key, value);
+		} else if (key == "linebreak") {
+			spec.linebreak = parseFraction(key, value);
+		} else if (key == "spaces") {
+			spec.spaces = parseFraction(key, value);
+		} else if (key == "blank") {
+			spec.blank = parseFraction(key, value);
+		} else if (key == "comment") {
+			spec.comment = parseFraction(key, value);
+		} else if (key == "ragged") {
+			spec.ragged = parseFraction(key, value);
+		} else {
+			throw std::runtime_error("unknown key " + key);
+		}
+	}
+	return spec;
+}
+
+std::string describeCsvSpec(const CsvSpec& spec)
+{
+	static const char* separators[] = {"comma", "semicolon", "tab"};
+	static const char* encodings[] = {"utf8", "utf16le", "utf16be", "cp1252"};
+	static const char* eols[] = {"lf", "crlf", "mixed"};
+	int separator = (spec.separator == ';') ? 1 : (spec.separator == '\t') ? 2 : 0;
+	const char* encoding = (spec.encoding == ENCODING_UTF8 && spec.bom) ? "utf8bom" : encodings[spec.encoding];
+
+	char buffer[512];
+	std::snprintf(buffer, sizeof(buffer),
+		"seed=%llu rows=%lld columns=%d separator=%s decimal=%s encoding=%s eol=%s final=%d gzip=%d "
+		"nan=%g text=%g quote=%g linebreak=%g spaces=%g blank=%g comment=%g ragged=%g",
+		(unsigned long long) spec.seed, (long long) spec.rows, spec.columns, separators[separator],
+		(spec.decimalPoint == ',') ? "comma" : "point", encoding, eols[spec.eol], spec.finalNewline ? 1 : 0, spec.gzip ? 1 : 0,
+		spec.nan, spec.text, spec.quote, spec.linebreak, spec.spaces, spec.blank, spec.comment, spec.ragged);
+	return buffer;
+}
+
+void generateCsv(const CsvSpec& spec, const std::function<void(const char* data, size_t size)>& write)
+{
+	Encoder encoder(spec, write);
+	encoder.begin();
+	std::function<void(const std::string&)> flush = [&](const std::string& text) {
+		encoder.add(text);
+	};
+	TextWriter(spec, flush).run();
+	encoder.finish();
+}
+
+std::string generateCsvText(const CsvSpec& spec)
+{
+	std::string all;
+	std::function<void(const std::string&)> flush = [&](const std::string& text) {
+		all += text;
+	};
+	TextWriter(spec, flush).run();
+	return all;
+}
+
+void writeCsvFile(const std::string& path, const CsvSpec& spec)
+{
+	FILE* f = std::fopen(path.c_str(), "wb");
+	if (!f)
+		throw std::runtime_error("can't write " + path);
+	bool ok = true;
+	generateCsv(spec, [&](const char* data, size_t size) {
+		ok = ok && std::fwrite(data, 1, size, f) == size;
+	});
+	ok = (std::fclose(f) == 0) && ok;
+	if (!ok)
+		throw std::runtime_error("couldn't write all of " + path);
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "Transcode.hpp"
+
+// Makes CSV files for benchmarks and stress tests, with as many rows and
+// columns as wanted and whatever awkward bits real files have. The same spec
+// always makes the same file.
+//
+// Specs are written as key=value words, like "rows=1e6 columns=8 nan=0.01
+// encoding=utf16le eol=crlf". Fractions are of cells, or of rows for the
+// ones that add or change whole lines. See parseCsvSpec() for the keys.
+struct CsvSpec
+{
+	uint64_t seed = 1;
+	int64_t rows = 1000;
+	int columns = 4;
+	char separator = ',';
+	char decimalPoint = '.';
+	TextEncoding encoding = ENCODING_UTF8;
+	bool bom = false; // UTF-8 only, UTF-16 always has one
+	enum LineEnding
+	{
+		EOL_LF,
+		EOL_CRLF,
+		EOL_MIXED, // either, picked line by line
+	};
+	LineEnding eol = EOL_LF;
+	bool finalNewline = true;
+	bool gzip = false;
+
+	double nan = 0.0; // blank cells
+	double text = 0.0; // words where numbers should be
+	double quote = 0.0; // cells in quotes, quoted words can have separators and quotes in them
+	double linebreak = 0.0; // quoted words with a line break in them
+	double spaces = 0.0; // cells with spaces around them
+	double blank = 0.0; // empty lines before rows
+	double comment = 0.0; // lines starting with # before rows
+	double ragged = 0.0; // rows with cells missing or extra ones
+};
+
+// Reads a spec, starting from the defaults. Throws std::runtime_error on keys
+// or values it doesn't know.
+//
+// Keys: seed, rows, columns, separator (comma, semicolon or tab), decimal
+// (point or comma), encoding (utf8, utf8bom, utf16le, utf16be or cp1252), eol
+// (lf, crlf or mixed), final (1 to end the last row with a line break, 0
+// not), gzip (0 or 1), and the fractions nan, text, quote, linebreak,
+// spaces, blank, comment and ragged. Numbers can be written like 1e6.
+CsvSpec parseCsvSpec(const std::string& text);
+
+// The spec written out in full, so it can be made again
+std::string describeCsvSpec(const CsvSpec& spec);
+
+// Makes the file a piece at a time, encoded and compressed as asked, so files
+// of any size can be made without holding them in memory
+void generateCsv(const CsvSpec& spec, const std::function<void(const char* data, size_t size)>& write);
+
+// The file as UTF-8, before any byte order mark, encoding or compression
+std::string generateCsvText(const CsvSpec& spec);
+
+// Throws std::runtime_error if the file can't be written
+void writeCsvFile(const std::string& path, const CsvSpec& spec);
+
+// Same numbers every run on every computer. xorshift64*.
+struct CsvRandom
+{
+	uint64_t state;
+
+	explicit CsvRandom(uint64_t seed)
+		: state(seed * 0x9e3779b97f4a7c15ull + 0x2545f4914f6cdd1dull)
+	{
+		if (!state)
+			state = 1;
+	}
+
+	uint64_t bits()
+	{
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 0x2545f4914f6cdd1dull;
+	}
+
+	// From 0 up to but not including 1
+	double next()
+	{
+		return (bits() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	// From 0 up to but not including n
+	int below(int n)
+	{
+		return static_cast<int>(next() * n);
+	}
+
+	bool chance(double p)
+	{
+		return p > 0.0 && next() < p;
+	}
+};
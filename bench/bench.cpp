@@ -0,0 +1,397 @@
+// Times loading files and running the module without Rack, see the README.
+// Results go to stdout as JSON, progress to stderr.
+//
+//   ./loudbench [--max-rows N] [--seconds S] [--spec SPEC] [--data-dir DIR] [--work-dir DIR]
+//
+// The made-up files are a few columns with the odd blank cell, unless --spec
+// asks for something else, see CsvGenerator.hpp.
+#include "../src/LoudNumbers.cpp"
+#include "ThreadPool.hpp"
+#include "CsvGenerator.hpp"
+#include "Inflate.hpp"
+#include <chrono>
+#include <dirent.h>
+#include <unistd.h>
+
+Plugin* pluginInstance = NULL;
+std::string rack::asset::userDir;
+
+namespace {
+
+double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs fn until it has taken at least minTime altogether, at least once, and
+// returns the quickest run. Big files only get the one run.
+template <typename F>
+double timeBest(double minTime, F fn)
+{
+	double best = INFINITY;
+	double total = 0.0;
+	int runs = 0;
+	while (runs == 0 || (total < minTime && runs < 1000))
+	{
+		double start = now();
+		fn();
+		double elapsed = now() - start;
+		best = std::min(best, elapsed);
+		total += elapsed;
+		runs++;
+	}
+	return best;
+}
+
+void clearDirectory(const std::string& dir)
+{
+	DIR* d = opendir(dir.c_str());
+	if (!d)
+		return;
+	while (struct dirent* entry = readdir(d))
+	{
+		std::string name = entry->d_name;
+		if (name != "." && name != "..")
+			unlink((dir + "/" + name).c_str());
+	}
+	closedir(d);
+}
+
+struct CountingSink
+{
+	size_t rows = 0;
+	size_t cells = 0;
+
+	void row(const CsvCell*, size_t count)
+	{
+		rows++;
+		cells += count;
+	}
+};
+
+struct ConvertingSink
+{
+	size_t rows = 0;
+	double sum = 0.0;
+	char decimalPoint = '.';
+
+	void row(const CsvCell* cells, size_t count)
+	{
+		// Skip the header like the loader does
+		if (rows++ == 0)
+			return;
+		for (size_t c = 0; c < count; c++)
+		{
+			float value = parseFloatCell(cells[c], decimalPoint);
+			if (value == value)
+				sum += value;
+		}
+	}
+};
+
+struct Output
+{
+	std::vector<std::string> loads;
+	std::vector<std::string> processes;
+
+	void addLoad(const std::string& file, const std::string& stage, int64_t rows, uint64_t bytes, double seconds)
+	{
+		loads.push_back(string::f("{\"file\": \"%s\", \"stage\": \"%s\", \"rows\": %lld, \"bytes\": %llu, \"seconds\": %.9f, \"mb_per_second\": %.1f}",
+			file.c_str(), stage.c_str(), (long long) rows, (unsigned long long) bytes, seconds, bytes / seconds / 1e6));
+		std::fprintf(stderr, "  %-18s %12.1f us\n", stage.c_str(), seconds * 1e6);
+	}
+
+	void addProcess(const std::string& mode, float sampleRate, double nsPerSample)
+	{
+		double realtime = 1e9 / (nsPerSample * sampleRate);
+		processes.push_back(string::f("{\"mode\": \"%s\", \"sample_rate\": %d, \"ns_per_sample\": %.3f, \"realtime\": %.1f}",
+			mode.c_str(), (int) sampleRate, nsPerSample, realtime));
+		std::fprintf(stderr, "  %-24s %6d Hz %9.2f ns/sample %9.0fx realtime\n", mode.c_str(), (int) sampleRate, nsPerSample, realtime);
+	}
+
+	void print()
+	{
+		std::printf("{\n\t\"version\": 1,\n");
+		std::printf("\t\"csv_scan\": \"%s\",\n", getCsvScanLevelName(getBestCsvScanLevel()));
+		std::printf("\t\"threads\": %d,\n", ThreadPool::shared().getThreads());
+		std::printf("\t\"load\": [\n");
+		for (size_t i = 0; i < loads.size(); i++)
+			std::printf("\t\t%s%s\n", loads[i].c_str(), i + 1 < loads.size() ? "," : "");
+		std::printf("\t],\n\t\"process\": [\n");
+		for (size_t i = 0; i < processes.size(); i++)
+			std::printf("\t\t%s%s\n", processes[i].c_str(), i + 1 < processes.size() ? "," : "");
+		std::printf("\t]\n}\n");
+	}
+};
+
+// Runs the module until it has swapped in a dataset newer than generation.
+// Returns false if the load failed.
+bool waitForDataset(LoudNumbers& module, uint64_t generation)
+{
+	Module::ProcessArgs args = {48000.f, 1.f / 48000.f, 0};
+	while (module.datasets.current()->generation <= generation)
+	{
+		if (module.badcsv)
+			return false;
+		module.process(args);
+		if (!module.loader.isBusy())
+			std::this_thread::yield();
+	}
+	module.datasets.collect();
+	return true;
+}
+
+// Every stage of loading a file, from splitting it up to the audio thread
+// playing it
+void benchLoad(Output& output, const std::string& path, const std::string& name, const std::string& cacheDir)
+{
+	uint64_t bytes;
+	int64_t mtime;
+	if (!getFileInfo(path, bytes, mtime)) {
+		std::fprintf(stderr, "%s is missing, skipped\n", path.c_str());
+		return;
+	}
+	std::fprintf(stderr, "%s, %.1f MB\n", name.c_str(), bytes / 1e6);
+	const double minTime = 0.2;
+
+	std::shared_ptr<Dataset> dataset;
+	double seconds = timeBest(minTime, [&]() {
+		LoadProgress progress;
+		dataset = parseCSV(path, progress);
+	});
+	int64_t rows = dataset->datalength;
+	output.addLoad(name, "parsecsv", rows, bytes, seconds);
+
+	// The parser on its own, first just finding the cells and then converting
+	// them too. Only for plain UTF-8, since other files are converted first.
+	size_t bomLength;
+	MappedFile file(path);
+	if (!isGzipData(file.data(), file.size()) && detectEncoding(file.data(), file.size(), bomLength) == ENCODING_UTF8) {
+		const char* text = file.data() + bomLength;
+		size_t size = file.size() - bomLength;
+		CsvOptions options = sniffCsvOptions(text, std::min<size_t>(size, 64 << 10));
+		std::vector<uint64_t> masks(4096);
+		output.addLoad(name, "scan", rows, bytes, timeBest(minTime, [&]() {
+			for (size_t block = 0; block < size; block += 64 * 4096)
+				scanStructural(text + block, std::min<size_t>(size - block, 64 * 4096), options.separator, masks.data());
+		}));
+		output.addLoad(name, "parse", rows, bytes, timeBest(minTime, [&]() {
+			CsvParser parser(options);
+			CountingSink counted;
+			parser.parse(text, size, true, counted);
+		}));
+		output.addLoad(name, "parse_convert", rows, bytes, timeBest(minTime, [&]() {
+			CsvParser parser(options);
+			ConvertingSink converted;
+			converted.decimalPoint = options.decimalPoint;
+			parser.parse(text, size, true, converted);
+		}));
+	}
+
+	output.addLoad(name, "stats", rows, bytes, timeBest(minTime, [&]() {
+		for (DataColumn& column : dataset->data)
+			column.stats = computeColumnStats(column.values, dataset->datalength);
+	}));
+
+	output.addLoad(name, "overviews", rows, bytes, timeBest(minTime, [&]() {
+		makeOverviews(*dataset);
+	}));
+
+	output.addLoad(name, "mipmaps", rows, bytes, timeBest(minTime, [&]() {
+		makeMipmaps(*dataset);
+	}));
+	dataset.reset();
+
+	// Through the module, as when a file is picked from the menu. The first
+	// time parses the file and writes the cache, the next maps the cache.
+	LoudNumbers module;
+	output.addLoad(name, "processcsv", rows, bytes, timeBest(minTime, [&]() {
+		clearDirectory(cacheDir);
+		module.processCSV(path);
+		if (!waitForDataset(module, module.datasets.current()->generation))
+			throw std::runtime_error("couldn't load " + path);
+	}));
+	output.addLoad(name, "processcsv_cached", rows, bytes, timeBest(minTime, [&]() {
+		module.processCSV(path);
+		if (!waitForDataset(module, module.datasets.current()->generation))
+			throw std::runtime_error("couldn't load " + path);
+	}));
+	clearDirectory(cacheDir);
+}
+
+// Handing a dataset over to the audio thread and freeing the old one, which
+// shouldn't depend on its size
+void benchSwap(Output& output)
+{
+	DatasetHandoff handoff;
+	std::vector<std::shared_ptr<Dataset>> datasets(1000);
+	for (std::shared_ptr<Dataset>& dataset : datasets)
+		dataset = std::make_shared<Dataset>();
+	double start = now();
+	for (std::shared_ptr<Dataset>& dataset : datasets)
+	{
+		handoff.publish(dataset);
+		handoff.acquire();
+		handoff.collect();
+	}
+	output.addLoad("empty", "swap", 0, 0, (now() - start) / datasets.size());
+}
+
+// A dataset like a wide file, made in memory so only process() is timed
+std::shared_ptr<Dataset> makeProcessDataset(int rows)
+{
+	std::shared_ptr<Dataset> dataset = std::make_shared<Dataset>();
+	CsvRandom random(1);
+	for (int c = 0; c < LoudNumbers::maxpolychannels; c++)
+	{
+		std::vector<float> values(rows);
+		for (int r = 0; r < rows; r++)
+			values[r] = (random.next() < 0.001) ? NAN : std::sin(r * (c + 1) * 0.01f) + random.next() * 0.1f;
+		DataColumn column;
+		column.setValues(std::move(values));
+		column.stats = computeColumnStats(column.values, rows);
+		dataset->columns.push_back(string::f("column %d", c));
+		dataset->data.push_back(std::move(column));
+	}
+	dataset->datalength = rows;
+	makeOverviews(*dataset);
+	makeMipmaps(*dataset);
+	return dataset;
+}
+
+// Each mode is set up on a fresh module playing the same data. Triggers come
+// at 1 kHz, the position input sweeps the whole file every second and the
+// oscillator plays at middle C.
+void benchProcess(Output& output, const std::string& mode, float sampleRate, double seconds, const std::shared_ptr<Dataset>& data)
+{
+	// The handoff owns what it's given, so each module gets its own copy
+	std::shared_ptr<Dataset> copy = std::make_shared<Dataset>();
+	copy->columns = data->columns;
+	copy->datalength = data->datalength;
+	for (const DataColumn& column : data->data)
+	{
+		DataColumn c;
+		c.values = column.values;
+		c.stats = column.stats;
+		c.overview = column.overview;
+		c.mipmaps = column.mipmaps;
+		copy->data.push_back(std::move(c));
+	}
+
+	LoudNumbers module;
+	bool triggers = (mode != "idle");
+	module.inputs[LoudNumbers::TRIG_INPUT].setChannels(triggers ? 1 : 0);
+	if (mode == "times") {
+		copy->timedeltas.assign(copy->datalength, 1.f);
+		module.params[LoudNumbers::SPEED_PARAM].setValue(7.f);
+	}
+	module.datasets.publish(copy);
+	if (mode == "poly16") {
+		std::vector<int> columns;
+		for (int c = 0; c < LoudNumbers::maxpolychannels; c++)
+			columns.push_back(c);
+		module.setPolyColumns(columns);
+	}
+	if (mode == "position" || mode == "position_smooth")
+		module.inputs[LoudNumbers::POSITION_INPUT].setChannels(1);
+	module.smoothposition = (mode == "position_smooth");
+	if (mode.compare(0, 10, "oscillator") == 0) {
+		module.oscillator = true;
+		if (mode == "oscillator_linear")
+			module.interpolation = INTERPOLATION_LINEAR;
+		else if (mode == "oscillator_cubic")
+			module.interpolation = INTERPOLATION_CUBIC;
+		else
+			module.interpolation = INTERPOLATION_BANDLIMITED;
+	}
+
+	Module::ProcessArgs args = {sampleRate, 1.f / sampleRate, 0};
+	const int64_t frames = static_cast<int64_t>(sampleRate * seconds);
+	const int64_t triggerHalf = std::max(static_cast<int64_t>(sampleRate / 2000.f), (int64_t) 1);
+	// Warm up, which also swaps the dataset in
+	for (int i = 0; i < 1000; i++)
+		module.process(args);
+
+	double best = INFINITY;
+	for (int run = 0; run < 3; run++)
+	{
+		double start = now();
+		for (int64_t frame = 0; frame < frames; frame++)
+		{
+			args.frame = frame;
+			module.inputs[LoudNumbers::TRIG_INPUT].setVoltage((triggers && ((frame / triggerHalf) & 1)) ? 10.f : 0.f);
+			module.inputs[LoudNumbers::POSITION_INPUT].setVoltage(10.f * (frame % (int64_t) sampleRate) / sampleRate);
+			module.process(args);
+		}
+		best = std::min(best, now() - start);
+	}
+	output.addProcess(mode, sampleRate, best * 1e9 / frames);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	int64_t maxRows = 10000000;
+	double seconds = 2.0;
+	std::string dataDir = "..";
+	std::string workDir = "bench_work";
+	std::string spec = "columns=4 nan=0.001";
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		if (arg == "--max-rows") {
+			maxRows = static_cast<int64_t>(std::atof(argv[i + 1]));
+		} else if (arg == "--seconds") {
+			seconds = std::atof(argv[i + 1]);
+		} else if (arg == "--spec") {
+			spec = argv[i + 1];
+		} else if (arg == "--data-dir") {
+			dataDir = argv[i + 1];
+		} else if (arg == "--work-dir") {
+			workDir = argv[i + 1];
+		} else {
+			std::fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	// The module keeps its cache under here
+	rack::asset::userDir = workDir;
+	std::string cacheDir = rack::asset::user("LoudNumbers/cache");
+	rack::system::createDirectories(cacheDir);
+
+	Output output;
+	try {
+		benchLoad(output, dataDir + "/temperature.csv", "temperature.csv", cacheDir);
+		benchLoad(output, dataDir + "/sunspots.csv", "sunspots.csv", cacheDir);
+		for (int64_t rows = 1000; rows <= maxRows; rows *= 10)
+		{
+			CsvSpec parsed = parseCsvSpec(spec);
+			parsed.rows = rows;
+			std::string name = string::f("synthetic_%lld.csv%s", (long long) rows, parsed.gzip ? ".gz" : "");
+			std::string path = workDir + "/" + name;
+			writeCsvFile(path, parsed);
+			benchLoad(output, path, name, cacheDir);
+			unlink(path.c_str());
+		}
+		benchSwap(output);
+
+		std::fprintf(stderr, "process()\n");
+		std::shared_ptr<Dataset> data = makeProcessDataset(1000000);
+		const char* modes[] = {"idle", "trigger", "times", "poly16", "position", "position_smooth",
+			"oscillator_linear", "oscillator_cubic", "oscillator_bandlimited"};
+		const float rates[] = {48000.f, 96000.f, 192000.f};
+		for (const char* mode : modes)
+		{
+			for (float rate : rates)
+				benchProcess(output, mode, rate, seconds, data);
+		}
+	} catch (std::exception& e) {
+		std::fprintf(stderr, "failed: %s\n", e.what());
+		return 1;
+	}
+
+	output.print();
+	return 0;
+}
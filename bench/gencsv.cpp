@@ -0,0 +1,42 @@
+// Makes a CSV file from a spec, see CsvGenerator.hpp.
+//
+//   ./gencsv rows=1e6 columns=8 nan=0.01 encoding=utf16le > big.csv
+//   ./gencsv out=big.csv.gz gzip=1 rows=1e7
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include "CsvGenerator.hpp"
+
+int main(int argc, char** argv)
+{
+	std::string spec;
+	std::string out;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "-h" || arg == "--help") {
+			std::fprintf(stderr, "usage: gencsv [out=FILE] [key=value ...]\n");
+			std::fprintf(stderr, "keys and defaults: %s\n", describeCsvSpec(CsvSpec()).c_str());
+			return 0;
+		}
+		if (arg.compare(0, 4, "out=") == 0)
+			out = arg.substr(4);
+		else
+			spec += arg + " ";
+	}
+
+	try {
+		CsvSpec parsed = parseCsvSpec(spec);
+		if (out.empty()) {
+			generateCsv(parsed, [](const char* data, size_t size) {
+				std::fwrite(data, 1, size, stdout);
+			});
+		} else {
+			writeCsvFile(out, parsed);
+		}
+	} catch (std::exception& e) {
+		std::fprintf(stderr, "gencsv: %s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,23 @@
+#pragma once
+// Stands in for osdialog, the benchmarks never open a file dialog
+
+typedef enum
+{
+	OSDIALOG_OPEN,
+	OSDIALOG_OPEN_DIR,
+	OSDIALOG_SAVE,
+} osdialog_file_action;
+
+typedef struct osdialog_filters osdialog_filters;
+
+inline char* osdialog_file(osdialog_file_action, const char*, const char*, osdialog_filters*)
+{
+	return NULL;
+}
+
+inline osdialog_filters* osdialog_filters_parse(const char*)
+{
+	return NULL;
+}
+
+inline void osdialog_filters_free(osdialog_filters*) {}
@@ -0,0 +1,696 @@
+#pragma once
+// Stand-ins for the parts of the Rack API the plugin uses, so the module can
+// be built and timed without the Rack SDK. The engine side (ports, params,
+// simd, dsp) works like Rack's, closely enough for the timings to mean
+// something. The UI side only has to compile, the benchmarks never draw.
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#endif
+
+// Logging is left out, it would only be timed
+#define DEBUG(...) ((void) 0)
+#define INFO(...) ((void) 0)
+#define WARN(...) ((void) 0)
+
+
+// jansson, only reached when saving and loading patches
+
+struct json_t;
+inline json_t* json_object() { return NULL; }
+inline json_t* json_object_get(const json_t*, const char*) { return NULL; }
+inline int json_object_set_new(json_t*, const char*, json_t*) { return 0; }
+inline json_t* json_string(const char*) { return NULL; }
+inline json_t* json_integer(long long) { return NULL; }
+inline json_t* json_boolean(bool) { return NULL; }
+inline json_t* json_array() { return NULL; }
+inline int json_array_append_new(json_t*, json_t*) { return 0; }
+inline size_t json_array_size(const json_t*) { return 0; }
+inline json_t* json_array_get(const json_t*, size_t) { return NULL; }
+inline const char* json_string_value(const json_t*) { return NULL; }
+inline long long json_integer_value(const json_t*) { return 0; }
+inline bool json_boolean_value(const json_t*) { return false; }
+
+
+// NanoVG, only reached when drawing
+
+struct NVGcontext;
+struct NVGcolor
+{
+	float r, g, b, a;
+};
+enum NVGalign
+{
+	NVG_ALIGN_LEFT = 1 << 0,
+	NVG_ALIGN_CENTER = 1 << 1,
+};
+inline void nvgBeginPath(NVGcontext*) {}
+inline void nvgClosePath(NVGcontext*) {}
+inline void nvgMoveTo(NVGcontext*, float, float) {}
+inline void nvgLineTo(NVGcontext*, float, float) {}
+inline void nvgCircle(NVGcontext*, float, float, float) {}
+inline void nvgStroke(NVGcontext*) {}
+inline void nvgStrokeColor(NVGcontext*, NVGcolor) {}
+inline void nvgStrokeWidth(NVGcontext*, float) {}
+inline void nvgFill(NVGcontext*) {}
+inline void nvgFillColor(NVGcontext*, NVGcolor) {}
+inline void nvgFontSize(NVGcontext*, float) {}
+inline void nvgTextAlign(NVGcontext*, int) {}
+inline float nvgText(NVGcontext*, float x, float, const char*, const char*) { return x; }
+
+#define GLFW_MOD_SHIFT 0x0001
+#define RACK_MOD_MASK 0x000f
+
+
+namespace rack {
+
+template <typename T>
+T clamp(T x, T a, T b)
+{
+	return std::max(std::min(x, b), a);
+}
+
+namespace math {
+
+struct Vec
+{
+	float x = 0.f;
+	float y = 0.f;
+
+	Vec() {}
+	Vec(float x, float y) : x(x), y(y) {}
+};
+
+struct Rect
+{
+	Vec pos;
+	Vec size;
+};
+
+} // namespace math
+
+using math::Vec;
+using math::Rect;
+
+inline float mm2px(float mm)
+{
+	return mm * 75.f / 25.4f;
+}
+
+inline Vec mm2px(Vec mm)
+{
+	return Vec(mm2px(mm.x), mm2px(mm.y));
+}
+
+namespace color {
+
+inline NVGcolor fromHexString(std::string s)
+{
+	unsigned r = 0, g = 0, b = 0;
+	std::sscanf(s.c_str(), "#%02x%02x%02x", &r, &g, &b);
+	NVGcolor c = {r / 255.f, g / 255.f, b / 255.f, 1.f};
+	return c;
+}
+
+} // namespace color
+
+namespace string {
+
+inline std::string f(const char* format, ...)
+{
+	char buffer[1024];
+	va_list args;
+	va_start(args, format);
+	std::vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	return buffer;
+}
+
+inline std::string toBase64(const uint8_t*, size_t)
+{
+	return "";
+}
+
+inline std::vector<uint8_t> fromBase64(const std::string&)
+{
+	return std::vector<uint8_t>();
+}
+
+} // namespace string
+
+namespace system {
+
+inline bool createDirectories(const std::string& path)
+{
+	for (size_t i = 1; i <= path.size(); i++)
+	{
+		if (i < path.size() && path[i] != '/')
+			continue;
+#if defined(_WIN32)
+		_mkdir(path.substr(0, i).c_str());
+#else
+		mkdir(path.substr(0, i).c_str(), 0755);
+#endif
+	}
+	return true;
+}
+
+} // namespace system
+
+struct Plugin;
+
+namespace asset {
+
+// Where the benchmark keeps the module's cache, set before making modules
+extern std::string userDir;
+
+inline std::string user(std::string filename)
+{
+	return userDir + "/" + filename;
+}
+
+inline std::string plugin(Plugin*, std::string filename)
+{
+	return filename;
+}
+
+} // namespace asset
+
+
+// Like Rack's float_4 without the SSE. Compilers vectorize most of it anyway.
+namespace simd {
+
+struct float_4
+{
+	float s[4];
+
+	float_4() {}
+	float_4(float x)
+	{
+		s[0] = s[1] = s[2] = s[3] = x;
+	}
+	float_4(float a, float b, float c, float d)
+	{
+		s[0] = a;
+		s[1] = b;
+		s[2] = c;
+		s[3] = d;
+	}
+
+	static float_4 load(const float* p)
+	{
+		return float_4(p[0], p[1], p[2], p[3]);
+	}
+
+	void store(float* p) const
+	{
+		std::memcpy(p, s, sizeof(s));
+	}
+
+	float& operator[](int i)
+	{
+		return s[i];
+	}
+
+	const float& operator[](int i) const
+	{
+		return s[i];
+	}
+};
+
+#define BENCH_FLOAT_4_OP(op) \
+	inline float_4 operator op(const float_4& a, const float_4& b) \
+	{ \
+		return float_4(a.s[0] op b.s[0], a.s[1] op b.s[1], a.s[2] op b.s[2], a.s[3] op b.s[3]); \
+	} \
+	inline float_4& operator op##=(float_4& a, const float_4& b) \
+	{ \
+		return a = a op b; \
+	}
+BENCH_FLOAT_4_OP(+)
+BENCH_FLOAT_4_OP(-)
+BENCH_FLOAT_4_OP(*)
+BENCH_FLOAT_4_OP(/)
+#undef BENCH_FLOAT_4_OP
+
+// Comparisons give masks of all set bits, like SSE
+inline float maskLane(bool set)
+{
+	uint32_t bits = set ? 0xffffffffu : 0u;
+	float f;
+	std::memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+inline bool laneSet(float f)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &f, sizeof(bits));
+	return bits != 0;
+}
+
+#define BENCH_FLOAT_4_COMPARE(op) \
+	inline float_4 operator op(const float_4& a, const float_4& b) \
+	{ \
+		return float_4(maskLane(a.s[0] op b.s[0]), maskLane(a.s[1] op b.s[1]), maskLane(a.s[2] op b.s[2]), maskLane(a.s[3] op b.s[3])); \
+	}
+BENCH_FLOAT_4_COMPARE(==)
+BENCH_FLOAT_4_COMPARE(!=)
+BENCH_FLOAT_4_COMPARE(<)
+BENCH_FLOAT_4_COMPARE(>)
+BENCH_FLOAT_4_COMPARE(<=)
+BENCH_FLOAT_4_COMPARE(>=)
+#undef BENCH_FLOAT_4_COMPARE
+
+inline float_4 ifelse(const float_4& mask, const float_4& a, const float_4& b)
+{
+	float_4 r;
+	for (int i = 0; i < 4; i++)
+		r.s[i] = laneSet(mask.s[i]) ? a.s[i] : b.s[i];
+	return r;
+}
+
+} // namespace simd
+
+
+namespace dsp {
+
+static const float FREQ_C4 = 261.6256f;
+
+struct SchmittTrigger
+{
+	bool high = false;
+
+	bool process(float in, float lowThreshold = 0.f, float highThreshold = 1.f)
+	{
+		if (high) {
+			if (in <= lowThreshold)
+				high = false;
+		} else if (in >= highThreshold) {
+			high = true;
+			return true;
+		}
+		return false;
+	}
+};
+
+struct PulseGenerator
+{
+	float remaining = 0.f;
+
+	void trigger(float duration = 1e-3f)
+	{
+		remaining = std::max(remaining, duration);
+	}
+
+	bool process(float deltaTime)
+	{
+		if (remaining > 0.f) {
+			remaining -= deltaTime;
+			return true;
+		}
+		return false;
+	}
+};
+
+} // namespace dsp
+
+
+struct Quantity
+{
+	virtual ~Quantity() {}
+};
+
+namespace engine {
+
+struct Param
+{
+	float value = 0.f;
+
+	float getValue()
+	{
+		return value;
+	}
+
+	void setValue(float v)
+	{
+		value = v;
+	}
+};
+
+struct ParamQuantity : Quantity
+{
+	bool snapEnabled = false;
+};
+
+struct Port
+{
+	static const int maxChannels = 16;
+	float voltages[maxChannels] = {};
+	int channels = 0;
+
+	float getVoltage(int c = 0)
+	{
+		return voltages[c];
+	}
+
+	void setVoltage(float voltage, int c = 0)
+	{
+		voltages[c] = voltage;
+	}
+
+	template <typename T>
+	T getVoltageSimd(int c)
+	{
+		return T::load(&voltages[c]);
+	}
+
+	template <typename T>
+	void setVoltageSimd(T voltage, int c)
+	{
+		voltage.store(&voltages[c]);
+	}
+
+	void setChannels(int n)
+	{
+		channels = n;
+	}
+
+	bool isConnected()
+	{
+		return channels > 0;
+	}
+};
+
+struct Input : Port {};
+struct Output : Port {};
+struct Light {};
+
+struct Module
+{
+	std::vector<Param> params;
+	std::vector<Input> inputs;
+	std::vector<Output> outputs;
+	std::vector<Light> lights;
+	std::vector<std::unique_ptr<ParamQuantity>> paramQuantities;
+
+	struct ProcessArgs
+	{
+		float sampleRate;
+		float sampleTime;
+		int64_t frame;
+	};
+
+	virtual ~Module() {}
+
+	void config(int numParams, int numInputs, int numOutputs, int numLights = 0)
+	{
+		params.resize(numParams);
+		inputs.resize(numInputs);
+		outputs.resize(numOutputs);
+		lights.resize(numLights);
+		paramQuantities.resize(numParams);
+		for (std::unique_ptr<ParamQuantity>& quantity : paramQuantities)
+			quantity.reset(new ParamQuantity);
+	}
+
+	ParamQuantity* configParam(int paramId, float, float, float defaultValue, std::string = "", std::string = "", float = 0.f, float = 1.f, float = 0.f)
+	{
+		params[paramId].value = defaultValue;
+		return paramQuantities[paramId].get();
+	}
+
+	void configInput(int, std::string = "") {}
+	void configOutput(int, std::string = "") {}
+
+	ParamQuantity* getParamQuantity(int paramId)
+	{
+		return paramQuantities[paramId].get();
+	}
+
+	virtual void process(const ProcessArgs&) {}
+	virtual json_t* dataToJson() { return NULL; }
+	virtual void dataFromJson(json_t*) {}
+};
+
+} // namespace engine
+
+using engine::Module;
+
+
+namespace event {
+
+struct Action {};
+
+struct HoverScroll
+{
+	Vec pos;
+	Vec scrollDelta;
+	void consume(void*) const {}
+};
+
+} // namespace event
+
+namespace widget {
+
+struct Widget
+{
+	Rect box;
+	std::vector<Widget*> children;
+
+	struct DrawArgs
+	{
+		NVGcontext* vg;
+	};
+
+	virtual ~Widget()
+	{
+		for (Widget* child : children)
+			delete child;
+	}
+
+	void addChild(Widget* child)
+	{
+		if (child)
+			children.push_back(child);
+	}
+
+	virtual void step()
+	{
+		for (Widget* child : children)
+			child->step();
+	}
+
+	virtual void draw(const DrawArgs&) {}
+	virtual void drawLayer(const DrawArgs&, int) {}
+	virtual void onHoverScroll(const event::HoverScroll&) {}
+};
+
+struct FramebufferWidget : Widget
+{
+	void setDirty(bool = true) {}
+};
+
+} // namespace widget
+
+using widget::Widget;
+using widget::FramebufferWidget;
+
+namespace window {
+
+struct Window
+{
+	int getMods()
+	{
+		return 0;
+	}
+};
+
+} // namespace window
+
+struct Context
+{
+	window::Window* window = NULL;
+};
+
+inline Context* contextGet()
+{
+	static window::Window window;
+	static Context context;
+	context.window = &window;
+	return &context;
+}
+
+#define APP rack::contextGet()
+
+namespace ui {
+
+struct MenuEntry : Widget {};
+struct MenuSeparator : MenuEntry {};
+struct MenuLabel : MenuEntry
+{
+	std::string text;
+};
+struct Menu : Widget {};
+struct MenuItem : MenuEntry
+{
+	std::string text;
+	std::string rightText;
+	virtual void onAction(const event::Action&) {}
+};
+struct Slider : Widget
+{
+	Quantity* quantity = NULL;
+};
+struct TextField : Widget
+{
+	std::string text;
+	std::string placeholder;
+	std::string getText()
+	{
+		return text;
+	}
+};
+
+} // namespace ui
+
+using namespace ui;
+
+namespace app {
+
+struct ModuleWidget : Widget
+{
+	Module* module = NULL;
+
+	void setModule(Module* m)
+	{
+		module = m;
+	}
+
+	void setPanel(Widget* panel)
+	{
+		addChild(panel);
+	}
+
+	void addParam(Widget* w)
+	{
+		addChild(w);
+	}
+
+	void addInput(Widget* w)
+	{
+		addChild(w);
+	}
+
+	void addOutput(Widget* w)
+	{
+		addChild(w);
+	}
+
+	virtual void appendContextMenu(Menu*) {}
+};
+
+} // namespace app
+
+using app::ModuleWidget;
+
+struct ScrewSilver : Widget {};
+struct RoundBlackKnob : Widget {};
+struct PJ301MPort : Widget {};
+
+static const float RACK_GRID_WIDTH = 15.f;
+static const float RACK_GRID_HEIGHT = 380.f;
+
+struct Model {};
+
+template <class TWidget>
+TWidget* createWidget(Vec pos)
+{
+	TWidget* w = new TWidget;
+	w->box.pos = pos;
+	return w;
+}
+
+template <class TWidget>
+TWidget* createParamCentered(Vec pos, Module*, int)
+{
+	return createWidget<TWidget>(pos);
+}
+
+template <class TWidget>
+TWidget* createInputCentered(Vec pos, Module*, int)
+{
+	return createWidget<TWidget>(pos);
+}
+
+template <class TWidget>
+TWidget* createOutputCentered(Vec pos, Module*, int)
+{
+	return createWidget<TWidget>(pos);
+}
+
+inline Widget* createPanel(std::string)
+{
+	return new Widget;
+}
+
+template <class TModule, class TModuleWidget>
+Model* createModel(std::string)
+{
+	return NULL;
+}
+
+inline MenuItem* createMenuItem(std::string text, std::string rightText, std::function<void()>, bool = false, bool = false)
+{
+	MenuItem* item = new MenuItem;
+	item->text = text;
+	item->rightText = rightText;
+	return item;
+}
+
+inline MenuItem* createBoolMenuItem(std::string text, std::string rightText, std::function<bool()>, std::function<void(bool)>, bool = false, bool = false)
+{
+	return createMenuItem(text, rightText, NULL);
+}
+
+template <typename T>
+MenuItem* createBoolPtrMenuItem(std::string text, std::string rightText, T*)
+{
+	return createMenuItem(text, rightText, NULL);
+}
+
+inline MenuItem* createCheckMenuItem(std::string text, std::string rightText, std::function<bool()>, std::function<void()>, bool = false, bool = false)
+{
+	return createMenuItem(text, rightText, NULL);
+}
+
+inline MenuItem* createSubmenuItem(std::string text, std::string rightText, std::function<void(Menu*)>, bool = false)
+{
+	return createMenuItem(text, rightText, NULL);
+}
+
+inline MenuItem* createIndexSubmenuItem(std::string text, std::vector<std::string>, std::function<size_t()>, std::function<void(size_t)>, bool = false, bool = false)
+{
+	return createMenuItem(text, "", NULL);
+}
+
+inline MenuLabel* createMenuLabel(std::string text)
+{
+	MenuLabel* label = new MenuLabel;
+	label->text = text;
+	return label;
+}
+
+} // namespace rack
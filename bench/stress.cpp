@@ -0,0 +1,370 @@
+// Checks that files load exactly as they did through rapidcsv::Document, on
+// generated files with every awkward thing CsvGenerator can put in them.
+// Prints what didn't match, with the spec to make the file again with
+// gencsv, and exits with 1 if anything didn't.
+//
+//   ./stress [--iterations N] [--seed S] [--work-dir DIR]
+//
+// The splitting into cells is checked against rapidcsv with every mix of its
+// options, whole and fed in pieces. Loading is checked against rapidcsv with
+// the options the loader picks, through every route a CSV takes: mapped and
+// split into chunks, UTF-16 and Windows-1252 converted on the way, gzipped,
+// only some columns, and back out of the cache.
+#define HAS_CODECVT
+#include "rapidcsv.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "CsvGenerator.hpp"
+#include "CsvLoader.hpp"
+#include "CsvReader.hpp"
+#include "DatasetCache.hpp"
+
+namespace {
+
+typedef std::vector<std::vector<std::string>> Rows;
+
+int failures = 0;
+
+void fail(const std::string& what, const std::string& spec)
+{
+	failures++;
+	std::fprintf(stderr, "FAILED: %s\n  spec: %s\n", what.c_str(), spec.c_str());
+	if (failures >= 20) {
+		std::fprintf(stderr, "too many failures, giving up\n");
+		std::exit(1);
+	}
+}
+
+std::string describeOptions(const CsvOptions& o)
+{
+	char buffer[256];
+	std::snprintf(buffer, sizeof(buffer), "separator=%d trim=%d quotedLinebreaks=%d autoQuote=%d skipCommentLines=%d skipEmptyLines=%d decimalPoint=%c",
+		o.separator, o.trim, o.quotedLinebreaks, o.autoQuote, o.skipCommentLines, o.skipEmptyLines, o.decimalPoint);
+	return buffer;
+}
+
+std::string quote(const std::string& s)
+{
+	std::string out = "\"";
+	for (char c : s)
+	{
+		if (c == '\n')
+			out += "\\n";
+		else if (c == '\r')
+			out += "\\r";
+		else
+			out += c;
+	}
+	return out + "\"";
+}
+
+rapidcsv::Document openDocument(std::istream& stream, const std::string& path, const CsvOptions& o)
+{
+	rapidcsv::LabelParams labels(-1, -1);
+	rapidcsv::SeparatorParams separators(o.separator, o.trim, false, o.quotedLinebreaks, o.autoQuote);
+	rapidcsv::ConverterParams converters(true, NAN, 0, true, o.decimalPoint);
+	rapidcsv::LineReaderParams lines(o.skipCommentLines, o.commentPrefix, o.skipEmptyLines);
+	if (!path.empty())
+		return rapidcsv::Document(path, labels, separators, converters, lines);
+	return rapidcsv::Document(stream, labels, separators, converters, lines);
+}
+
+// Every cell of every row, as rapidcsv splits them. A path reads the file
+// itself, which is how rapidcsv reads UTF-16.
+Rows readRapidcsv(const std::string& text, const std::string& path, const CsvOptions& o)
+{
+	std::istringstream stream(text);
+	rapidcsv::Document doc = openDocument(stream, path, o);
+	Rows rows;
+	for (size_t r = 0; r < doc.GetRowCount(); r++)
+		rows.push_back(doc.GetRow<std::string>(r));
+	return rows;
+}
+
+struct RowCollector
+{
+	Rows rows;
+
+	void row(const CsvCell* cells, size_t count)
+	{
+		std::vector<std::string> row;
+		for (size_t c = 0; c < count; c++)
+			row.push_back(cells[c].str());
+		rows.push_back(row);
+	}
+};
+
+// As the gzip loader does it: a piece at a time, carrying the unfinished row
+// over to the next piece
+Rows readInPieces(const std::string& text, const CsvOptions& o, CsvRandom& random)
+{
+	CsvParser parser(o);
+	RowCollector collector;
+	std::string buffer;
+	size_t pos = 0;
+	while (true)
+	{
+		size_t n = std::min<size_t>(text.size() - pos, 1 + random.below(200));
+		buffer.append(text, pos, n);
+		pos += n;
+		bool final = (pos == text.size());
+		buffer.erase(0, parser.parse(buffer.data(), buffer.size(), final, collector));
+		if (final)
+			break;
+	}
+	return collector.rows;
+}
+
+// Describes the first difference, or returns an empty string
+std::string compareRows(const Rows& expected, const Rows& got)
+{
+	for (size_t r = 0; r < std::min(expected.size(), got.size()); r++)
+	{
+		if (expected[r] == got[r])
+			continue;
+		std::string s = "row " + std::to_string(r) + ": expected";
+		for (const std::string& cell : expected[r])
+			s += " " + quote(cell);
+		s += ", got";
+		for (const std::string& cell : got[r])
+			s += " " + quote(cell);
+		return s;
+	}
+	if (expected.size() != got.size())
+		return "expected " + std::to_string(expected.size()) + " rows, got " + std::to_string(got.size());
+	return "";
+}
+
+CsvSpec randomSpec(CsvRandom& random, uint64_t seed, int64_t maxRows)
+{
+	CsvSpec spec;
+	spec.seed = seed;
+	spec.rows = random.below(static_cast<int>(maxRows) + 1);
+	spec.columns = 1 + random.below(12);
+	static const char separators[] = {',', ',', ';', '\t'};
+	spec.separator = separators[random.below(4)];
+	// Semicolon files mostly have decimal commas, but not all of them do
+	spec.decimalPoint = random.chance(spec.separator == ';' ? 0.7 : 0.1) ? ',' : '.';
+	spec.encoding = static_cast<TextEncoding>(random.below(4));
+	spec.bom = random.chance(0.3);
+	spec.eol = static_cast<CsvSpec::LineEnding>(random.below(3));
+	spec.finalNewline = random.chance(0.7);
+	spec.gzip = random.chance(0.2);
+	// Mostly clean files, now and then a messy one
+	double mess = random.chance(0.3) ? 0.3 : 0.05;
+	spec.nan = random.next() * mess;
+	spec.text = random.next() * mess;
+	spec.quote = random.next() * mess;
+	spec.linebreak = random.next();
+	spec.spaces = random.next() * mess;
+	spec.blank = random.next() * mess;
+	spec.comment = random.next() * mess;
+	spec.ragged = random.next() * mess;
+	return spec;
+}
+
+// Splitting into cells, with random options, against rapidcsv with the same
+void checkTokenizer(const CsvSpec& spec, CsvRandom& random)
+{
+	std::string text = generateCsvText(spec);
+	CsvOptions o;
+	o.separator = spec.separator;
+	o.decimalPoint = spec.decimalPoint;
+	o.trim = random.chance(0.5);
+	o.quotedLinebreaks = random.chance(0.5);
+	o.autoQuote = random.chance(0.8);
+	o.skipCommentLines = random.chance(0.5);
+	o.skipEmptyLines = random.chance(0.5);
+	std::string where = describeCsvSpec(spec) + "\n  options: " + describeOptions(o);
+
+	Rows expected = readRapidcsv(text, "", o);
+	CsvParser parser(o);
+	RowCollector whole;
+	parser.parse(text.data(), text.size(), true, whole);
+	std::string diff = compareRows(expected, whole.rows);
+	if (!diff.empty())
+		fail("cells differ from rapidcsv, " + diff, where);
+	diff = compareRows(expected, readInPieces(text, o, random));
+	if (!diff.empty())
+		fail("cells differ from rapidcsv when parsed in pieces, " + diff, where);
+}
+
+bool sameFloat(float a, float b)
+{
+	return (std::isnan(a) && std::isnan(b)) || std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+// Column values as the loader should have them, from rapidcsv's cells: the
+// first row names the columns and missing cells are NaN
+std::string compareDataset(const Rows& rows, const CsvOptions& o, const Dataset& dataset, const std::vector<int>& columns)
+{
+	if (rows.empty())
+		return "rapidcsv found no rows";
+	if (dataset.columns != rows[0]) {
+		std::string s = "column names differ: expected";
+		for (const std::string& name : rows[0])
+			s += " " + quote(name);
+		s += ", got";
+		for (const std::string& name : dataset.columns)
+			s += " " + quote(name);
+		return s;
+	}
+	if (dataset.datalength != static_cast<int>(rows.size()) - 1)
+		return "expected " + std::to_string(rows.size() - 1) + " rows, got " + std::to_string(dataset.datalength);
+
+	rapidcsv::ConverterParams params(true, NAN, 0, true, o.decimalPoint);
+	rapidcsv::Converter<float> converter(params);
+	for (size_t c = 0; c < dataset.columns.size(); c++)
+	{
+		bool wanted = columns.empty() || std::find(columns.begin(), columns.end(), static_cast<int>(c)) != columns.end();
+		const DataColumn& column = dataset.data[c];
+		if (column.loaded != wanted)
+			return "column " + std::to_string(c) + (wanted ? " wasn't loaded" : " was loaded when it wasn't asked for");
+		if (!wanted)
+			continue;
+		for (int r = 0; r < dataset.datalength; r++)
+		{
+			const std::vector<std::string>& row = rows[r + 1];
+			float expected = NAN;
+			if (c < row.size())
+				converter.ToVal(row[c], expected);
+			if (!sameFloat(expected, column.values[r])) {
+				return "column " + std::to_string(c) + " row " + std::to_string(r) + ": " + quote(c < row.size() ? row[c] : "")
+					+ " should be " + std::to_string(expected) + ", got " + std::to_string(column.values[r]);
+			}
+		}
+	}
+	return "";
+}
+
+// The whole load of a file, against rapidcsv with the options the loader
+// works out for it
+void checkLoad(const CsvSpec& spec, const std::string& workDir, CsvRandom& random)
+{
+	std::string where = describeCsvSpec(spec);
+	std::string path = workDir + (spec.gzip ? "/stress.csv.gz" : "/stress.csv");
+	std::string cacheDir = workDir + "/cache";
+	writeCsvFile(path, spec);
+	std::string text = generateCsvText(spec);
+	CsvOptions o = sniffCsvOptions(text.data(), std::min<size_t>(text.size(), 64 << 10));
+
+	// rapidcsv reads UTF-16 itself, and only UTF-16, so that's checked
+	// against its own reading of the file. Everything else is checked
+	// against the text before it was encoded.
+	bool utf16 = (spec.encoding == ENCODING_UTF16LE || spec.encoding == ENCODING_UTF16BE) && !spec.gzip;
+	Rows rows = readRapidcsv(text, utf16 ? path : "", o);
+	if (spec.columns > 1 && spec.separator != '\t' && o.separator != spec.separator)
+		fail("sniffed the wrong separator", where);
+	// The second column is all fractions, so there are plenty to go on
+	if (spec.separator == ';' && spec.columns > 1 && spec.rows >= 20 && spec.nan < 0.5 && o.decimalPoint != spec.decimalPoint)
+		fail("sniffed the wrong decimal point", where);
+
+	try {
+		LoadProgress progress;
+		std::shared_ptr<Dataset> dataset = parseCSV(path, progress);
+		std::string diff = compareDataset(rows, o, *dataset, std::vector<int>());
+		if (!diff.empty())
+			fail("load differs from rapidcsv, " + diff, where);
+
+		// Back out of the cache, which is mapped rather than parsed
+		CacheKey key;
+		if (!spec.gzip && getCacheKey(path, key) && writeDatasetCache(cacheDir, *dataset, key)) {
+			std::shared_ptr<Dataset> cached = readDatasetCache(cacheDir, path, key);
+			diff = cached ? compareDataset(rows, o, *cached, std::vector<int>()) : "cache wasn't read back";
+			if (!diff.empty())
+				fail("cached load differs from rapidcsv, " + diff, where);
+		}
+
+		// Only some of the columns
+		std::vector<int> columns;
+		for (int c = 0; c < static_cast<int>(dataset->columns.size()); c++)
+		{
+			if (random.chance(0.4))
+				columns.push_back(c);
+		}
+		if (!columns.empty()) {
+			std::shared_ptr<Dataset> some = parseCSV(path, progress, columns);
+			diff = compareDataset(rows, o, *some, columns);
+			if (!diff.empty())
+				fail("load of some columns differs from rapidcsv, " + diff, where);
+		}
+	} catch (std::exception& e) {
+		if (!rows.empty())
+			fail(std::string("load failed: ") + e.what(), where);
+	}
+	unlink(path.c_str());
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	int iterations = 2000;
+	uint64_t seed = 1;
+	std::string workDir = "bench_work";
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		if (arg == "--iterations") {
+			iterations = std::atoi(argv[i + 1]);
+		} else if (arg == "--seed") {
+			seed = std::strtoull(argv[i + 1], NULL, 10);
+		} else if (arg == "--work-dir") {
+			workDir = argv[i + 1];
+		} else {
+			std::fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+	mkdir(workDir.c_str(), 0755);
+	mkdir((workDir + "/cache").c_str(), 0755);
+
+	// One of each route through the loader, then big ones that get split
+	// into chunks and gzip blocks
+	const char* specs[] = {
+		"rows=1000",
+		"rows=2000 nan=0.1 text=0.1 quote=0.2 linebreak=0.3",
+		"rows=2000 eol=crlf encoding=utf8bom",
+		"rows=2000 columns=10 encoding=utf16le text=0.05 quote=0.05",
+		"rows=2000 columns=10 encoding=utf16be eol=crlf",
+		"rows=2000 columns=8 encoding=cp1252 text=0.1",
+		"rows=2000 separator=semicolon decimal=comma quote=0.1",
+		"rows=2000 separator=semicolon decimal=point text=0.05",
+		"rows=2000 ragged=0.05 final=0 eol=mixed blank=0.02 comment=0.02",
+		"rows=2000 spaces=0.1 quote=0.1",
+		"rows=2000 gzip=1 encoding=utf16le",
+		"rows=0",
+		"rows=150000 columns=6 nan=0.01 quote=0.05 text=0.01",
+		"rows=150000 columns=6 encoding=utf16le eol=crlf",
+		"rows=150000 columns=6 encoding=cp1252 ragged=0.001",
+		"rows=150000 gzip=1 eol=mixed",
+	};
+	CsvRandom random(seed);
+	std::fprintf(stderr, "loading %d fixed specs\n", (int) (sizeof(specs) / sizeof(specs[0])));
+	for (const char* spec : specs)
+		checkLoad(parseCsvSpec(spec), workDir, random);
+
+	std::fprintf(stderr, "%d random files, split and loaded\n", iterations);
+	for (int i = 0; i < iterations; i++)
+	{
+		uint64_t specSeed = seed * 1000003 + i;
+		checkTokenizer(randomSpec(random, specSeed, 60), random);
+		if (i % 4 == 0)
+			checkLoad(randomSpec(random, specSeed, 3000), workDir, random);
+	}
+
+	if (failures) {
+		std::fprintf(stderr, "%d failed\n", failures);
+		return 1;
+	}
+	std::fprintf(stderr, "all passed\n");
+	return 0;
+}
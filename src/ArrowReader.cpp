@@ -0,0 +1,713 @@
+#include "ArrowReader.hpp"
+#include "CsvReader.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+
+static const char arrowMagic[6] = {'A', 'R', 'R', 'O', 'W', '1'};
+// Fields nested deeper than this are taken to be a broken file
+static const int maxFieldDepth = 64;
+// Columns shorter than this get their stats worked out on one thread
+static const size_t minStatsPiece = 1 << 20;
+
+// Type ids of the Type union in Arrow's Schema.fbs
+enum ArrowType
+{
+	TYPE_NULL = 1,
+	TYPE_INT = 2,
+	TYPE_FLOAT = 3,
+	TYPE_BINARY = 4,
+	TYPE_UTF8 = 5,
+	TYPE_BOOL = 6,
+	TYPE_DECIMAL = 7,
+	TYPE_DATE = 8,
+	TYPE_TIME = 9,
+	TYPE_TIMESTAMP = 10,
+	TYPE_INTERVAL = 11,
+	TYPE_LIST = 12,
+	TYPE_STRUCT = 13,
+	TYPE_UNION = 14,
+	TYPE_FIXED_BINARY = 15,
+	TYPE_FIXED_LIST = 16,
+	TYPE_MAP = 17,
+	TYPE_DURATION = 18,
+	TYPE_LARGE_BINARY = 19,
+	TYPE_LARGE_UTF8 = 20,
+	TYPE_LARGE_LIST = 21,
+	TYPE_RUN_END = 22,
+};
+
+// Header ids of the MessageHeader union in Message.fbs
+enum ArrowHeader
+{
+	HEADER_SCHEMA = 1,
+	HEADER_DICTIONARY = 2,
+	HEADER_RECORD_BATCH = 3,
+};
+
+// How a column's values are laid out, for the types that are numbers
+enum ValueKind
+{
+	KIND_NONE,
+	KIND_BOOL,
+	KIND_INT8,
+	KIND_INT16,
+	KIND_INT32,
+	KIND_INT64,
+	KIND_UINT8,
+	KIND_UINT16,
+	KIND_UINT32,
+	KIND_UINT64,
+	KIND_HALF,
+	KIND_FLOAT,
+	KIND_DOUBLE,
+};
+
+static std::runtime_error badFile()
+{
+	return std::runtime_error("bad Arrow file");
+}
+
+// The flatbuffers Arrow keeps its metadata in. Every read is checked against
+// the end of the buffer, since the file could hold anything.
+struct FlatBuffer
+{
+	const uint8_t* data = NULL;
+	size_t size = 0;
+
+	template <typename T>
+	T read(size_t pos) const
+	{
+		if (pos > size || sizeof(T) > size - pos)
+			throw badFile();
+		T value;
+		std::memcpy(&value, data + pos, sizeof(T));
+		return value;
+	}
+
+	// Follows the offset at pos to a table, vector or string
+	size_t follow(size_t pos) const
+	{
+		size_t target = pos + read<uint32_t>(pos);
+		if (target >= size)
+			throw badFile();
+		return target;
+	}
+};
+
+// A table in a flatbuffer. Its fields are looked up by number through its
+// vtable, and ones that were left out get their defaults.
+struct FlatTable
+{
+	const FlatBuffer* buffer = NULL;
+	size_t pos = 0;
+	size_t vtable = 0;
+	size_t vtableSize = 0;
+
+	FlatTable(const FlatBuffer& buffer, size_t pos)
+		: buffer(&buffer)
+		, pos(pos)
+	{
+		int64_t v = static_cast<int64_t>(pos) - buffer.read<int32_t>(pos);
+		if (v < 0 || v >= static_cast<int64_t>(buffer.size))
+			throw badFile();
+		vtable = static_cast<size_t>(v);
+		vtableSize = buffer.read<uint16_t>(vtable);
+	}
+
+	// Where a field is, or 0 if it was left out
+	size_t field(int index) const
+	{
+		size_t entry = 4 + 2 * index;
+		if (entry + 2 > vtableSize)
+			return 0;
+		uint16_t offset = buffer->read<uint16_t>(vtable + entry);
+		return offset ? pos + offset : 0;
+	}
+
+	bool has(int index) const
+	{
+		return field(index) != 0;
+	}
+
+	template <typename T>
+	T get(int index, T value) const
+	{
+		size_t p = field(index);
+		return p ? buffer->read<T>(p) : value;
+	}
+
+	// Throws if the field was left out
+	FlatTable table(int index) const
+	{
+		size_t p = field(index);
+		if (!p)
+			throw badFile();
+		return FlatTable(*buffer, buffer->follow(p));
+	}
+
+	// Where a vector's elements start, and how many there are. A vector that
+	// was left out is empty.
+	size_t vector(int index, size_t& length) const
+	{
+		length = 0;
+		size_t p = field(index);
+		if (!p)
+			return 0;
+		size_t v = buffer->follow(p);
+		length = buffer->read<uint32_t>(v);
+		return v + 4;
+	}
+
+	// Element i of a vector of tables
+	FlatTable element(size_t elements, size_t i) const
+	{
+		return FlatTable(*buffer, buffer->follow(elements + 4 * i));
+	}
+
+	std::string string(int index) const
+	{
+		size_t length;
+		size_t start = vector(index, length);
+		if (start > buffer->size || length > buffer->size - start)
+			throw badFile();
+		return std::string(reinterpret_cast<const char*>(buffer->data) + start, length);
+	}
+};
+
+static FlatTable rootTable(const FlatBuffer& buffer)
+{
+	return FlatTable(buffer, buffer.follow(0));
+}
+
+// One top-level column of the schema, and where its arrays are among the
+// nodes and buffers of each record batch
+struct ArrowColumn
+{
+	std::string name;
+	ValueKind kind = KIND_NONE;
+	size_t node = 0;
+	size_t buffer = 0;
+};
+
+// The parts of one column in one record batch
+struct ArrowArray
+{
+	const uint8_t* validity = NULL; // NULL if there are no nulls
+	const uint8_t* values = NULL;
+};
+
+struct ArrowBatch
+{
+	size_t rows = 0;
+	size_t rowStart = 0;
+	std::vector<ArrowArray> arrays; // one per column
+};
+
+static size_t valueSize(ValueKind kind)
+{
+	switch (kind)
+	{
+		case KIND_INT8:
+		case KIND_UINT8:
+			return 1;
+		case KIND_INT16:
+		case KIND_UINT16:
+		case KIND_HALF:
+			return 2;
+		case KIND_INT32:
+		case KIND_UINT32:
+		case KIND_FLOAT:
+			return 4;
+		case KIND_INT64:
+		case KIND_UINT64:
+		case KIND_DOUBLE:
+			return 8;
+		default:
+			return 0;
+	}
+}
+
+static ValueKind intKind(int bitWidth, bool isSigned)
+{
+	switch (bitWidth)
+	{
+		case 8:
+			return isSigned ? KIND_INT8 : KIND_UINT8;
+		case 16:
+			return isSigned ? KIND_INT16 : KIND_UINT16;
+		case 32:
+			return isSigned ? KIND_INT32 : KIND_UINT32;
+		case 64:
+			return isSigned ? KIND_INT64 : KIND_UINT64;
+		default:
+			return KIND_NONE;
+	}
+}
+
+// Dates, times and durations are played as the numbers they're stored as
+static ValueKind fieldKind(const FlatTable& field)
+{
+	// Dictionary encoded columns hold indexes into the dictionary, not values
+	if (field.has(4))
+		return KIND_NONE;
+	uint8_t type = field.get<uint8_t>(2, 0);
+	switch (type)
+	{
+		case TYPE_INT: {
+			FlatTable t = field.table(3);
+			return intKind(t.get<int32_t>(0, 0), t.get<uint8_t>(1, 0) != 0);
+		}
+		case TYPE_FLOAT: {
+			int16_t precision = field.table(3).get<int16_t>(0, 0);
+			return (precision == 0) ? KIND_HALF : (precision == 1) ? KIND_FLOAT : (precision == 2) ? KIND_DOUBLE : KIND_NONE;
+		}
+		case TYPE_BOOL:
+			return KIND_BOOL;
+		case TYPE_DATE:
+			// Days or milliseconds
+			return (field.table(3).get<int16_t>(0, 1) == 0) ? KIND_INT32 : KIND_INT64;
+		case TYPE_TIME:
+			return intKind(field.table(3).get<int32_t>(1, 32), true);
+		case TYPE_TIMESTAMP:
+		case TYPE_DURATION:
+			return KIND_INT64;
+		default:
+			return KIND_NONE;
+	}
+}
+
+// How many buffers an array of the field's type has in a record batch, not
+// counting those of its children
+static size_t bufferCount(const FlatTable& field)
+{
+	if (field.has(4))
+		return 2;
+	uint8_t type = field.get<uint8_t>(2, 0);
+	switch (type)
+	{
+		case TYPE_NULL:
+		case TYPE_RUN_END:
+			return 0;
+		case TYPE_STRUCT:
+		case TYPE_FIXED_LIST:
+			return 1;
+		case TYPE_INT:
+		case TYPE_FLOAT:
+		case TYPE_BOOL:
+		case TYPE_DECIMAL:
+		case TYPE_DATE:
+		case TYPE_TIME:
+		case TYPE_TIMESTAMP:
+		case TYPE_INTERVAL:
+		case TYPE_FIXED_BINARY:
+		case TYPE_DURATION:
+		case TYPE_LIST:
+		case TYPE_LARGE_LIST:
+		case TYPE_MAP:
+			return 2;
+		case TYPE_BINARY:
+		case TYPE_UTF8:
+		case TYPE_LARGE_BINARY:
+		case TYPE_LARGE_UTF8:
+			return 3;
+		case TYPE_UNION:
+			// Sparse unions only have type ids, dense ones offsets as well
+			return (field.table(3).get<int16_t>(0, 0) == 0) ? 1 : 2;
+		default:
+			throw std::runtime_error("unsupported Arrow column type");
+	}
+}
+
+// Counts the nodes and buffers of a field and everything inside it. They come
+// depth first, a field's own before its children's.
+static void countLayout(const FlatTable& field, size_t& nodes, size_t& buffers, int depth)
+{
+	if (depth > maxFieldDepth)
+		throw badFile();
+	nodes++;
+	buffers += bufferCount(field);
+	// The children of a dictionary encoded field are in the dictionary
+	if (field.has(4))
+		return;
+	size_t count;
+	size_t children = field.vector(5, count);
+	for (size_t i = 0; i < count; i++)
+		countLayout(field.element(children, i), nodes, buffers, depth + 1);
+}
+
+static std::vector<ArrowColumn> readSchema(const FlatTable& schema)
+{
+	if (schema.get<int16_t>(0, 0) != 0)
+		throw std::runtime_error("big-endian Arrow files aren't supported");
+
+	std::vector<ArrowColumn> columns;
+	size_t nodes = 0;
+	size_t buffers = 0;
+	size_t count;
+	size_t fields = schema.vector(1, count);
+	for (size_t i = 0; i < count; i++)
+	{
+		FlatTable field = schema.element(fields, i);
+		ArrowColumn column;
+		column.name = field.string(0);
+		column.kind = fieldKind(field);
+		column.node = nodes;
+		column.buffer = buffers;
+		countLayout(field, nodes, buffers, 0);
+		columns.push_back(column);
+	}
+	return columns;
+}
+
+// Finds the message at offset. Returns false at the end of a stream.
+static bool readMessage(const MappedFile& file, size_t offset, FlatBuffer& meta, size_t& bodyStart)
+{
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data());
+	size_t size = file.size();
+	if (offset > size || size - offset < 4)
+		return false;
+	uint32_t length;
+	std::memcpy(&length, data + offset, sizeof(length));
+	size_t p = offset + 4;
+	// Files from before Arrow 0.15 don't have the continuation marker
+	if (length == 0xFFFFFFFF) {
+		if (size - p < 4)
+			return false;
+		std::memcpy(&length, data + p, sizeof(length));
+		p += 4;
+	}
+	if (length == 0)
+		return false;
+	if (length > size - p)
+		throw badFile();
+	meta.data = data + p;
+	meta.size = length;
+	bodyStart = p + length;
+	return true;
+}
+
+// Finds the arrays of each column in a record batch message
+static ArrowBatch readBatch(const MappedFile& file, const FlatTable& message, size_t bodyStart,
+	const std::vector<ArrowColumn>& columns)
+{
+	int64_t bodyLength = message.get<int64_t>(3, 0);
+	if (bodyLength < 0 || bodyStart > file.size() || static_cast<uint64_t>(bodyLength) > file.size() - bodyStart)
+		throw badFile();
+	const uint8_t* body = reinterpret_cast<const uint8_t*>(file.data()) + bodyStart;
+
+	FlatTable batch = message.table(2);
+	if (batch.has(3))
+		throw std::runtime_error("compressed Arrow files aren't supported");
+	int64_t rows = batch.get<int64_t>(0, 0);
+	if (rows < 0 || rows > INT_MAX)
+		throw badFile();
+
+	ArrowBatch result;
+	result.rows = static_cast<size_t>(rows);
+	size_t nodeCount, bufferCount;
+	size_t nodes = batch.vector(1, nodeCount);
+	size_t buffers = batch.vector(2, bufferCount);
+	const FlatBuffer& meta = *batch.buffer;
+
+	// Each array has to have a value for every row
+	for (const ArrowColumn& column : columns)
+	{
+		ArrowArray array;
+		if (column.kind != KIND_NONE) {
+			if (column.node >= nodeCount || column.buffer + 1 >= bufferCount)
+				throw badFile();
+			size_t node = nodes + 16 * column.node;
+			if (meta.read<int64_t>(node) != rows)
+				throw badFile();
+			int64_t nullCount = meta.read<int64_t>(node + 8);
+
+			size_t bitmapLength = (result.rows + 7) / 8;
+			size_t valuesLength = (column.kind == KIND_BOOL) ? bitmapLength : result.rows * valueSize(column.kind);
+			const uint8_t* parts[2];
+			for (int b = 0; b < 2; b++)
+			{
+				size_t buffer = buffers + 16 * (column.buffer + b);
+				int64_t offset = meta.read<int64_t>(buffer);
+				int64_t length = meta.read<int64_t>(buffer + 8);
+				size_t needed = (b == 0) ? bitmapLength : valuesLength;
+				if (offset < 0 || length < 0 || offset > bodyLength || length > bodyLength - offset)
+					throw badFile();
+				// A missing validity bitmap means there are no nulls
+				if (b == 0 && (nullCount == 0 || length == 0)) {
+					parts[b] = NULL;
+					continue;
+				}
+				if (static_cast<uint64_t>(length) < needed)
+					throw badFile();
+				parts[b] = body + offset;
+			}
+			array.validity = parts[0];
+			array.values = parts[1];
+		}
+		result.arrays.push_back(array);
+	}
+	return result;
+}
+
+static float halfToFloat(uint16_t half)
+{
+	int exponent = (half >> 10) & 0x1f;
+	int mantissa = half & 0x3ff;
+	float value;
+	if (exponent == 0)
+		value = std::ldexp(static_cast<float>(mantissa), -24);
+	else if (exponent == 31)
+		value = mantissa ? NAN : INFINITY;
+	else
+		value = std::ldexp(static_cast<float>(mantissa | 0x400), exponent - 25);
+	return (half & 0x8000) ? -value : value;
+}
+
+template <typename T, typename Out>
+static void convertValues(const uint8_t* values, size_t rows, Out* out)
+{
+	for (size_t i = 0; i < rows; i++)
+	{
+		T value;
+		std::memcpy(&value, values + i * sizeof(T), sizeof(T));
+		out[i] = static_cast<Out>(value);
+	}
+}
+
+// Turns one array into floats, or doubles for times, with nulls as NaN
+template <typename Out>
+static void convertArray(ValueKind kind, const ArrowArray& array, size_t rows, Out* out)
+{
+	switch (kind)
+	{
+		case KIND_BOOL:
+			for (size_t i = 0; i < rows; i++)
+				out[i] = (array.values[i >> 3] >> (i & 7)) & 1;
+			break;
+		case KIND_INT8:
+			convertValues<int8_t, Out>(array.values, rows, out);
+			break;
+		case KIND_INT16:
+			convertValues<int16_t, Out>(array.values, rows, out);
+			break;
+		case KIND_INT32:
+			convertValues<int32_t, Out>(array.values, rows, out);
+			break;
+		case KIND_INT64:
+			convertValues<int64_t, Out>(array.values, rows, out);
+			break;
+		case KIND_UINT8:
+			convertValues<uint8_t, Out>(array.values, rows, out);
+			break;
+		case KIND_UINT16:
+			convertValues<uint16_t, Out>(array.values, rows, out);
+			break;
+		case KIND_UINT32:
+			convertValues<uint32_t, Out>(array.values, rows, out);
+			break;
+		case KIND_UINT64:
+			convertValues<uint64_t, Out>(array.values, rows, out);
+			break;
+		case KIND_HALF:
+			for (size_t i = 0; i < rows; i++)
+			{
+				uint16_t half;
+				std::memcpy(&half, array.values + 2 * i, sizeof(half));
+				out[i] = halfToFloat(half);
+			}
+			break;
+		case KIND_FLOAT:
+			convertValues<float, Out>(array.values, rows, out);
+			break;
+		case KIND_DOUBLE:
+			convertValues<double, Out>(array.values, rows, out);
+			break;
+		default:
+			break;
+	}
+
+	if (array.validity) {
+		for (size_t i = 0; i < rows; i++)
+		{
+			if (!((array.validity[i >> 3] >> (i & 7)) & 1))
+				out[i] = NAN;
+		}
+	}
+}
+
+bool isArrowData(const char* data, size_t size)
+{
+	// A file starts with the magic, a stream with a continuation marker
+	if (size >= sizeof(arrowMagic) && std::memcmp(data, arrowMagic, sizeof(arrowMagic)) == 0)
+		return true;
+	return size >= 4 && std::memcmp(data, "\xff\xff\xff\xff", 4) == 0;
+}
+
+std::shared_ptr<Dataset> readArrowFile(const std::string& path, LoadProgress& progress, const std::vector<int>& wanted,
+	int timeColumn)
+{
+	progress.set(0.f);
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(path);
+	const char* data = file->data();
+	size_t size = file->size();
+
+	// A file has the same messages as a stream, between the magic at the start
+	// and a footer that says where the record batches are. A file that's
+	// missing its footer, maybe because it's still being written, is read
+	// like a stream.
+	std::vector<ArrowColumn> columns;
+	std::vector<ArrowBatch> batches;
+	bool hasFooter = size >= 18 && std::memcmp(data, arrowMagic, sizeof(arrowMagic)) == 0 &&
+		std::memcmp(data + size - 6, arrowMagic, sizeof(arrowMagic)) == 0;
+	if (hasFooter) {
+		int32_t footerLength;
+		std::memcpy(&footerLength, data + size - 10, sizeof(footerLength));
+		if (footerLength <= 0 || static_cast<size_t>(footerLength) > size - 18)
+			throw badFile();
+		FlatBuffer footerBuffer;
+		footerBuffer.data = reinterpret_cast<const uint8_t*>(data + size - 10 - footerLength);
+		footerBuffer.size = footerLength;
+		FlatTable footer = rootTable(footerBuffer);
+		columns = readSchema(footer.table(1));
+
+		size_t count;
+		size_t blocks = footer.vector(3, count);
+		for (size_t i = 0; i < count; i++)
+		{
+			int64_t offset = footerBuffer.read<int64_t>(blocks + 24 * i);
+			FlatBuffer meta;
+			size_t bodyStart;
+			if (offset < 0 || !readMessage(*file, static_cast<size_t>(offset), meta, bodyStart))
+				throw badFile();
+			FlatTable message = rootTable(meta);
+			if (message.get<uint8_t>(1, 0) != HEADER_RECORD_BATCH)
+				throw badFile();
+			batches.push_back(readBatch(*file, message, bodyStart, columns));
+		}
+	} else {
+		bool hasSchema = false;
+		size_t offset = (std::memcmp(data, arrowMagic, std::min(size, sizeof(arrowMagic))) == 0) ? 8 : 0;
+		FlatBuffer meta;
+		size_t bodyStart;
+		while (readMessage(*file, offset, meta, bodyStart))
+		{
+			FlatTable message = rootTable(meta);
+			uint8_t header = message.get<uint8_t>(1, 0);
+			if (header == HEADER_SCHEMA && !hasSchema) {
+				columns = readSchema(message.table(2));
+				hasSchema = true;
+			} else if (header == HEADER_RECORD_BATCH) {
+				if (!hasSchema)
+					throw badFile();
+				batches.push_back(readBatch(*file, message, bodyStart, columns));
+			}
+			// Dictionaries aren't needed, dictionary encoded columns aren't played
+			int64_t bodyLength = message.get<int64_t>(3, 0);
+			if (bodyLength < 0 || static_cast<uint64_t>(bodyLength) > size - bodyStart)
+				throw badFile();
+			offset = bodyStart + static_cast<size_t>(bodyLength);
+		}
+		if (!hasSchema)
+			throw badFile();
+	}
+	if (columns.empty())
+		throw std::runtime_error("no columns");
+
+	std::shared_ptr<Dataset> dataset = std::make_shared<Dataset>();
+	dataset->path = path;
+	dataset->mappedFile = file;
+	size_t totalRows = 0;
+	for (ArrowBatch& batch : batches)
+	{
+		batch.rowStart = totalRows;
+		totalRows += batch.rows;
+		if (totalRows > INT_MAX)
+			throw std::runtime_error("too many rows");
+	}
+	dataset->datalength = static_cast<int>(totalRows);
+
+	dataset->data.resize(columns.size());
+	std::vector<size_t> converted;
+	for (size_t c = 0; c < columns.size(); c++)
+	{
+		dataset->columns.push_back(columns[c].name);
+		DataColumn& column = dataset->data[c];
+		if (!wanted.empty() && std::find(wanted.begin(), wanted.end(), static_cast<int>(c)) == wanted.end()) {
+			column.loaded = false;
+			continue;
+		}
+		if (columns[c].kind == KIND_NONE)
+			continue;
+
+		// Floats without nulls all in one place can be played where they are
+		const uint8_t* values = batches.empty() ? NULL : batches[0].arrays[c].values;
+		if (batches.size() == 1 && columns[c].kind == KIND_FLOAT && !batches[0].arrays[c].validity &&
+			reinterpret_cast<uintptr_t>(values) % alignof(float) == 0) {
+			// Read in and kept, so the audio thread never waits on the disk
+			// for them, and the stats don't have to wait either
+			column.values = reinterpret_cast<const float*>(values);
+			file->prefault(values - reinterpret_cast<const uint8_t*>(data), totalRows * sizeof(float), &progress.cancelled);
+			progress.check();
+			continue;
+		}
+		column.storage.resize(totalRows);
+		column.values = column.storage.data();
+		converted.push_back(c);
+	}
+
+	// Everything else is converted a record batch at a time
+	ThreadPool& pool = ThreadPool::shared();
+	pool.parallelFor(converted.size() * batches.size(), [&](size_t task) {
+		progress.check();
+		size_t c = converted[task / batches.size()];
+		const ArrowBatch& batch = batches[task % batches.size()];
+		convertArray(columns[c].kind, batch.arrays[c], batch.rows, dataset->data[c].storage.data() + batch.rowStart);
+	});
+
+	// Times are read from the values as they are, since floats would round
+	// big ones like timestamps
+	if (timeColumn >= 0 && timeColumn < static_cast<int>(columns.size()) && columns[timeColumn].kind != KIND_NONE) {
+		std::vector<double> times(totalRows);
+		pool.parallelFor(batches.size(), [&](size_t b) {
+			const ArrowBatch& batch = batches[b];
+			convertArray(columns[timeColumn].kind, batch.arrays[timeColumn], batch.rows, times.data() + batch.rowStart);
+		});
+		dataset->timedeltas = makeTimeDeltas(times);
+	}
+	progress.set(0.5f);
+
+	// Then the stats of each column, split into pieces when there aren't
+	// enough columns to keep every thread busy
+	std::vector<size_t> playable;
+	for (size_t c = 0; c < columns.size(); c++)
+	{
+		if (dataset->data[c].values)
+			playable.push_back(c);
+	}
+	if (!playable.empty()) {
+		size_t pieces = std::max<size_t>(1, std::min<size_t>(pool.getThreads() / playable.size(), totalRows / minStatsPiece));
+		size_t pieceRows = (totalRows + pieces - 1) / pieces;
+		std::vector<StatsAccumulator> stats(playable.size() * pieces);
+		pool.parallelFor(stats.size(), [&](size_t task) {
+			progress.check();
+			const DataColumn& column = dataset->data[playable[task / pieces]];
+			size_t begin = std::min(totalRows, (task % pieces) * pieceRows);
+			size_t end = std::min(totalRows, begin + pieceRows);
+			stats[task].add(column.values + begin, end - begin);
+		});
+		for (size_t p = 0; p < playable.size(); p++)
+		{
+			for (size_t i = 1; i < pieces; i++)
+				stats[p * pieces].merge(stats[p * pieces + i]);
+			dataset->data[playable[p]].stats = stats[p * pieces].finish();
+		}
+	}
+
+	progress.set(1.f);
+	return dataset;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CsvLoader.hpp"
+#include "Dataset.hpp"
+
+// True if the start of a file looks like an Arrow IPC file (Feather v2 is the
+// same thing) or an Arrow IPC stream
+bool isArrowData(const char* data, size_t size);
+
+// Opens an Arrow IPC file or stream as a dataset. Throws on bad files, and on
+// ones that use something this reader doesn't handle, like compression.
+//
+// The file is mapped rather than read. Float columns with no nulls in a file
+// with a single record batch are played straight from the map, so opening
+// one costs no more than reading it in once and working out its stats. Other numeric columns (ints,
+// doubles, dates, times, half floats and bools) are converted to floats, with
+// null cells as NaN. Strings, lists and the like have no numbers.
+//
+// Only the listed columns are loaded, as with parseCSV(). A numeric, date,
+// time or timestamp column can be the time column.
+std::shared_ptr<Dataset> readArrowFile(const std::string& path, LoadProgress& progress,
+	const std::vector<int>& columns = std::vector<int>(), int timeColumn = -1);
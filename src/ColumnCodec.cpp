@@ -0,0 +1,206 @@
+#include "ColumnCodec.hpp"
+#include <cstring>
+
+
+// "LNZ" and a version byte, then the number of values
+static const uint8_t codecMagic[4] = {'L', 'N', 'Z', 1};
+static const size_t headerSize = 8;
+
+// The compressed stream is a run of sequences, each some literal bytes then
+// a match copied from earlier output. A sequence starts with a token byte, the
+// literal count in the high nibble and the match length minus 4 in the low
+// one, either of which can run on in extra bytes when it's 15. Then come the
+// literals, then a two byte distance back to the match. The last sequence has
+// literals only.
+static const size_t minMatch = 4;
+static const size_t maxDistance = 65535;
+static const int hashBits = 14;
+
+static inline uint32_t read32(const uint8_t* p)
+{
+	uint32_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t hash4(const uint8_t* p)
+{
+	return (read32(p) * 2654435761u) >> (32 - hashBits);
+}
+
+static void putLength(std::vector<uint8_t>& out, size_t length)
+{
+	while (length >= 255)
+	{
+		out.push_back(255);
+		length -= 255;
+	}
+	out.push_back(static_cast<uint8_t>(length));
+}
+
+static void putSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t numLiterals, size_t distance, size_t matchLength)
+{
+	size_t matchCode = matchLength ? matchLength - minMatch : 0;
+	uint8_t token = static_cast<uint8_t>(((numLiterals < 15 ? numLiterals : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+	out.push_back(token);
+	if (numLiterals >= 15)
+		putLength(out, numLiterals - 15);
+	out.insert(out.end(), literals, literals + numLiterals);
+	if (!matchLength)
+		return;
+	out.push_back(static_cast<uint8_t>(distance));
+	out.push_back(static_cast<uint8_t>(distance >> 8));
+	if (matchCode >= 15)
+		putLength(out, matchCode - 15);
+}
+
+void lzCompress(const uint8_t* in, size_t size, std::vector<uint8_t>& out)
+{
+	// Positions of the last place each hash of four bytes was seen, plus one
+	std::vector<uint32_t> table(size_t(1) << hashBits, 0);
+
+	size_t anchor = 0; // start of the literals not written yet
+	size_t i = 0;
+	size_t misses = 0;
+	while (size >= minMatch && i <= size - minMatch)
+	{
+		uint32_t h = hash4(in + i);
+		size_t candidate = table[h];
+		table[h] = static_cast<uint32_t>(i + 1);
+
+		if (candidate == 0 || i - (candidate - 1) > maxDistance || read32(in + candidate - 1) != read32(in + i)) {
+			// Skip ahead faster the longer we go without a match, so noise
+			// that won't compress doesn't cost much
+			i += 1 + (misses++ >> 5);
+			continue;
+		}
+		misses = 0;
+		size_t from = candidate - 1;
+
+		size_t length = minMatch;
+		while (i + length < size && in[from + length] == in[i + length])
+			length++;
+
+		putSequence(out, in + anchor, i - anchor, i - from, length);
+		i += length;
+		anchor = i;
+	}
+	putSequence(out, in + anchor, size - anchor, 0, 0);
+}
+
+static bool getLength(const uint8_t*& p, const uint8_t* end, size_t& length)
+{
+	while (true)
+	{
+		if (p == end)
+			return false;
+		uint8_t b = *p++;
+		length += b;
+		if (b != 255)
+			return true;
+	}
+}
+
+bool lzDecompress(const uint8_t* in, size_t size, uint8_t* out, size_t outSize)
+{
+	const uint8_t* p = in;
+	const uint8_t* end = in + size;
+	size_t o = 0;
+	while (p < end)
+	{
+		uint8_t token = *p++;
+		size_t numLiterals = token >> 4;
+		if (numLiterals == 15 && !getLength(p, end, numLiterals))
+			return false;
+		if (numLiterals > static_cast<size_t>(end - p) || numLiterals > outSize - o)
+			return false;
+		if (numLiterals)
+			std::memcpy(out + o, p, numLiterals);
+		p += numLiterals;
+		o += numLiterals;
+
+		// The last sequence has no match
+		if (p == end)
+			break;
+
+		if (end - p < 2)
+			return false;
+		size_t distance = p[0] | (p[1] << 8);
+		p += 2;
+		size_t length = token & 15;
+		if (length == 15 && !getLength(p, end, length))
+			return false;
+		length += minMatch;
+		if (distance == 0 || distance > o || length > outSize - o)
+			return false;
+
+		// A match closer than its length repeats the last `distance` bytes.
+		// Once one copy of those is written the output repeats with that
+		// period, so each copy can be twice as long as the last.
+		uint8_t* dst = out + o;
+		size_t copied = (distance < length) ? distance : length;
+		std::memcpy(dst, dst - distance, copied);
+		while (copied < length)
+		{
+			size_t n = (copied < length - copied) ? copied : length - copied;
+			std::memcpy(dst + copied, dst, n);
+			copied += n;
+		}
+		o += length;
+	}
+	return o == outSize;
+}
+
+std::vector<uint8_t> encodeColumn(const float* values, size_t count)
+{
+	// XOR each value with the last, then split into byte planes
+	std::vector<uint8_t> planes(count * 4);
+	uint32_t previous = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &values[i], sizeof(bits));
+		uint32_t x = bits ^ previous;
+		previous = bits;
+		planes[i] = static_cast<uint8_t>(x);
+		planes[count + i] = static_cast<uint8_t>(x >> 8);
+		planes[2 * count + i] = static_cast<uint8_t>(x >> 16);
+		planes[3 * count + i] = static_cast<uint8_t>(x >> 24);
+	}
+
+	std::vector<uint8_t> out(codecMagic, codecMagic + 4);
+	for (int b = 0; b < 4; b++)
+		out.push_back(static_cast<uint8_t>(count >> (8 * b)));
+	out.reserve(headerSize + planes.size() / 2);
+	lzCompress(planes.data(), planes.size(), out);
+	return out;
+}
+
+bool decodeColumn(const uint8_t* data, size_t size, std::vector<float>& values)
+{
+	if (size < headerSize || std::memcmp(data, codecMagic, 4) != 0)
+		return false;
+	size_t count = 0;
+	for (int b = 0; b < 4; b++)
+		count |= static_cast<size_t>(data[4 + b]) << (8 * b);
+
+	// Anything that decompresses to this size can be at most 255 times bigger
+	// than its input, so a bogus count is caught before allocating for it
+	if (count * 4 / 255 > size)
+		return false;
+
+	std::vector<uint8_t> planes(count * 4);
+	if (!lzDecompress(data + headerSize, size - headerSize, planes.data(), planes.size()))
+		return false;
+
+	values.resize(count);
+	uint32_t previous = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t x = planes[i] | (planes[count + i] << 8) | (planes[2 * count + i] << 16) | (static_cast<uint32_t>(planes[3 * count + i]) << 24);
+		uint32_t bits = x ^ previous;
+		previous = bits;
+		std::memcpy(&values[i], &bits, sizeof(bits));
+	}
+	return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Packs a column of numbers into a few bytes for saving in a patch, and back.
+//
+// Each value's bits are XORed with the one before, so neighbouring values that
+// are close leave mostly zero bits. The bytes are then split into four planes,
+// one per byte of a float, so the near-constant sign and exponent bytes sit
+// together. Last, a small LZ77 compressor squeezes out the repeats. Nothing is
+// rounded, NaN and all come back bit for bit.
+std::vector<uint8_t> encodeColumn(const float* values, size_t count);
+
+// Returns false if the bytes aren't a column made by encodeColumn()
+bool decodeColumn(const uint8_t* data, size_t size, std::vector<float>& values);
+
+// The LZ77 stage on its own. Returns false if the input is corrupt or
+// doesn't decompress to exactly outSize bytes.
+void lzCompress(const uint8_t* in, size_t size, std::vector<uint8_t>& out);
+bool lzDecompress(const uint8_t* in, size_t size, uint8_t* out, size_t outSize);
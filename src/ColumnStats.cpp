@@ -0,0 +1,242 @@
+#include "ColumnStats.hpp"
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+// Numbers are counted into buckets by the top 16 bits of their float, flipped
+// so they sort as unsigned integers. That's the sign, the exponent and 7 bits
+// of the mantissa, so a bucket is less than 1% as wide as the values in it.
+static const uint32_t numBuckets = 1 << 16;
+// NaN goes in one more bucket on the end, which is never read
+static const uint32_t nanBucket = numBuckets;
+// The buckets are in pages of 256, one for every two powers of two. Most
+// columns only cover a few of them, so an accumulator takes a few KB rather
+// than all 256 KB, which matters when lots of them are kept at once.
+static const uint32_t numPages = (numBuckets >> 8) + 1;
+
+// Stats are worked out a block at a time, then merged into the running totals
+static const size_t blockSize = 4096;
+
+static inline uint32_t sortKey(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+static inline float fromSortKey(uint32_t key)
+{
+	uint32_t bits = (key & 0x80000000u) ? (key & 0x7FFFFFFFu) : ~key;
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+float ColumnStats::quantile(float q) const
+{
+	float position = std::min(std::max(q, 0.f), 1.f) * 100.f;
+	int i = std::min(static_cast<int>(position), 99);
+	float frac = position - i;
+	return percentiles[i] + (percentiles[i + 1] - percentiles[i]) * frac;
+}
+
+StatsAccumulator::StatsAccumulator()
+	: min(INFINITY)
+	, max(-INFINITY)
+	, pages(numPages)
+{
+}
+
+void StatsAccumulator::add(const float* values, size_t count)
+{
+	for (size_t i = 0; i < count; i += blockSize)
+		addBlock(values + i, std::min(blockSize, count - i));
+}
+
+// Chan et al.'s formula for the mean and variance of two sets put together
+void StatsAccumulator::combine(uint64_t n, double blockMean, double blockM2)
+{
+	if (n == 0)
+		return;
+	uint64_t total = count + n;
+	double delta = blockMean - mean;
+	mean += delta * n / total;
+	m2 += blockM2 + delta * delta * (static_cast<double>(count) * n / total);
+	count = total;
+}
+
+void StatsAccumulator::addBlock(const float* values, size_t size)
+{
+	// Sums are taken from a shift near the values rather than from zero, so
+	// big numbers that barely change don't lose their variance to rounding
+	float shift = static_cast<float>(mean);
+	if (count == 0) {
+		shift = 0.f;
+		for (size_t i = 0; i < size; i++)
+		{
+			if (!std::isnan(values[i])) {
+				shift = values[i];
+				break;
+			}
+		}
+	}
+
+	uint64_t n = 0;
+	float blockMin = INFINITY;
+	float blockMax = -INFINITY;
+	double sum = 0.0;
+	double sumSquares = 0.0;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	__m128 vmin = _mm_set1_ps(INFINITY);
+	__m128 vmax = _mm_set1_ps(-INFINITY);
+	__m128i vcount = _mm_setzero_si128();
+	__m128d vsum0 = _mm_setzero_pd(), vsum1 = _mm_setzero_pd();
+	__m128d vsquares0 = _mm_setzero_pd(), vsquares1 = _mm_setzero_pd();
+	const __m128 vshift = _mm_set1_ps(shift);
+	const __m128i signBit = _mm_set1_epi32(static_cast<int>(0x80000000u));
+	const __m128i vnanBucket = _mm_set1_epi32(nanBucket);
+	uint32_t index[4];
+	for (; i + 4 <= size; i += 4)
+	{
+		__m128 v = _mm_loadu_ps(values + i);
+		__m128 isNumber = _mm_cmpord_ps(v, v);
+
+		// minps and maxps return the second operand if either is NaN
+		vmin = _mm_min_ps(v, vmin);
+		vmax = _mm_max_ps(v, vmax);
+		vcount = _mm_sub_epi32(vcount, _mm_castps_si128(isNumber));
+
+		// NaN lanes add nothing
+		__m128 d = _mm_and_ps(_mm_sub_ps(v, vshift), isNumber);
+		__m128d d0 = _mm_cvtps_pd(d);
+		__m128d d1 = _mm_cvtps_pd(_mm_movehl_ps(d, d));
+		vsum0 = _mm_add_pd(vsum0, d0);
+		vsum1 = _mm_add_pd(vsum1, d1);
+		vsquares0 = _mm_add_pd(vsquares0, _mm_mul_pd(d0, d0));
+		vsquares1 = _mm_add_pd(vsquares1, _mm_mul_pd(d1, d1));
+
+		// The same flip as sortKey(), four at once
+		__m128i bits = _mm_castps_si128(v);
+		__m128i key = _mm_xor_si128(bits, _mm_or_si128(_mm_srai_epi32(bits, 31), signBit));
+		__m128i bucket = _mm_srli_epi32(key, 16);
+		__m128i isNumberInt = _mm_castps_si128(isNumber);
+		bucket = _mm_or_si128(_mm_and_si128(isNumberInt, bucket), _mm_andnot_si128(isNumberInt, vnanBucket));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(index), bucket);
+		page(index[0])[index[0] & 255]++;
+		page(index[1])[index[1] & 255]++;
+		page(index[2])[index[2] & 255]++;
+		page(index[3])[index[3] & 255]++;
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, vmin);
+	blockMin = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+	_mm_storeu_ps(lanes, vmax);
+	blockMax = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+	uint32_t counts[4];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(counts), vcount);
+	n = static_cast<uint64_t>(counts[0]) + counts[1] + counts[2] + counts[3];
+	double pairs[2];
+	_mm_storeu_pd(pairs, _mm_add_pd(vsum0, vsum1));
+	sum = pairs[0] + pairs[1];
+	_mm_storeu_pd(pairs, _mm_add_pd(vsquares0, vsquares1));
+	sumSquares = pairs[0] + pairs[1];
+#endif
+
+	// Whatever's left over, or everything without SSE2
+	for (; i < size; i++)
+	{
+		float value = values[i];
+		if (std::isnan(value))
+			continue;
+		blockMin = std::min(blockMin, value);
+		blockMax = std::max(blockMax, value);
+		n++;
+		double d = value - shift;
+		sum += d;
+		sumSquares += d * d;
+		uint32_t b = sortKey(value) >> 16;
+		page(b)[b & 255]++;
+	}
+
+	if (n == 0)
+		return;
+	min = std::min(min, blockMin);
+	max = std::max(max, blockMax);
+	double blockMean = sum / n;
+	combine(n, shift + blockMean, std::max(0.0, sumSquares - sum * blockMean));
+}
+
+void StatsAccumulator::merge(const StatsAccumulator& other)
+{
+	min = std::min(min, other.min);
+	max = std::max(max, other.max);
+	combine(other.count, other.mean, other.m2);
+	for (uint32_t p = 0; p < numPages; p++)
+	{
+		if (other.pages[p].empty())
+			continue;
+		uint32_t* counts = page(p << 8);
+		for (uint32_t i = 0; i < 256; i++)
+			counts[i] += other.pages[p][i];
+	}
+}
+
+ColumnStats StatsAccumulator::finish() const
+{
+	ColumnStats stats;
+	if (count == 0)
+		return stats;
+	stats.count = count;
+	stats.min = min;
+	stats.max = max;
+	stats.mean = mean;
+	stats.variance = m2 / count;
+
+	// Walk up the buckets to each percentile's rank, and guess where in its
+	// bucket it is by how far through the bucket's count the rank is
+	stats.percentiles[0] = min;
+	stats.percentiles[100] = max;
+	uint64_t below = 0;
+	uint32_t b = 0;
+	for (int p = 1; p < 100; p++)
+	{
+		double rank = (count - 1) * (p / 100.0);
+		while (b < numBuckets && below + getCount(b) <= rank)
+		{
+			// Whole pages with nothing in them are skipped at once
+			if (pages[b >> 8].empty()) {
+				b = (b | 255) + 1;
+				continue;
+			}
+			below += getCount(b++);
+		}
+		if (b == numBuckets) {
+			stats.percentiles[p] = max;
+			continue;
+		}
+		float lo = fromSortKey(b << 16);
+		float hi = fromSortKey((b << 16) | 0xFFFF);
+		float frac = static_cast<float>((rank - below + 0.5) / getCount(b));
+		float value = lo + (hi - lo) * frac;
+		// Buckets at the ends stretch past the numbers in them, or even to NaN
+		if (!(value >= min))
+			value = min;
+		if (!(value <= max))
+			value = max;
+		stats.percentiles[p] = value;
+	}
+	return stats;
+}
+
+ColumnStats computeColumnStats(const float* values, size_t count)
+{
+	StatsAccumulator accumulator;
+	accumulator.add(values, count);
+	return accumulator.finish();
+}
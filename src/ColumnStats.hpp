@@ -0,0 +1,68 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What's known about the numbers in a column, worked out once when it's
+// loaded. NaN cells, the ones that weren't numbers, are left out of all of it.
+struct ColumnStats
+{
+	uint64_t count = 0; // how many numbers, 0 if the column has none
+	float min = 0.f;
+	float max = 0.f;
+	double mean = 0.0;
+	double variance = 0.0;
+	// The value at each percentile from 0 to 100. The ends are exact, the rest
+	// are within about 1% of the true value.
+	float percentiles[101] = {};
+
+	double stddev() const
+	{
+		return std::sqrt(variance);
+	}
+
+	// Approximate value below which a fraction q of the numbers fall
+	float quantile(float q) const;
+};
+
+// Builds up ColumnStats in one pass over the values, which can come in any
+// number of pieces. Accumulators for different parts of a column can be
+// merged, so the parts can be done on different threads.
+struct StatsAccumulator
+{
+	StatsAccumulator();
+
+	void add(const float* values, size_t count);
+	void merge(const StatsAccumulator& other);
+	ColumnStats finish() const;
+
+private:
+	uint64_t count = 0;
+	float min;
+	float max;
+	double mean = 0.0;
+	double m2 = 0.0; // sum of squared differences from the mean
+	// Counts for the percentiles, in pages that are only made once a number
+	// lands in them. Empty pages have no numbers.
+	std::vector<std::vector<uint32_t>> pages;
+
+	uint32_t* page(uint32_t bucket)
+	{
+		std::vector<uint32_t>& p = pages[bucket >> 8];
+		if (p.empty())
+			p.assign(256, 0);
+		return p.data();
+	}
+
+	uint32_t getCount(uint32_t bucket) const
+	{
+		const std::vector<uint32_t>& p = pages[bucket >> 8];
+		return p.empty() ? 0 : p[bucket & 255];
+	}
+
+	void addBlock(const float* values, size_t count);
+	void combine(uint64_t n, double blockMean, double blockM2);
+};
+
+ColumnStats computeColumnStats(const float* values, size_t count);
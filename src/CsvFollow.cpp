@@ -0,0 +1,269 @@
+#include "CsvFollow.hpp"
+#include "CsvReader.hpp"
+#include "Transcode.hpp"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+
+// This much of the end of what's been parsed is checked for changes
+static const size_t tailSize = 256;
+// New bytes are read and parsed this much at a time
+static const size_t pieceSize = 16 << 20;
+
+static std::atomic<uint64_t> nextFollowId{1};
+
+// Converts the wanted cells of each new row into numbers
+struct AppendBuilder
+{
+	std::vector<std::vector<float>>& columns; // one per wanted column
+	const std::vector<int>& wanted;
+	char decimalPoint;
+	size_t rows = 0;
+
+	AppendBuilder(std::vector<std::vector<float>>& columns, const std::vector<int>& wanted, char decimalPoint)
+		: columns(columns)
+		, wanted(wanted)
+		, decimalPoint(decimalPoint)
+	{
+	}
+
+	void row(const CsvCell* cells, size_t count)
+	{
+		// Short rows are padded out with NaN, extra cells are ignored
+		for (size_t w = 0; w < wanted.size(); w++)
+		{
+			size_t c = wanted[w];
+			columns[w].push_back((c < count) ? parseFloatCell(cells[c], decimalPoint) : NAN);
+		}
+		rows++;
+	}
+};
+
+static std::string readTail(FileReader& file, uint64_t offset)
+{
+	std::string tail(std::min<uint64_t>(offset, tailSize), '\0');
+	tail.resize(file.read(offset - tail.size(), &tail[0], tail.size()));
+	return tail;
+}
+
+CsvFollower::CsvFollower(const std::string& path, const std::vector<int>& columns, LoadProgress& progress)
+	: path(path)
+{
+	dataset = parseCSV(path, progress, columns, &position);
+	dataset->followId = nextFollowId++;
+
+	// Move the columns into buffers that later datasets can share
+	for (size_t c = 0; c < dataset->data.size(); c++)
+	{
+		DataColumn& column = dataset->data[c];
+		if (!column.loaded)
+			continue;
+		std::shared_ptr<std::vector<float>> buffer = std::make_shared<std::vector<float>>();
+		buffer->swap(column.storage);
+		column.shared = buffer;
+		column.values = buffer->data();
+		wanted.push_back(static_cast<int>(c));
+		buffers.push_back(buffer);
+		stats.emplace_back();
+		stats.back().add(buffer->data(), buffer->size());
+	}
+
+	FileReader file(path);
+	tail = readTail(file, position.offset);
+}
+
+CsvFollower::Update CsvFollower::update()
+{
+	// A file that's gone might be being replaced, so wait for it to come back
+	std::unique_ptr<FileReader> file;
+	try {
+		file.reset(new FileReader(path));
+	} catch (std::runtime_error&) {
+		return UPDATE_NONE;
+	}
+	uint64_t size = file->size();
+	if (size < position.offset || readTail(*file, position.offset) != tail)
+		return UPDATE_RESET;
+	if (size == position.offset)
+		return UPDATE_NONE;
+
+	// Parse up to the last whole row, a piece at a time. A piece without a
+	// whole row in it gets doubled until it has one.
+	std::vector<std::vector<float>> rows(wanted.size());
+	AppendBuilder builder(rows, wanted, position.options.decimalPoint);
+	CsvParser parser(position.options);
+	std::vector<char> buffer;
+	std::string utf8;
+	uint64_t offset = position.offset;
+	size_t piece = pieceSize;
+	while (offset < size)
+	{
+		size_t length = static_cast<size_t>(std::min<uint64_t>(piece, size - offset));
+		buffer.resize(length);
+		length = file->read(offset, buffer.data(), length);
+
+		size_t used;
+		if (position.encoding == ENCODING_UTF8) {
+			used = parser.parse(buffer.data(), length, false, builder);
+		} else {
+			utf8.clear();
+			size_t converted = transcodeToUtf8(position.encoding, buffer.data(), length, false, utf8);
+			size_t parsed = parser.parse(utf8.data(), utf8.size(), false, builder);
+			used = converted - transcodedLength(position.encoding, utf8.data() + parsed, utf8.size() - parsed);
+		}
+
+		if (used == 0) {
+			if (offset + length >= size)
+				break;
+			piece *= 2;
+			continue;
+		}
+		offset += used;
+		piece = pieceSize;
+	}
+
+	// Lines that aren't rows, like comments, move us on without adding any
+	if (offset == position.offset)
+		return UPDATE_NONE;
+	position.offset = offset;
+	tail = readTail(*file, offset);
+	if (builder.rows == 0)
+		return UPDATE_NONE;
+
+	append(rows, builder.rows);
+	return UPDATE_GREW;
+}
+
+void CsvFollower::append(const std::vector<std::vector<float>>& rows, size_t numrows)
+{
+	if (numrows > static_cast<size_t>(INT_MAX - dataset->datalength))
+		throw std::runtime_error("too many rows");
+	std::shared_ptr<Dataset> next = std::make_shared<Dataset>();
+	next->path = dataset->path;
+	next->columns = dataset->columns;
+	next->datalength = dataset->datalength + static_cast<int>(numrows);
+	next->followId = dataset->followId;
+	next->data.resize(dataset->data.size());
+	for (size_t c = 0; c < next->data.size(); c++)
+		next->data[c].loaded = dataset->data[c].loaded;
+
+	for (size_t w = 0; w < wanted.size(); w++)
+	{
+		// Older datasets only look at the rows they had, so the new rows can
+		// go on the end of the same buffer while there's room for them
+		std::shared_ptr<std::vector<float>>& buffer = buffers[w];
+		if (buffer->size() + numrows > buffer->capacity()) {
+			std::shared_ptr<std::vector<float>> bigger = std::make_shared<std::vector<float>>();
+			bigger->reserve(std::max<size_t>(2 * (buffer->size() + numrows), 4096));
+			bigger->assign(buffer->begin(), buffer->end());
+			buffer = bigger;
+		}
+		buffer->insert(buffer->end(), rows[w].begin(), rows[w].end());
+		stats[w].add(rows[w].data(), numrows);
+
+		// The overview carries on from the last dataset's, adding runs to the
+		// buffers they share
+		DataColumn& column = next->data[wanted[w]];
+		column.shared = buffer;
+		column.values = buffer->data();
+		column.stats = stats[w].finish();
+		column.overview = dataset->data[wanted[w]].overview;
+		extendOverview(column.overview, column.values, dataset->datalength, next->datalength);
+	}
+	dataset = next;
+}
+
+
+// Without anything better, a change in size or time says the file changed
+bool FileWatcher::checkInfo()
+{
+	uint64_t newSize;
+	int64_t newTime;
+	if (!getFileInfo(path, newSize, newTime))
+		return false;
+	bool changed = (newSize != size || newTime != mtime);
+	size = newSize;
+	mtime = newTime;
+	return changed;
+}
+
+#if defined(__linux__)
+
+static const uint32_t watchEvents = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF;
+
+FileWatcher::FileWatcher(const std::string& path)
+	: path(path)
+{
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd >= 0)
+		watch = inotify_add_watch(fd, path.c_str(), watchEvents);
+	getFileInfo(path, size, mtime);
+}
+
+FileWatcher::~FileWatcher()
+{
+	if (fd >= 0)
+		::close(fd);
+}
+
+bool FileWatcher::poll()
+{
+	if (fd >= 0) {
+		bool changed = false;
+		bool gone = false;
+		alignas(inotify_event) char events[4096];
+		while (true)
+		{
+			ssize_t got = ::read(fd, events, sizeof(events));
+			if (got <= 0)
+				break;
+			changed = true;
+			for (char* p = events; p < events + got; )
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+				if (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED))
+					gone = true;
+				p += sizeof(inotify_event) + event->len;
+			}
+		}
+
+		// When the file is moved away or deleted, like a rotated log, watch
+		// for a new one turning up in its place
+		if (gone && watch >= 0) {
+			inotify_rm_watch(fd, watch);
+			watch = -1;
+		}
+		if (watch < 0) {
+			watch = inotify_add_watch(fd, path.c_str(), watchEvents);
+			changed = changed || watch >= 0;
+		}
+		return changed;
+	}
+	return checkInfo();
+}
+
+#else
+
+FileWatcher::FileWatcher(const std::string& path)
+	: path(path)
+{
+	getFileInfo(path, size, mtime);
+}
+
+FileWatcher::~FileWatcher()
+{
+}
+
+bool FileWatcher::poll()
+{
+	return checkInfo();
+}
+
+#endif
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ColumnStats.hpp"
+#include "CsvLoader.hpp"
+#include "Dataset.hpp"
+
+// Keeps up with a CSV file that's being added to, like a log or a sensor
+// feed. The file is parsed once, then each update() parses only the bytes
+// added since and makes a new dataset with the new rows on the end. Stats and
+// overviews are carried on from the new rows alone, not made again.
+//
+// Rows go into buffers that are shared by every dataset of the file. A
+// buffer only ever grows past the rows that older datasets can see, so
+// nothing already published changes under the audio thread. When a buffer
+// fills up the rows move to one twice the size, and the old one lives on as
+// long as the datasets using it.
+struct CsvFollower
+{
+	// Parses the file up to its last whole row. Throws on bad files.
+	CsvFollower(const std::string& path, const std::vector<int>& columns, LoadProgress& progress);
+
+	// The latest dataset
+	std::shared_ptr<Dataset> getDataset() const
+	{
+		return dataset;
+	}
+
+	enum Update
+	{
+		UPDATE_NONE, // nothing new yet
+		UPDATE_GREW, // getDataset() has more rows
+		UPDATE_RESET, // the file was cut short or rewritten, it has to be loaded again
+	};
+
+	Update update();
+
+private:
+	CsvFollower(const CsvFollower&) = delete;
+	CsvFollower& operator=(const CsvFollower&) = delete;
+
+	void append(const std::vector<std::vector<float>>& rows, size_t numrows);
+
+	std::string path;
+	ParsePosition position;
+	std::vector<int> wanted; // the columns that are loaded
+	std::vector<std::shared_ptr<std::vector<float>>> buffers; // one per wanted column
+	std::vector<StatsAccumulator> stats; // one per wanted column
+	// The last few bytes parsed, which have to stay the same if the file is
+	// only being added to
+	std::string tail;
+	std::shared_ptr<Dataset> dataset;
+};
+
+// Says when a file might have changed. On Linux inotify says so, elsewhere
+// the size and modification time are checked each time.
+struct FileWatcher
+{
+	explicit FileWatcher(const std::string& path);
+	~FileWatcher();
+
+	// Never waits. True if the file may have changed since the last call.
+	bool poll();
+
+private:
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	bool checkInfo();
+
+	std::string path;
+	uint64_t size = 0;
+	int64_t mtime = 0;
+#if defined(__linux__)
+	int fd = -1;
+	int watch = -1;
+#endif
+};
@@ -0,0 +1,740 @@
+#include "CsvLoader.hpp"
+#include "ArrowReader.hpp"
+#include "CsvFollow.hpp"
+#include "CsvReader.hpp"
+#include "CsvStream.hpp"
+#include "DatasetCache.hpp"
+#include "Inflate.hpp"
+#include "ThreadPool.hpp"
+#include "Transcode.hpp"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <deque>
+#include <exception>
+#include <stdexcept>
+
+
+// Keeps the names from the first row the parser hands over
+struct HeaderBuilder
+{
+	std::vector<std::string>& names;
+	bool found = false;
+
+	explicit HeaderBuilder(std::vector<std::string>& names)
+		: names(names)
+	{
+	}
+
+	void row(const CsvCell* cells, size_t count)
+	{
+		if (found)
+			return;
+		for (size_t c = 0; c < count; c++)
+			names.push_back(cells[c].str());
+		found = true;
+	}
+};
+
+// Converts the rows of one chunk of the file into columns of numbers. Only
+// the wanted columns are converted and kept, the other cells are skipped.
+// The time column, if there is one, is also read as times.
+struct ChunkBuilder
+{
+	std::vector<std::vector<float>>& columns; // one per wanted column
+	const std::vector<int>& wanted;
+	std::vector<double>& times;
+	int timeColumn;
+	size_t& rows;
+	char decimalPoint;
+
+	ChunkBuilder(std::vector<std::vector<float>>& columns, const std::vector<int>& wanted, std::vector<double>& times,
+		int timeColumn, size_t& rows, char decimalPoint)
+		: columns(columns)
+		, wanted(wanted)
+		, times(times)
+		, timeColumn(timeColumn)
+		, rows(rows)
+		, decimalPoint(decimalPoint)
+	{
+	}
+
+	void row(const CsvCell* cells, size_t count)
+	{
+		// Short rows are padded out with NaN, extra cells are ignored
+		size_t numwanted = wanted.size();
+		for (size_t w = 0; w < numwanted; w++)
+		{
+			size_t c = wanted[w];
+			float value = (c < count) ? parseFloatCell(cells[c], decimalPoint) : NAN;
+			columns[w].push_back(value);
+		}
+		if (timeColumn >= 0)
+			times.push_back((static_cast<size_t>(timeColumn) < count) ? parseTimeCell(cells[timeColumn], decimalPoint) : NAN);
+		rows++;
+	}
+};
+
+// A piece of the file parsed on its own. Chunks start straight after a
+// newline, which is only a guess at a row boundary until the chunk before
+// has been parsed.
+struct Chunk
+{
+	size_t begin = 0;
+	size_t end = 0;
+	size_t used = 0; // bytes that made up whole rows
+	size_t rows = 0;
+	std::vector<std::vector<float>> columns; // one per wanted column
+	std::vector<double> times; // one per row, if there's a time column
+};
+
+// Parse text[begin, end) into chunk, a slice at a time so we can report
+// progress and notice cancellation. Unless it's the last chunk, parsing stops
+// after the last complete row.
+static void parseChunk(const char* text, TextEncoding encoding, Chunk& chunk, bool final, const CsvOptions& options,
+	const std::vector<int>& wanted, int timeColumn, LoadProgress& progress, std::atomic<size_t>& bytesDone, size_t totalBytes)
+{
+	chunk.used = 0;
+	chunk.rows = 0;
+	chunk.columns.assign(wanted.size(), std::vector<float>());
+	chunk.times.clear();
+
+	// Every row ends in a newline, so counting them is a cheap upper bound
+	// on the number of rows. Reserving that up front means the columns
+	// never have to be reallocated and copied as they grow.
+	size_t expectedRows = std::count(text + chunk.begin, text + chunk.end, '\n') + 1;
+	for (std::vector<float>& column : chunk.columns)
+		column.reserve(expectedRows);
+	if (timeColumn >= 0)
+		chunk.times.reserve(expectedRows);
+
+	CsvParser parser(options);
+	ChunkBuilder builder(chunk.columns, wanted, chunk.times, timeColumn, chunk.rows, options.decimalPoint);
+	const size_t sliceSize = 4 << 20;
+
+	if (encoding != ENCODING_UTF8) {
+		// Convert a slice at a time and parse that, keeping any unfinished
+		// row to go in front of the next slice
+		std::string utf8;
+		size_t offset = chunk.begin;
+		while (offset < chunk.end)
+		{
+			size_t length = std::min(sliceSize, chunk.end - offset);
+			bool last = (offset + length == chunk.end);
+			size_t converted = transcodeToUtf8(encoding, text + offset, length, last, utf8);
+			offset += converted;
+			size_t used = parser.parse(utf8.data(), utf8.size(), final && last, builder);
+			utf8.erase(0, used);
+
+			size_t done = std::min(bytesDone.fetch_add(converted) + converted, totalBytes);
+			progress.set(0.9f * done / totalBytes);
+			progress.check();
+		}
+		chunk.used = (chunk.end - chunk.begin) - transcodedLength(encoding, utf8.data(), utf8.size());
+		return;
+	}
+
+	// A slice that doesn't hold a single whole row gets doubled until it does
+	size_t slice = sliceSize;
+	size_t offset = chunk.begin;
+	while (offset < chunk.end)
+	{
+		size_t length = std::min(slice, chunk.end - offset);
+		bool last = (offset + length == chunk.end);
+		size_t used = parser.parse(text + offset, length, final && last, builder);
+		if (used == 0 && !(final && last)) {
+			// Whatever is left of the chunk isn't a whole row
+			if (last)
+				break;
+			slice *= 2;
+			continue;
+		}
+		offset += used;
+		slice = sliceSize;
+
+		// Chunks parsed twice count twice, so don't run past the end
+		size_t done = std::min(bytesDone.fetch_add(used) + used, totalBytes);
+		progress.set(0.9f * done / totalBytes);
+		progress.check();
+	}
+	chunk.used = offset - chunk.begin;
+}
+
+// Parse text[0, size) into the columns of dataset, splitting the work across
+// the thread pool. Text that isn't UTF-8 is converted as it goes. Only the
+// columns listed are kept, or all of them if the list is empty. The times of
+// the time column, if there is one, go into times.
+//
+// Unless final is set, an unfinished row at the end is left alone. Returns
+// how many bytes were parsed, and the options they were parsed with.
+static size_t parseChunks(const char* text, size_t size, TextEncoding encoding, const std::vector<int>& columns,
+	int timeColumn, bool final, Dataset& dataset, std::vector<double>& times, CsvOptions& options, LoadProgress& progress)
+{
+	size_t newline = newlineLength(encoding);
+	std::string start;
+	transcodeToUtf8(encoding, text, std::min<size_t>(size, 64 << 10) & ~size_t(1), false, start);
+	options = sniffCsvOptions(start.data(), start.size());
+
+	// The header comes first, on this thread. Empty or comment lines might be
+	// skipped before it, so keep taking lines until a row turns up.
+	size_t headerEnd = 0;
+	while (true)
+	{
+		size_t lineEnd = findNewline(encoding, text, headerEnd, size);
+		bool last = (lineEnd == size);
+		size_t length = last ? size : lineEnd + newline;
+
+		std::string line;
+		transcodeToUtf8(encoding, text, length, last, line);
+		CsvParser parser(options);
+		HeaderBuilder header(dataset.columns);
+		parser.parse(line.data(), line.size(), last, header);
+		headerEnd = length;
+		if (header.found || last)
+			break;
+	}
+	if (dataset.columns.empty())
+		throw std::runtime_error("no header row");
+	size_t numcolumns = dataset.columns.size();
+
+	// Sort out which columns to keep, ignoring any the file doesn't have
+	std::vector<int> wanted;
+	for (size_t c = 0; c < numcolumns; c++)
+	{
+		if (columns.empty() || std::find(columns.begin(), columns.end(), static_cast<int>(c)) != columns.end())
+			wanted.push_back(static_cast<int>(c));
+	}
+
+	// Cut the rest into a few chunks per thread so a slow one doesn't hold
+	// everything up, but not so small that the overhead shows.
+	ThreadPool& pool = ThreadPool::shared();
+	const size_t minChunkSize = 1 << 20;
+	size_t dataSize = size - headerEnd;
+	size_t numchunks = std::max<size_t>(1, std::min<size_t>(4 * pool.getThreads(), dataSize / minChunkSize));
+	std::vector<Chunk> chunks;
+	for (size_t i = 0; i < numchunks; i++)
+	{
+		size_t begin = headerEnd;
+		if (i > 0) {
+			// Start just after the first newline at or after the even split,
+			// keeping to whole UTF-16 units
+			size_t split = (headerEnd + dataSize / numchunks * i) / newline * newline;
+			size_t lineEnd = findNewline(encoding, text, split - newline, size);
+			begin = (lineEnd == size) ? size : lineEnd + newline;
+			if (begin == chunks.back().begin)
+				continue;
+		}
+		Chunk chunk;
+		chunk.begin = begin;
+		chunks.push_back(std::move(chunk));
+	}
+	for (size_t i = 0; i < chunks.size(); i++)
+		chunks[i].end = (i + 1 < chunks.size()) ? chunks[i + 1].begin : size;
+
+	std::atomic<size_t> bytesDone{0};
+	pool.parallelFor(chunks.size(), [&](size_t i) {
+		parseChunk(text, encoding, chunks[i], final && i + 1 == chunks.size(), options, wanted, timeColumn, progress, bytesDone,
+			dataSize);
+	});
+
+	// Check the guesses in order. A chunk only started on a real row boundary
+	// if the one before used up all of its bytes, otherwise that newline was
+	// inside quotes. Wrong chunks get parsed again from where the row really
+	// started, which can only happen with quoted line breaks.
+	size_t rowStart = headerEnd;
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		Chunk& chunk = chunks[i];
+		if (chunk.begin != rowStart) {
+			chunk.begin = rowStart;
+			parseChunk(text, encoding, chunk, final && i + 1 == chunks.size(), options, wanted, timeColumn, progress, bytesDone,
+				dataSize);
+		}
+		rowStart = chunk.begin + chunk.used;
+	}
+
+	// Stitch the chunks together, a column at a time, freeing them as we go
+	size_t numrows = 0;
+	for (const Chunk& chunk : chunks)
+		numrows += chunk.rows;
+	if (numrows > INT_MAX)
+		throw std::runtime_error("too many rows");
+	dataset.datalength = static_cast<int>(numrows);
+
+	dataset.data.resize(numcolumns);
+	for (DataColumn& column : dataset.data)
+		column.loaded = false;
+	pool.parallelFor(wanted.size(), [&](size_t w) {
+		std::vector<float> values;
+		values.reserve(numrows);
+		for (Chunk& chunk : chunks)
+		{
+			values.insert(values.end(), chunk.columns[w].begin(), chunk.columns[w].end());
+			std::vector<float>().swap(chunk.columns[w]);
+		}
+		DataColumn& column = dataset.data[wanted[w]];
+		column.setValues(std::move(values));
+		column.loaded = true;
+	});
+	if (timeColumn >= 0) {
+		times.reserve(numrows);
+		for (Chunk& chunk : chunks)
+			times.insert(times.end(), chunk.times.begin(), chunk.times.end());
+	}
+	return rowStart;
+}
+
+// Passes blocks of decompressed text from the thread decompressing them to
+// the thread parsing them. Only a few blocks are waiting at once, so memory
+// stays the same however big the file is.
+struct BlockQueue
+{
+	static const size_t maxBlocks = 3;
+
+	// Waits for room. Returns false if the parser has stopped.
+	bool push(std::string& block)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return stopped || blocks.size() < maxBlocks; });
+		if (stopped)
+			return false;
+		blocks.push_back(std::move(block));
+		changed.notify_all();
+		return true;
+	}
+
+	// No more blocks are coming. The error, if there is one, is rethrown by pop().
+	void finish(std::exception_ptr e)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finished = true;
+		error = e;
+		changed.notify_all();
+	}
+
+	// Waits for the next block. Returns false once they've all been taken.
+	bool pop(std::string& block)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return finished || !blocks.empty(); });
+		if (!blocks.empty()) {
+			block = std::move(blocks.front());
+			blocks.pop_front();
+			changed.notify_all();
+			return true;
+		}
+		if (error)
+			std::rethrow_exception(error);
+		return false;
+	}
+
+	// The parser is done with it, whether it got to the end or not
+	void stop()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopped = true;
+		changed.notify_all();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<std::string> blocks;
+	bool finished = false;
+	bool stopped = false;
+	std::exception_ptr error;
+};
+
+// Takes the column names from the first row, then converts the wanted cells
+// of the rows after it, and the time column into times
+struct StreamedRowBuilder
+{
+	std::vector<std::string>& names;
+	const std::vector<int>& columns;
+	int timeColumn;
+	std::vector<int> wanted;
+	std::vector<std::vector<float>> values; // one per wanted column
+	std::vector<double> times;
+	char decimalPoint = '.';
+	size_t rows = 0;
+	bool found = false;
+
+	StreamedRowBuilder(std::vector<std::string>& names, const std::vector<int>& columns, int timeColumn)
+		: names(names)
+		, columns(columns)
+		, timeColumn(timeColumn)
+	{
+	}
+
+	void row(const CsvCell* cells, size_t count)
+	{
+		if (!found) {
+			for (size_t c = 0; c < count; c++)
+			{
+				names.push_back(cells[c].str());
+				if (columns.empty() || std::find(columns.begin(), columns.end(), static_cast<int>(c)) != columns.end())
+					wanted.push_back(static_cast<int>(c));
+			}
+			values.resize(wanted.size());
+			found = true;
+			return;
+		}
+		for (size_t w = 0; w < wanted.size(); w++)
+		{
+			size_t c = wanted[w];
+			values[w].push_back((c < count) ? parseFloatCell(cells[c], decimalPoint) : NAN);
+		}
+		if (timeColumn >= 0)
+			times.push_back((static_cast<size_t>(timeColumn) < count) ? parseTimeCell(cells[timeColumn], decimalPoint) : NAN);
+		rows++;
+	}
+};
+
+// Parse a gzipped file into the columns of dataset as it's decompressed. The
+// decompressing happens on a thread of its own, a block ahead of the parsing,
+// and only a few blocks of the text are ever in memory.
+static void parseGzipCSV(const MappedFile& file, const std::vector<int>& columns, int timeColumn, Dataset& dataset,
+	std::vector<double>& times, LoadProgress& progress)
+{
+	const size_t blockSize = 4 << 20;
+	// The separator and decimal point are worked out from this much text
+	const size_t sniffSize = 64 << 10;
+
+	GzipReader reader(file.data(), file.size());
+	std::atomic<size_t> position{0};
+	BlockQueue queue;
+	std::thread inflater([&] {
+		try {
+			while (true)
+			{
+				std::string block(blockSize, '\0');
+				block.resize(reader.read(&block[0], block.size()));
+				position.store(reader.getPosition(), std::memory_order_relaxed);
+				if (block.empty() || !queue.push(block))
+					break;
+			}
+			queue.finish(NULL);
+		} catch (...) {
+			queue.finish(std::current_exception());
+		}
+	});
+
+	// However parsing ends, the decompressing has to stop too
+	struct Stopper
+	{
+		BlockQueue& queue;
+		std::thread& thread;
+
+		~Stopper()
+		{
+			queue.stop();
+			thread.join();
+		}
+	} stopper{queue, inflater};
+
+	TextEncoding encoding = ENCODING_UTF8;
+	std::unique_ptr<CsvParser> parser;
+	StreamedRowBuilder builder(dataset.columns, columns, timeColumn);
+	std::string raw; // text that isn't UTF-8 and hasn't been converted yet
+	std::string text; // UTF-8 that hasn't been parsed yet
+	std::string block;
+	bool first = true;
+	bool more = true;
+	while (more)
+	{
+		more = queue.pop(block);
+		if (first && more) {
+			// Skip any byte order mark, anything but UTF-8 gets converted
+			size_t bomLength;
+			encoding = detectEncoding(block.data(), block.size(), bomLength);
+			block.erase(0, bomLength);
+			first = false;
+		}
+		if (encoding == ENCODING_UTF8) {
+			text.append(block);
+		} else {
+			raw.append(block);
+			raw.erase(0, transcodeToUtf8(encoding, raw.data(), raw.size(), !more, text));
+		}
+		block.clear();
+
+		if (!parser) {
+			if (more && text.size() < sniffSize)
+				continue;
+			CsvOptions options = sniffCsvOptions(text.data(), std::min(text.size(), sniffSize));
+			parser.reset(new CsvParser(options));
+			builder.decimalPoint = options.decimalPoint;
+		}
+		// Whatever is left is an unfinished row, which goes in front of the next block
+		text.erase(0, parser->parse(text.data(), text.size(), !more, builder));
+
+		progress.set(0.9f * position.load(std::memory_order_relaxed) / std::max<size_t>(file.size(), 1));
+		progress.check();
+	}
+	if (dataset.columns.empty())
+		throw std::runtime_error("no header row");
+
+	if (builder.rows > INT_MAX)
+		throw std::runtime_error("too many rows");
+	dataset.datalength = static_cast<int>(builder.rows);
+	dataset.data.resize(dataset.columns.size());
+	for (DataColumn& column : dataset.data)
+		column.loaded = false;
+	for (size_t w = 0; w < builder.wanted.size(); w++)
+	{
+		DataColumn& column = dataset.data[builder.wanted[w]];
+		column.setValues(std::move(builder.values[w]));
+		column.loaded = true;
+	}
+	times.swap(builder.times);
+}
+
+std::shared_ptr<Dataset> parseCSV(const std::string& path, LoadProgress& progress, const std::vector<int>& columns,
+	ParsePosition* position, int timeColumn)
+{
+	progress.set(0.f);
+
+	std::shared_ptr<Dataset> dataset = std::make_shared<Dataset>();
+	dataset->path = path;
+
+	std::vector<double> times;
+	MappedFile file(path);
+	if (isZstdData(file.data(), file.size()))
+		throw std::runtime_error("zstd compressed files aren't supported, only gzip");
+	if (isGzipData(file.data(), file.size())) {
+		// There's nowhere to carry on from in compressed text
+		if (position)
+			throw std::runtime_error("compressed files can't be followed");
+		parseGzipCSV(file, columns, timeColumn, *dataset, times, progress);
+	} else {
+		const char* text = file.data();
+		size_t size = file.size();
+
+		// Skip any byte order mark, anything but UTF-8 gets converted as it's parsed
+		size_t bomLength;
+		TextEncoding encoding = detectEncoding(text, size, bomLength);
+		CsvOptions options;
+		size_t parsed = parseChunks(text + bomLength, size - bomLength, encoding, columns, timeColumn, !position, *dataset, times,
+			options, progress);
+		if (position) {
+			position->options = options;
+			position->encoding = encoding;
+			position->offset = bomLength + parsed;
+		}
+	}
+
+	if (timeColumn >= 0)
+		dataset->timedeltas = makeTimeDeltas(times);
+
+	// Work out the range and spread of each column
+	ThreadPool::shared().parallelFor(dataset->data.size(), [&](size_t c) {
+		DataColumn& column = dataset->data[c];
+		if (column.loaded)
+			column.stats = computeColumnStats(column.values, dataset->datalength);
+	});
+
+	progress.set(1.f);
+	return dataset;
+}
+
+// The first few bytes of a file, enough to tell what kind of file it is
+static std::string readFileStart(const std::string& path)
+{
+	FileReader file(path);
+	std::string start(8, '\0');
+	start.resize(file.read(0, &start[0], start.size()));
+	return start;
+}
+
+// Use the cached copy of a file if it's up to date, otherwise parse it. The
+// cache always has every column and no times, so a file parsed for only some
+// of them, or for its times, isn't cached. Otherwise save is set, and the
+// dataset should go in the cache under key once it's been handed over.
+static std::shared_ptr<Dataset> loadCSV(const std::string& path, const std::vector<int>& columns, int timeColumn,
+	const std::string& cacheDir, CacheKey& key, bool& save, LoadProgress& progress)
+{
+	bool cacheable = !cacheDir.empty() && timeColumn < 0 && getCacheKey(path, key);
+	if (cacheable) {
+		std::shared_ptr<Dataset> dataset = readDatasetCache(cacheDir, path, key, &progress.cancelled);
+		if (dataset)
+			return dataset;
+		progress.check();
+	}
+
+	std::shared_ptr<Dataset> dataset = parseCSV(path, progress, columns, NULL, timeColumn);
+	save = cacheable && columns.empty();
+	return dataset;
+}
+
+
+CsvLoader::~CsvLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+		next.reset();
+		progress.cancelled = true;
+	}
+	wake.notify_one();
+	if (worker.joinable())
+		worker.join();
+}
+
+void CsvLoader::start(const std::string& path, const LoadOptions& options, DoneCallback done)
+{
+	queue(new Job{path, options, cacheDir, done, NULL});
+}
+
+void CsvLoader::addMipmaps(std::shared_ptr<const Dataset> dataset, DoneCallback done)
+{
+	LoadOptions options;
+	options.mipmaps = true;
+	queue(new Job{dataset->path, options, cacheDir, done, dataset});
+}
+
+void CsvLoader::queue(Job* job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		next.reset(job);
+
+		// Abandon whatever is loading now, the worker moves straight on to this job
+		if (running)
+			progress.cancelled = true;
+		if (!job->source)
+			busy = true;
+
+		// The thread is only started once something needs loading
+		if (!worker.joinable())
+			worker = std::thread(&CsvLoader::run, this);
+	}
+	wake.notify_one();
+}
+
+void CsvLoader::cancel()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	next.reset();
+	progress.cancelled = true;
+	// A job the worker hadn't got to yet is gone, and nothing else would say
+	// so. One that's running says so itself when it stops.
+	if (!running)
+		busy = false;
+}
+
+void CsvLoader::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		wake.wait(lock, [this] { return quit || next; });
+		if (quit)
+			break;
+
+		std::unique_ptr<Job> job = std::move(next);
+		running = true;
+		progress.cancelled = false;
+		progress.set(0.f);
+		lock.unlock();
+
+		std::shared_ptr<Dataset> dataset;
+		std::unique_ptr<CsvFollower> follower;
+		std::string error;
+		CacheKey key;
+		bool save = false;
+		try {
+			// Compressed files can only be read from the start, so they can't
+			// be streamed or followed, just loaded. Adding mipmaps doesn't
+			// touch the file at all.
+			std::string start = job->source ? std::string() : readFileStart(job->path);
+			bool compressed = isGzipData(start.data(), start.size()) || isZstdData(start.data(), start.size());
+			if (job->source) {
+				// The rows are the ones already playing, only the mipmaps are new
+				dataset = copyDataset(job->source);
+			} else if (isArrowData(start.data(), start.size())) {
+				// Arrow files are mapped, so there's nothing to stream, cache or follow
+				dataset = readArrowFile(job->path, progress, job->options.columns, job->options.timecolumn);
+			} else if (job->options.stream && !compressed) {
+				dataset = openCsvStream(job->path, progress);
+			} else if (job->options.follow && !compressed) {
+				follower.reset(new CsvFollower(job->path, job->options.columns, progress));
+				dataset = follower->getDataset();
+			} else {
+				dataset = loadCSV(job->path, job->options.columns, job->options.timecolumn, job->cacheDir, key, save, progress);
+			}
+			if (dataset && !job->source)
+				makeOverviews(*dataset);
+			if (dataset && !follower && job->options.mipmaps)
+				makeMipmaps(*dataset);
+		} catch (LoadCancelled&) {
+		} catch (std::exception& e) {
+			error = e.what();
+		} catch (...) {
+			error = "unknown error";
+		}
+
+		// Results of a cancelled load are thrown away, even if it managed to finish
+		if (!progress.cancelled)
+			job->done(dataset, error);
+
+		// The dataset is playing before it's cached, so the first load of a
+		// big file isn't held up writing a second copy of it. A new load
+		// still has to wait for the cache, but it cuts the writing short.
+		if (save && !progress.cancelled) {
+			lock.lock();
+			if (!next)
+				busy = false;
+			lock.unlock();
+			if (writeDatasetCache(job->cacheDir, *dataset, key, &progress.cancelled))
+				trimDatasetCache(job->cacheDir, datasetCacheLimit);
+		}
+
+		lock.lock();
+		running = false;
+		if (!next)
+			busy = false;
+
+		if (dataset && follower)
+			follow(*job, *follower, lock);
+	}
+}
+
+// Keeps up with a followed file until there's another job, or it's
+// cancelled. The lock is held going in and coming out.
+void CsvLoader::follow(Job& job, CsvFollower& follower, std::unique_lock<std::mutex>& lock)
+{
+	FileWatcher watcher(job.path);
+	while (true)
+	{
+		// Check the file every so often, but stop straight away for a new job
+		wake.wait_for(lock, std::chrono::milliseconds(100), [this] { return quit || next || progress.cancelled; });
+		if (quit || next || progress.cancelled)
+			return;
+		lock.unlock();
+
+		CsvFollower::Update update = CsvFollower::UPDATE_NONE;
+		std::string error;
+		try {
+			if (watcher.poll())
+				update = follower.update();
+		} catch (std::exception& e) {
+			error = e.what();
+		}
+		if (update == CsvFollower::UPDATE_GREW) {
+			job.done(follower.getDataset(), "");
+		}
+		else if (!error.empty())
+			job.done(NULL, error);
+
+		lock.lock();
+		if (!error.empty())
+			return;
+		if (update == CsvFollower::UPDATE_RESET && !next) {
+			// The file's been rewritten, so load it again from the start
+			next.reset(new Job(job));
+			busy = true;
+			return;
+		}
+	}
+}
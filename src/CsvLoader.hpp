@@ -0,0 +1,156 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CsvReader.hpp"
+#include "Dataset.hpp"
+#include "Transcode.hpp"
+
+struct CsvFollower;
+
+// Thrown by the parser when a load has been cancelled
+struct LoadCancelled {};
+
+// Progress and cancellation shared between a load and whoever started it
+struct LoadProgress
+{
+	std::atomic<float> fraction{0.f};
+	std::atomic<bool> cancelled{false};
+
+	void set(float f)
+	{
+		fraction.store(f, std::memory_order_relaxed);
+	}
+
+	// Call this regularly while loading, it bails out if the load was cancelled
+	void check() const
+	{
+		if (cancelled.load(std::memory_order_relaxed))
+			throw LoadCancelled();
+	}
+};
+
+// Where parsing a file stopped, so it can carry on from there if the file
+// grows. See CsvFollower.
+struct ParsePosition
+{
+	CsvOptions options;
+	TextEncoding encoding = ENCODING_UTF8;
+	uint64_t offset = 0; // just past the last whole row
+};
+
+// Parse a CSV file into a new dataset. Throws on bad files. Gzipped files are
+// parsed as they're decompressed, zstd ones aren't supported.
+//
+// Every column is named, but only the listed ones are parsed and stored, the
+// rest aren't loaded. Cells of the other columns are skipped without being
+// converted, so a wide file costs about as much as its listed columns. An
+// empty list loads them all.
+//
+// With position set, a row that's still being written at the end of the file
+// is left out, and position says where parsing stopped.
+//
+// With a time column, its cells are also read as times with parseTimeCell()
+// and made into the dataset's timedeltas.
+std::shared_ptr<Dataset> parseCSV(const std::string& path, LoadProgress& progress,
+	const std::vector<int>& columns = std::vector<int>(), ParsePosition* position = NULL, int timeColumn = -1);
+
+// How to load a file
+struct LoadOptions
+{
+	// Only index the file, and read its rows in later around the playhead.
+	// See CsvStream.
+	bool stream = false;
+	// Which columns to load, see parseCSV(). Empty loads them all.
+	std::vector<int> columns;
+	// Keep watching the file after loading it, and load any rows added to the
+	// end. See CsvFollower. Streamed files aren't followed.
+	bool follow = false;
+	// The column to read times from, for playing rows at their times, or -1.
+	// Streamed and followed files don't get times.
+	int timecolumn = -1;
+	// Make the columns' mipmaps, for the band-limited oscillator. See
+	// makeMipmaps(). Streamed and followed files don't get them.
+	bool mipmaps = false;
+};
+
+// Loads CSV files on a background thread so the UI and audio threads never
+// wait on file I/O or parsing. Arrow files are loaded too, see readArrowFile().
+//
+// Parsed files are cached in the cache directory, if one has been set, and
+// later loads of the same file map the cache instead of parsing again. The
+// cache is written after the callback, and trimmed to datasetCacheLimit.
+// Files being followed aren't cached, since they keep changing.
+//
+// Only the latest request matters: starting a new load cancels whatever is
+// in flight. When a load finishes the callback runs on the worker thread with
+// either a dataset or an error message. Cancelled loads don't call back.
+//
+// A followed file stays with the worker after loading. Whenever rows are
+// added to it the callback runs again with a dataset that has them, until
+// the next load or cancel().
+struct CsvLoader
+{
+	typedef std::function<void(std::shared_ptr<Dataset> dataset, const std::string& error)> DoneCallback;
+
+	~CsvLoader();
+
+	// Call before the first load
+	void setCacheDir(const std::string& dir)
+	{
+		cacheDir = dir;
+	}
+
+	const std::string& getCacheDir() const
+	{
+		return cacheDir;
+	}
+
+	void start(const std::string& path, const LoadOptions& options, DoneCallback done);
+	void cancel();
+
+	// Makes the mipmaps a dataset was loaded without, from the rows it already
+	// has, and calls back with a copy that has them. Like a load it cancels
+	// whatever is in flight, but it doesn't make the loader busy.
+	void addMipmaps(std::shared_ptr<const Dataset> dataset, DoneCallback done);
+
+	bool isBusy() const
+	{
+		return busy.load(std::memory_order_relaxed);
+	}
+
+	float getProgress() const
+	{
+		return progress.fraction.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Job
+	{
+		std::string path;
+		LoadOptions options;
+		std::string cacheDir;
+		DoneCallback done;
+		std::shared_ptr<const Dataset> source; // set if this is for addMipmaps()
+	};
+
+	void queue(Job* job);
+	void run();
+	void follow(Job& job, CsvFollower& follower, std::unique_lock<std::mutex>& lock);
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::unique_ptr<Job> next;
+	bool running = false;
+	bool quit = false;
+
+	std::atomic<bool> busy{false};
+	LoadProgress progress;
+	std::string cacheDir;
+};
@@ -0,0 +1,429 @@
+#include "CsvReader.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <stdexcept>
+#include "rapidcsv.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#if defined(_WIN32)
+
+std::wstring widen(const std::string& path)
+{
+	int wlen = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+	std::wstring wpath(wlen, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wpath[0], wlen);
+	return wpath;
+}
+
+MappedFile::MappedFile(const std::string& path, Access access)
+{
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | ((access == ACCESS_SEQUENTIAL) ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS);
+	HANDLE f = CreateFileW(widen(path).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+						OPEN_EXISTING, flags, NULL);
+	if (f == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("could not open " + path);
+	file = f;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(f, &fileSize)) {
+		CloseHandle(f);
+		throw std::runtime_error("could not read size of " + path);
+	}
+	length = static_cast<size_t>(fileSize.QuadPart);
+
+	// Empty files can't be mapped, but there's nothing to read anyway
+	if (length == 0)
+		return;
+
+	mapping = CreateFileMappingW(f, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping)
+		begin = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!begin) {
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(f);
+		throw std::runtime_error("could not map " + path);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (begin)
+		UnmapViewOfFile(begin);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file)
+		CloseHandle(file);
+}
+
+FileReader::FileReader(const std::string& path)
+{
+	HANDLE f = CreateFileW(widen(path).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+						OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("could not open " + path);
+	file = f;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(f, &fileSize)) {
+		CloseHandle(f);
+		throw std::runtime_error("could not read size of " + path);
+	}
+	length = static_cast<uint64_t>(fileSize.QuadPart);
+}
+
+FileReader::~FileReader()
+{
+	CloseHandle(file);
+}
+
+bool getFileInfo(const std::string& path, uint64_t& size, int64_t& mtime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesExW(widen(path).c_str(), GetFileExInfoStandard, &info))
+		return false;
+	size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+
+	// File times count 100ns ticks from 1601
+	uint64_t ticks = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+	mtime = static_cast<int64_t>(ticks / 10000000) - 11644473600LL;
+	return true;
+}
+
+size_t FileReader::read(uint64_t offset, char* buffer, size_t size)
+{
+	size_t total = 0;
+	while (total < size)
+	{
+		// Reads on a synchronous handle take their position from the OVERLAPPED
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(offset + total);
+		overlapped.OffsetHigh = static_cast<DWORD>((offset + total) >> 32);
+		DWORD chunk = static_cast<DWORD>(std::min<size_t>(size - total, 1 << 30));
+		DWORD got = 0;
+		if (!ReadFile(file, buffer + total, chunk, &got, &overlapped) || got == 0)
+			break;
+		total += got;
+	}
+	return total;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path, Access access)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("could not open " + path);
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		throw std::runtime_error("could not read size of " + path);
+	}
+	length = static_cast<size_t>(st.st_size);
+
+	// Empty files can't be mapped, but there's nothing to read anyway
+	if (length == 0) {
+		::close(fd);
+		return;
+	}
+
+	void* p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps the file alive by itself
+	::close(fd);
+	if (p == MAP_FAILED)
+		throw std::runtime_error("could not map " + path);
+	begin = static_cast<const char*>(p);
+
+	// Read front to back, the kernel can read ahead aggressively. Otherwise
+	// it shouldn't read ahead or throw pages out early.
+	madvise(p, length, (access == ACCESS_SEQUENTIAL) ? MADV_SEQUENTIAL : MADV_RANDOM);
+}
+
+MappedFile::~MappedFile()
+{
+	if (begin)
+		munmap(const_cast<char*>(begin), length);
+}
+
+FileReader::FileReader(const std::string& path)
+{
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("could not open " + path);
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		throw std::runtime_error("could not read size of " + path);
+	}
+	length = static_cast<uint64_t>(st.st_size);
+}
+
+FileReader::~FileReader()
+{
+	::close(fd);
+}
+
+bool getFileInfo(const std::string& path, uint64_t& size, int64_t& mtime)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return false;
+	size = static_cast<uint64_t>(st.st_size);
+	mtime = static_cast<int64_t>(st.st_mtime);
+	return true;
+}
+
+size_t FileReader::read(uint64_t offset, char* buffer, size_t size)
+{
+	size_t total = 0;
+	while (total < size)
+	{
+		ssize_t got = pread(fd, buffer + total, size - total, static_cast<off_t>(offset + total));
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			break;
+		total += got;
+	}
+	return total;
+}
+
+#endif
+
+bool MappedFile::prefault(size_t offset, size_t size, const std::atomic<bool>* cancelled) const
+{
+	if (offset >= length)
+		return true;
+	size_t end = offset + std::min(size, length - offset);
+#if defined(_WIN32)
+	const size_t pageSize = 4096;
+#else
+	const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+	// A piece at a time, so a cancel doesn't wait long
+	const size_t pieceSize = 16 << 20;
+	const volatile char* bytes = begin;
+	char sum = 0;
+	for (size_t start = offset / pageSize * pageSize; start < end; start += pieceSize)
+	{
+		if (cancelled && cancelled->load(std::memory_order_relaxed))
+			return false;
+		size_t stop = std::min(start + pieceSize, end);
+#if !defined(_WIN32)
+		// Start it all being read, rather than a page at a time as it's touched
+		madvise(const_cast<char*>(begin) + start, stop - start, MADV_RANDOM);
+		madvise(const_cast<char*>(begin) + start, stop - start, MADV_WILLNEED);
+#endif
+		for (size_t i = std::max(start, offset); i < stop; i += pageSize)
+			sum += bytes[i];
+		sum += bytes[stop - 1];
+	}
+	(void) sum;
+	return true;
+}
+
+
+float parseFloatCell(const CsvCell& cell, char decimalPoint)
+{
+	// Same rules as std::stof: leading space and trailing junk are fine, but
+	// there has to be a number and it has to fit in a float
+	const char* end = cell.data + cell.size;
+	float value;
+	rapidcsv::FromCharsResult result = rapidcsv::FromCharsFloat(rapidcsv::SkipNumberPrefix(cell.data, end), end, value, decimalPoint);
+	if (result.ec != std::errc())
+		return NAN;
+	return value;
+}
+
+// Reads between minDigits and maxDigits digits
+static bool readDigits(const char*& p, const char* end, int minDigits, int maxDigits, int& value)
+{
+	value = 0;
+	int digits = 0;
+	while (p < end && digits < maxDigits && *p >= '0' && *p <= '9')
+	{
+		value = value * 10 + (*p++ - '0');
+		digits++;
+	}
+	return digits >= minDigits;
+}
+
+// Days from 1970-01-01 to a date in the proleptic Gregorian calendar
+static int64_t daysFromCivil(int64_t year, int month, int day)
+{
+	year -= month <= 2;
+	int64_t era = (year >= 0 ? year : year - 399) / 400;
+	int64_t yearOfEra = year - era * 400;
+	int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	return era * 146097 + dayOfEra - 719468;
+}
+
+// Reads HH:MM, with optional seconds and fractions of a second, into seconds
+static bool readTimeOfDay(const char*& p, const char* end, char decimalPoint, double& seconds)
+{
+	int hours, minutes;
+	if (!readDigits(p, end, 1, 2, hours) || p == end || *p != ':' || !readDigits(++p, end, 2, 2, minutes))
+		return false;
+	if (hours > 24 || minutes > 59)
+		return false;
+	seconds = hours * 3600.0 + minutes * 60.0;
+	if (p < end && *p == ':') {
+		int whole;
+		if (!readDigits(++p, end, 2, 2, whole) || whole > 60)
+			return false;
+		seconds += whole;
+		if (p < end && (*p == '.' || *p == decimalPoint)) {
+			double scale = 0.1;
+			for (p++; p < end && *p >= '0' && *p <= '9'; p++, scale *= 0.1)
+				seconds += (*p - '0') * scale;
+		}
+	}
+	return true;
+}
+
+double parseTimeCell(const CsvCell& cell, char decimalPoint)
+{
+	const char* p = cell.data;
+	const char* end = cell.data + cell.size;
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	const char* start = p;
+
+	// A date, maybe with a time after it
+	int year, month, day = 1;
+	if (readDigits(p, end, 4, 4, year) && p < end && (*p == '-' || *p == '/')) {
+		char separator = *p;
+		if (!readDigits(++p, end, 1, 2, month) || month < 1 || month > 12)
+			return NAN;
+		if (p < end && *p == separator && (!readDigits(++p, end, 1, 2, day) || day < 1 || day > 31))
+			return NAN;
+		double seconds = daysFromCivil(year, month, day) * 86400.0;
+
+		if (p < end && (*p == 'T' || *p == ' ')) {
+			double time;
+			const char* q = p + 1;
+			if (readTimeOfDay(q, end, decimalPoint, time)) {
+				seconds += time;
+				p = q;
+			}
+		}
+		// Times are UTC unless they say otherwise
+		if (p < end && (*p == '+' || *p == '-')) {
+			int sign = (*p == '+') ? 1 : -1;
+			int hours, minutes = 0;
+			const char* q = p + 1;
+			if (readDigits(q, end, 2, 2, hours)) {
+				if (q < end && *q == ':')
+					q++;
+				readDigits(q, end, 2, 2, minutes);
+				seconds -= sign * (hours * 3600.0 + minutes * 60.0);
+			}
+		}
+		return seconds;
+	}
+
+	// A time on its own
+	p = start;
+	double time;
+	if (readTimeOfDay(p, end, decimalPoint, time))
+		return time;
+
+	// Otherwise a number, with the same rules as parseFloatCell()
+	double value;
+	rapidcsv::FromCharsResult result = rapidcsv::FromCharsFloat(rapidcsv::SkipNumberPrefix(cell.data, end), end, value, decimalPoint);
+	if (result.ec != std::errc())
+		return NAN;
+	return value;
+}
+
+// Tells which decimal mark the numbers in a sample use, by counting cells
+// that are nothing but digits either side of a '.' or a ','
+struct DecimalCounter
+{
+	bool header = true;
+	size_t points = 0;
+	size_t commas = 0;
+
+	void row(const CsvCell* cells, size_t count)
+	{
+		if (header) {
+			header = false;
+			return;
+		}
+		for (size_t c = 0; c < count; c++)
+		{
+			char mark = decimalMark(cells[c]);
+			if (mark == '.')
+				points++;
+			else if (mark == ',')
+				commas++;
+		}
+	}
+
+	// The mark in a cell like " -12,5e3 ", or 0 if it isn't like that
+	static char decimalMark(const CsvCell& cell)
+	{
+		const char* p = cell.data;
+		const char* end = cell.data + cell.size;
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		if (p < end && (*p == '-' || *p == '+'))
+			p++;
+		if (!skipDigits(p, end) || p == end || (*p != '.' && *p != ','))
+			return 0;
+		char mark = *p++;
+		if (!skipDigits(p, end))
+			return 0;
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			p++;
+			if (p < end && (*p == '-' || *p == '+'))
+				p++;
+			if (!skipDigits(p, end))
+				return 0;
+		}
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		return (p == end) ? mark : 0;
+	}
+
+	static bool skipDigits(const char*& p, const char* end)
+	{
+		const char* start = p;
+		while (p < end && *p >= '0' && *p <= '9')
+			p++;
+		return p > start;
+	}
+};
+
+CsvOptions sniffCsvOptions(const char* text, size_t size)
+{
+	CsvOptions options;
+
+	// Spreadsheets in decimal-comma locales export with semicolons, so a
+	// header with semicolons but no commas is most likely one of those. Not
+	// always though, so the rows get a look too: a number like 1.5 in them
+	// means points after all, or it would quietly load as 1.
+	const char* lineEnd = static_cast<const char*>(std::memchr(text, '\n', size));
+	size_t lineLength = lineEnd ? lineEnd - text : size;
+	if (!std::memchr(text, ',', lineLength) && std::memchr(text, ';', lineLength)) {
+		options.separator = ';';
+		CsvParser parser(options);
+		DecimalCounter counter;
+		parser.parse(text, size, false, counter);
+		options.decimalPoint = (counter.points > 0) ? '.' : ',';
+	}
+	return options;
+}
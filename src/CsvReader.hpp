@@ -0,0 +1,348 @@
+#pragma once
+#include <atomic>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include "CsvScan.hpp"
+
+// A whole file mapped read-only into memory. Throws std::runtime_error if the
+// file can't be opened.
+//
+// A sequential file is read once from front to back, so the system reads
+// ahead and can drop pages once they've been read. Anything played from the
+// map, where the audio thread mustn't wait on the disk, should be random
+// access and prefaulted first.
+struct MappedFile
+{
+	enum Access
+	{
+		ACCESS_SEQUENTIAL,
+		ACCESS_RANDOM,
+	};
+
+	explicit MappedFile(const std::string& path, Access access = ACCESS_SEQUENTIAL);
+	~MappedFile();
+
+	// Reads size bytes from offset into memory and marks them as wanted again
+	// in any order, even in a sequential file. Takes as long as reading them
+	// from the disk. Returns false if cancelled gets set first.
+	bool prefault(size_t offset, size_t size, const std::atomic<bool>* cancelled = NULL) const;
+
+	const char* data() const
+	{
+		return begin;
+	}
+
+	size_t size() const
+	{
+		return length;
+	}
+
+private:
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* begin = NULL;
+	size_t length = 0;
+#if defined(_WIN32)
+	void* file = NULL;
+	void* mapping = NULL;
+#endif
+};
+
+// A file read a piece at a time through a buffer of the caller's, for files
+// too big to keep in memory. Throws std::runtime_error if the file can't be
+// opened.
+struct FileReader
+{
+	explicit FileReader(const std::string& path);
+	~FileReader();
+
+	uint64_t size() const
+	{
+		return length;
+	}
+
+	// Reads up to `size` bytes starting at `offset`. Returns how many were
+	// read, which is only short at the end of the file.
+	size_t read(uint64_t offset, char* buffer, size_t size);
+
+private:
+	FileReader(const FileReader&) = delete;
+	FileReader& operator=(const FileReader&) = delete;
+
+	uint64_t length = 0;
+#if defined(_WIN32)
+	void* file = NULL;
+#else
+	int fd = -1;
+#endif
+};
+
+#if defined(_WIN32)
+// Rack paths are UTF-8, Windows wants UTF-16. Files are always opened
+// through this, so paths with any characters in them work.
+std::wstring widen(const std::string& path);
+#endif
+
+// Size and modification time (seconds since the epoch) of a file. Returns
+// false if it doesn't exist.
+bool getFileInfo(const std::string& path, uint64_t& size, int64_t& mtime);
+
+// How cells and lines are split up, and how numbers are written. The defaults
+// and the behaviour match rapidcsv's SeparatorParams and LineReaderParams, so
+// files parse exactly as they did when everything went through rapidcsv::Document.
+struct CsvOptions
+{
+	char separator = ',';
+	bool trim = false;
+	bool quotedLinebreaks = false;
+	bool autoQuote = true;
+	bool skipCommentLines = false;
+	char commentPrefix = '#';
+	bool skipEmptyLines = false;
+	char decimalPoint = '.';
+};
+
+// Guess the separator and decimal point from the start of a file
+CsvOptions sniffCsvOptions(const char* text, size_t size);
+
+// A single cell. Most cells point straight into the input, the few that need
+// unquoting or had carriage returns inside them point into parser scratch
+// space. Either way they're only valid until the row callback returns.
+struct CsvCell
+{
+	const char* data;
+	size_t size;
+
+	std::string str() const
+	{
+		return std::string(data, size);
+	}
+};
+
+// Splits CSV text into rows of cells without copying it. Produces exactly the
+// same cells as rapidcsv::Document with the same options.
+//
+// parse() calls sink.row(const CsvCell* cells, size_t count) for each row,
+// header included. Input can be fed in pieces: unless `final` is set, parsing
+// stops after the last complete row and the number of bytes used is returned,
+// so the caller can feed the rest again along with the next piece.
+struct CsvParser
+{
+	explicit CsvParser(const CsvOptions& options = CsvOptions())
+		: options(options)
+	{
+	}
+
+	template <typename Sink>
+	size_t parse(const char* data, size_t size, bool final, Sink& sink)
+	{
+		const char* end = data + size;
+		const char* rowStart = data;
+		const char* next = data; // first byte not looked at yet
+		beginRow();
+		beginCell(data);
+
+		// Only quotes, separators and line endings change the state, so find
+		// those a block at a time and jump straight from one to the next.
+		// Anything skipped in between is ordinary cell content.
+		const size_t blockSize = 64 * 64;
+		uint64_t masks[64];
+		for (size_t block = 0; block < size; block += blockSize)
+		{
+			const char* base = data + block;
+			size_t length = (size - block < blockSize) ? size - block : blockSize;
+			scanStructural(base, length, options.separator, masks);
+
+			for (size_t m = 0; m < (length + 63) / 64; m++)
+			{
+				for (uint64_t bits = masks[m]; bits; bits &= bits - 1)
+				{
+					const char* p = base + 64 * m + __builtin_ctzll(bits);
+					if (p > next)
+						cellEmpty = false;
+					next = p + 1;
+
+					char c = *p;
+					if (c == '"') {
+						// Quotes only count at the start of a cell, or inside a quoted one
+						if (cellEmpty) {
+							cellQuoted = true;
+							cellEmpty = false;
+							quoted = !quoted;
+						} else if (cellQuoted) {
+							quoted = !quoted;
+						}
+					} else if (c == options.separator) {
+						if (!quoted) {
+							endCell(p);
+							beginCell(p + 1);
+						} else {
+							cellEmpty = false;
+						}
+					} else if (c == '\r') {
+						if (options.quotedLinebreaks && quoted) {
+							cellEmpty = false;
+						} else {
+							// Carriage returns outside quotes are dropped
+							if (!droppedCRs)
+								firstCR = p;
+							droppedCRs++;
+						}
+					} else {
+						if (options.quotedLinebreaks && quoted) {
+							cellEmpty = false;
+						} else {
+							if (!(options.skipEmptyLines && cells.empty() && cellEmpty)) {
+								endCell(p);
+								if (!isComment())
+									sink.row(cells.data(), cells.size());
+							}
+							beginRow();
+							beginCell(p + 1);
+							rowStart = p + 1;
+						}
+					}
+				}
+			}
+		}
+		if (end > next)
+			cellEmpty = false;
+
+		if (!final)
+			return rowStart - data;
+
+		// Handle last line without linebreak
+		if (!cellEmpty || !cells.empty()) {
+			endCell(end);
+			sink.row(cells.data(), cells.size());
+		}
+		return size;
+	}
+
+private:
+	void beginRow()
+	{
+		cells.clear();
+		scratchUsed = 0;
+		quoted = false;
+	}
+
+	void beginCell(const char* p)
+	{
+		cellStart = p;
+		cellEmpty = true;
+		cellQuoted = false;
+		droppedCRs = 0;
+	}
+
+	bool isComment() const
+	{
+		return options.skipCommentLines && cells[0].size > 0 && cells[0].data[0] == options.commentPrefix;
+	}
+
+	void endCell(const char* p)
+	{
+		const char* b = cellStart;
+		const char* e = p;
+		if (droppedCRs) {
+			if (e - firstCR == static_cast<ptrdiff_t>(droppedCRs)) {
+				// Just a line ending, trim it off
+				e = firstCR;
+			} else {
+				std::string& s = rebuildCell(b, e);
+				b = s.data();
+				e = b + s.size();
+			}
+		}
+
+		if (options.trim) {
+			while (b < e && std::isspace(static_cast<unsigned char>(*b)))
+				b++;
+			while (e > b && std::isspace(static_cast<unsigned char>(e[-1])))
+				e--;
+		}
+
+		if (options.autoQuote && e - b >= 2 && *b == '"' && e[-1] == '"') {
+			b++;
+			e--;
+			// Unescape doubled quotes, which means copying
+			if (std::memchr(b, '"', e - b)) {
+				std::string& s = scratch();
+				for (const char* x = b; x < e; x++)
+				{
+					s += *x;
+					if (*x == '"' && x + 1 < e && x[1] == '"')
+						x++;
+				}
+				b = s.data();
+				e = b + s.size();
+			}
+		}
+
+		CsvCell cell = {b, static_cast<size_t>(e - b)};
+		cells.push_back(cell);
+	}
+
+	// Copy a cell without the carriage returns that were dropped from it
+	std::string& rebuildCell(const char* b, const char* e)
+	{
+		std::string& s = scratch();
+		bool q = false;
+		bool empty = true;
+		bool startsQuoted = false;
+		for (const char* x = b; x < e; x++)
+		{
+			if (*x == '"') {
+				if (empty)
+					startsQuoted = true;
+				if (empty || startsQuoted)
+					q = !q;
+			} else if (*x == '\r' && !(options.quotedLinebreaks && q)) {
+				continue;
+			}
+			s += *x;
+			empty = false;
+		}
+		return s;
+	}
+
+	// Scratch strings are recycled from row to row. A deque never moves its
+	// elements, so cells pointing into earlier ones stay valid.
+	std::string& scratch()
+	{
+		if (scratchUsed == scratchSpace.size())
+			scratchSpace.push_back(std::string());
+		std::string& s = scratchSpace[scratchUsed++];
+		s.clear();
+		return s;
+	}
+
+	CsvOptions options;
+	std::vector<CsvCell> cells;
+	std::deque<std::string> scratchSpace;
+	size_t scratchUsed = 0;
+
+	const char* cellStart = NULL;
+	const char* firstCR = NULL;
+	size_t droppedCRs = 0;
+	bool cellEmpty = true;
+	bool cellQuoted = false;
+	bool quoted = false;
+};
+
+// Converts a cell the same way std::stof does, but without exceptions or
+// allocations. Returns NaN if it isn't a number.
+float parseFloatCell(const CsvCell& cell, char decimalPoint = '.');
+
+// Converts a date, time or number cell into a point in time. Dates like
+// 2024-03-01 or 2024/03, optionally followed by a time and a time zone, come
+// out as seconds since 1970. A time on its own, like 14:30:05.25, is seconds
+// since midnight. Anything else is read as a plain number, in whatever units
+// it's in. Returns NaN if it's none of these.
+double parseTimeCell(const CsvCell& cell, char decimalPoint = '.');
@@ -0,0 +1,157 @@
+#include "CsvScan.hpp"
+#include <atomic>
+#include <cstring>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+static void scanScalar(const char* data, size_t size, char separator, uint64_t* masks)
+{
+	bool structural[256] = {};
+	structural[static_cast<unsigned char>('"')] = true;
+	structural[static_cast<unsigned char>('\r')] = true;
+	structural[static_cast<unsigned char>('\n')] = true;
+	structural[static_cast<unsigned char>(separator)] = true;
+
+	for (size_t block = 0; block < size; block += 64)
+	{
+		size_t n = (size - block < 64) ? size - block : 64;
+		uint64_t mask = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			if (structural[static_cast<unsigned char>(data[block + i])])
+				mask |= uint64_t(1) << i;
+		}
+		*masks++ = mask;
+	}
+}
+
+#if defined(__SSE2__)
+
+static inline uint64_t scanBlockSse2(const char* p, __m128i quote, __m128i sep, __m128i cr, __m128i lf)
+{
+	uint64_t mask = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+		__m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, sep)),
+									_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+		mask |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(hits))) << (16 * i);
+	}
+	return mask;
+}
+
+static void scanSse2(const char* data, size_t size, char separator, uint64_t* masks)
+{
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i sep = _mm_set1_epi8(separator);
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+
+	size_t block = 0;
+	for (; block + 64 <= size; block += 64)
+		*masks++ = scanBlockSse2(data + block, quote, sep, cr, lf);
+
+	// Pad the last partial block with zeros, which never match
+	if (block < size) {
+		char tail[64] = {};
+		std::memcpy(tail, data + block, size - block);
+		*masks = scanBlockSse2(tail, quote, sep, cr, lf);
+	}
+}
+
+#if defined(__GNUC__)
+#define CSV_SCAN_HAS_AVX2
+
+__attribute__((target("avx2")))
+static inline uint64_t scanBlockAvx2(const char* p, __m256i quote, __m256i sep, __m256i cr, __m256i lf)
+{
+	__m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+	__m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+	__m256i hitsLo = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(lo, quote), _mm256_cmpeq_epi8(lo, sep)),
+									_mm256_or_si256(_mm256_cmpeq_epi8(lo, cr), _mm256_cmpeq_epi8(lo, lf)));
+	__m256i hitsHi = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(hi, quote), _mm256_cmpeq_epi8(hi, sep)),
+									_mm256_or_si256(_mm256_cmpeq_epi8(hi, cr), _mm256_cmpeq_epi8(hi, lf)));
+	return uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(hitsLo)))
+		| (uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(hitsHi))) << 32);
+}
+
+__attribute__((target("avx2")))
+static void scanAvx2(const char* data, size_t size, char separator, uint64_t* masks)
+{
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i sep = _mm256_set1_epi8(separator);
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i lf = _mm256_set1_epi8('\n');
+
+	size_t block = 0;
+	for (; block + 64 <= size; block += 64)
+		*masks++ = scanBlockAvx2(data + block, quote, sep, cr, lf);
+
+	if (block < size) {
+		char tail[64] = {};
+		std::memcpy(tail, data + block, size - block);
+		*masks = scanBlockAvx2(tail, quote, sep, cr, lf);
+	}
+}
+#endif
+
+#endif
+
+
+typedef void (*ScanFunction)(const char* data, size_t size, char separator, uint64_t* masks);
+
+static ScanFunction scanFunctionFor(CsvScanLevel level)
+{
+	switch (level)
+	{
+#if defined(CSV_SCAN_HAS_AVX2)
+		case CSV_SCAN_AVX2: return scanAvx2;
+#endif
+#if defined(__SSE2__)
+		case CSV_SCAN_SSE2: return scanSse2;
+#endif
+		default: return scanScalar;
+	}
+}
+
+CsvScanLevel getBestCsvScanLevel()
+{
+#if defined(CSV_SCAN_HAS_AVX2)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return CSV_SCAN_AVX2;
+#endif
+#if defined(__SSE2__)
+	return CSV_SCAN_SSE2;
+#else
+	return CSV_SCAN_SCALAR;
+#endif
+}
+
+static std::atomic<ScanFunction> scanFunction{scanFunctionFor(getBestCsvScanLevel())};
+
+void scanStructural(const char* data, size_t size, char separator, uint64_t* masks)
+{
+	scanFunction.load(std::memory_order_relaxed)(data, size, separator, masks);
+}
+
+CsvScanLevel setCsvScanLevel(CsvScanLevel level)
+{
+	CsvScanLevel best = getBestCsvScanLevel();
+	if (level > best)
+		level = best;
+	scanFunction.store(scanFunctionFor(level));
+	return level;
+}
+
+const char* getCsvScanLevelName(CsvScanLevel level)
+{
+	switch (level)
+	{
+		case CSV_SCAN_AVX2: return "avx2";
+		case CSV_SCAN_SSE2: return "sse2";
+		default: return "scalar";
+	}
+}
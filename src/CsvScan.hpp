@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Finds the bytes a CSV tokenizer has to look at: quotes, the separator, CR
+// and LF. Everything else can be skipped over in bulk.
+//
+// Fills one 64-bit mask per 64 bytes of input, bit i set if byte i is one of
+// those. Bits past the end of the input are clear. The work is done with
+// AVX2 or SSE2 when the CPU has them and plain C++ otherwise, picked once at
+// runtime.
+void scanStructural(const char* data, size_t size, char separator, uint64_t* masks);
+
+enum CsvScanLevel
+{
+	CSV_SCAN_SCALAR,
+	CSV_SCAN_SSE2,
+	CSV_SCAN_AVX2,
+};
+
+// The best level this CPU supports
+CsvScanLevel getBestCsvScanLevel();
+
+// Use a particular level, for testing and benchmarks. It's capped to what the
+// CPU supports, and the level actually used is returned.
+CsvScanLevel setCsvScanLevel(CsvScanLevel level);
+
+const char* getCsvScanLevelName(CsvScanLevel level);
@@ -0,0 +1,395 @@
+#include "CsvStream.hpp"
+#include "Transcode.hpp"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+
+// Overviews and the index stop growing at about this size
+static const size_t overviewBuckets = 1024;
+static const size_t indexEntries = 4096;
+
+// Builds up the first level of a column's overview, doubling the rows per
+// bucket whenever it gets full
+struct OverviewBuilder
+{
+	ColumnOverview& overview;
+	float bucketMin = INFINITY;
+	float bucketMax = -INFINITY;
+	int bucketCount = 0;
+
+	explicit OverviewBuilder(ColumnOverview& overview)
+		: overview(overview)
+	{
+		overview.levels.resize(1);
+		overview.levels[0].mins = std::make_shared<std::vector<float>>();
+		overview.levels[0].maxs = std::make_shared<std::vector<float>>();
+	}
+
+	void add(float value)
+	{
+		if (!std::isnan(value)) {
+			bucketMin = std::min(bucketMin, value);
+			bucketMax = std::max(bucketMax, value);
+		}
+		if (++bucketCount == overview.bucketRows)
+			flush();
+	}
+
+	void flush()
+	{
+		if (bucketCount == 0)
+			return;
+		std::vector<float>& mins = *overview.levels[0].mins;
+		std::vector<float>& maxs = *overview.levels[0].maxs;
+		bool empty = bucketMin > bucketMax;
+		mins.push_back(empty ? NAN : bucketMin);
+		maxs.push_back(empty ? NAN : bucketMax);
+		bucketMin = INFINITY;
+		bucketMax = -INFINITY;
+		bucketCount = 0;
+
+		if (mins.size() == overviewBuckets) {
+			// Merge pairs of buckets, fmin and fmax skip the empty ones
+			for (size_t i = 0; i < overviewBuckets / 2; i++)
+			{
+				mins[i] = std::fmin(mins[2 * i], mins[2 * i + 1]);
+				maxs[i] = std::fmax(maxs[2 * i], maxs[2 * i + 1]);
+			}
+			mins.resize(overviewBuckets / 2);
+			maxs.resize(overviewBuckets / 2);
+			overview.bucketRows *= 2;
+		}
+	}
+
+	// Flushes the last bucket and adds the coarser levels
+	void finish()
+	{
+		flush();
+		overview.addLevels();
+	}
+};
+
+// Takes the header, then the stats and overview of every column, without
+// keeping any rows
+struct IndexBuilder
+{
+	Dataset& dataset;
+	char decimalPoint;
+	int64_t rows = 0; // header included
+	std::vector<OverviewBuilder> overviews;
+	std::vector<StatsAccumulator> stats;
+	// Numbers wait here to be added to the stats a batch at a time
+	std::vector<std::vector<float>> pending;
+	static const size_t batchSize = 4096;
+
+	IndexBuilder(Dataset& dataset, char decimalPoint)
+		: dataset(dataset)
+		, decimalPoint(decimalPoint)
+	{
+	}
+
+	void row(const CsvCell* cells, size_t count)
+	{
+		if (rows++ == 0) {
+			for (size_t c = 0; c < count; c++)
+				dataset.columns.push_back(cells[c].str());
+			dataset.data.resize(count);
+			for (DataColumn& column : dataset.data)
+				overviews.push_back(OverviewBuilder(column.overview));
+			stats.resize(count);
+			pending.resize(count);
+			return;
+		}
+
+		// Short rows are padded out with NaN, extra cells are ignored
+		size_t numcolumns = dataset.data.size();
+		for (size_t c = 0; c < numcolumns; c++)
+		{
+			float value = (c < count) ? parseFloatCell(cells[c], decimalPoint) : NAN;
+			overviews[c].add(value);
+			pending[c].push_back(value);
+			if (pending[c].size() == batchSize) {
+				stats[c].add(pending[c].data(), batchSize);
+				pending[c].clear();
+			}
+		}
+	}
+
+	void finish()
+	{
+		for (size_t c = 0; c < dataset.data.size(); c++)
+		{
+			overviews[c].finish();
+			stats[c].add(pending[c].data(), pending[c].size());
+			dataset.data[c].stats = stats[c].finish();
+		}
+	}
+};
+
+// Copies the cells of one column from a range of rows
+struct BlockBuilder
+{
+	int column;
+	char decimalPoint;
+	int64_t next; // the row to arrive next, counting the header as row 0
+	int64_t first;
+	int64_t last;
+	float* values;
+
+	void row(const CsvCell* cells, size_t count)
+	{
+		if (next >= first && next < last)
+			values[next - first] = (static_cast<size_t>(column) < count) ? parseFloatCell(cells[column], decimalPoint) : NAN;
+		next++;
+	}
+};
+
+std::shared_ptr<Dataset> openCsvStream(const std::string& path, LoadProgress& progress)
+{
+	progress.set(0.f);
+
+	std::shared_ptr<Dataset> dataset = std::make_shared<Dataset>();
+	dataset->path = path;
+
+	FileReader file(path);
+	uint64_t size = file.size();
+	std::vector<char> buffer(4 << 20);
+	size_t filled = file.read(0, buffer.data(), buffer.size());
+
+	// Windows-1252 is close enough to UTF-8 to index as it is, only the
+	// column names need converting
+	size_t bomLength;
+	TextEncoding encoding = detectEncoding(buffer.data(), filled, bomLength);
+	if (encoding == ENCODING_UTF16LE || encoding == ENCODING_UTF16BE)
+		throw std::runtime_error("UTF-16 files can't be streamed");
+
+	uint64_t offset = bomLength; // of the start of the buffer
+	std::memmove(buffer.data(), buffer.data() + bomLength, filled - bomLength);
+	filled -= bomLength;
+
+	CsvOptions options = sniffCsvOptions(buffer.data(), filled);
+	CsvParser parser(options);
+	IndexBuilder builder(*dataset, options.decimalPoint);
+
+	// Parse a slice at a time, noting where the rows are at the start of each
+	// one. Once the index is full every other entry is dropped and they're
+	// taken half as often from then on.
+	std::vector<CsvStream::IndexEntry> index;
+	index.push_back(CsvStream::IndexEntry{0, offset});
+	uint64_t indexSpacing = 64 << 10;
+
+	while (true)
+	{
+		bool eof = (offset + filled >= size);
+		size_t pos = 0;
+		size_t slice = 64 << 10;
+		while (pos < filled)
+		{
+			size_t length = std::min(slice, filled - pos);
+			bool final = eof && pos + length == filled;
+
+			const CsvStream::IndexEntry& last = index.back();
+			if (offset + pos >= last.offset + indexSpacing) {
+				index.push_back(CsvStream::IndexEntry{builder.rows, offset + pos});
+				if (index.size() == indexEntries) {
+					for (size_t i = 0; i < indexEntries / 2; i++)
+						index[i] = index[2 * i];
+					index.resize(indexEntries / 2);
+					indexSpacing *= 2;
+				}
+			}
+
+			size_t used = parser.parse(buffer.data() + pos, length, final, builder);
+			if (used == 0 && !final) {
+				// No whole row in this slice, try a bigger one or read some more
+				if (pos + length == filled)
+					break;
+				slice *= 2;
+				continue;
+			}
+			pos += used;
+			slice = 64 << 10;
+		}
+		if (eof)
+			break;
+
+		// Keep the unfinished row and read in more after it, making room if
+		// a single row fills the whole buffer
+		std::memmove(buffer.data(), buffer.data() + pos, filled - pos);
+		offset += pos;
+		filled -= pos;
+		if (filled == buffer.size())
+			buffer.resize(buffer.size() * 2);
+		filled += file.read(offset + filled, buffer.data() + filled, buffer.size() - filled);
+
+		progress.set(0.99f * offset / size);
+		progress.check();
+	}
+
+	if (dataset->columns.empty())
+		throw std::runtime_error("no header row");
+	if (builder.rows - 1 > INT_MAX)
+		throw std::runtime_error("too many rows");
+
+	dataset->datalength = static_cast<int>(builder.rows - 1);
+	if (encoding == ENCODING_WINDOWS1252) {
+		for (std::string& name : dataset->columns)
+		{
+			std::string utf8;
+			transcodeToUtf8(encoding, name.data(), name.size(), true, utf8);
+			name = utf8;
+		}
+	}
+	builder.finish();
+
+	dataset->stream = std::make_shared<CsvStream>(path, options, index, dataset->datalength);
+	progress.set(1.f);
+	return dataset;
+}
+
+
+CsvStream::CsvStream(const std::string& path, const CsvOptions& options, std::vector<IndexEntry> index, int rows)
+	: file(path)
+	, options(options)
+	, index(index)
+	, rows(rows)
+	, slots(new Slot[numSlots + 1])
+	, cursor(index[0])
+	, buffer(256 << 10)
+	, blockValues(blockRows)
+{
+	for (int i = 0; i <= numSlots; i++)
+		slots[i].values.reset(new std::atomic<float>[blockRows]);
+	reader = std::thread(&CsvStream::run, this);
+}
+
+CsvStream::~CsvStream()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_one();
+	reader.join();
+}
+
+bool CsvStream::read(int column, int row, float& value) const
+{
+	if (row < 0 || row >= rows)
+		return false;
+
+	int64_t block = row / blockRows;
+	int64_t key = makeKey(column, block);
+	const Slot& slot = slotFor(block);
+	if (slot.key.load(std::memory_order_acquire) != key)
+		return false;
+	float v = slot.values[row % blockRows].load(std::memory_order_relaxed);
+
+	// If the reader started replacing the block meanwhile, v may be from the new one
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (slot.key.load(std::memory_order_relaxed) != key)
+		return false;
+	value = v;
+	return true;
+}
+
+// The most urgent block that isn't read in yet, or -1. That's the first one,
+// then the one playing, then those coming up, then those just played.
+int64_t CsvStream::nextBlock(int column, int row) const
+{
+	int64_t numBlocks = (rows + blockRows - 1) / blockRows;
+	int64_t playing = std::max(row, 0) / blockRows;
+
+	int64_t wanted[numSlots + 1];
+	int count = 0;
+	wanted[count++] = 0;
+	for (int i = 0; i <= blocksAhead; i++)
+		wanted[count++] = playing + i;
+	for (int i = 1; i <= blocksBehind; i++)
+		wanted[count++] = playing - i;
+
+	for (int i = 0; i < count; i++)
+	{
+		int64_t b = wanted[i];
+		if (b < 0 || b >= numBlocks)
+			continue;
+		if (slotFor(b).key.load(std::memory_order_relaxed) != makeKey(column, b))
+			return b;
+	}
+	return -1;
+}
+
+void CsvStream::fill(int column, int64_t b)
+{
+	// Rows counted with the header as row 0
+	int64_t first = b * blockRows + 1;
+	int64_t last = std::min<int64_t>(first + blockRows, rows + 1);
+
+	// Start from the closest known row before the block
+	IndexEntry start = *(std::upper_bound(index.begin(), index.end(), first,
+		[](int64_t r, const IndexEntry& e) { return r < e.row; }) - 1);
+	if (cursor.row <= first && cursor.row > start.row)
+		start = cursor;
+
+	CsvParser parser(options);
+	BlockBuilder builder = {column, options.decimalPoint, start.row, first, last, blockValues.data()};
+	std::fill(blockValues.begin(), blockValues.end(), NAN);
+
+	uint64_t offset = start.offset;
+	size_t filled = 0;
+	while (builder.next < last)
+	{
+		filled += file.read(offset + filled, buffer.data() + filled, buffer.size() - filled);
+		bool eof = (offset + filled >= file.size());
+		size_t used = parser.parse(buffer.data(), filled, eof, builder);
+
+		// Remember where we got to, the next block probably carries on from here
+		if (builder.next <= last) {
+			cursor.row = builder.next;
+			cursor.offset = offset + used;
+		}
+		if (eof)
+			break;
+
+		std::memmove(buffer.data(), buffer.data() + used, filled - used);
+		offset += used;
+		filled -= used;
+		if (filled == buffer.size())
+			buffer.resize(buffer.size() * 2);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (quit)
+			return;
+	}
+
+	// Readers check the key either side of reading, so they either see the
+	// old block, the new one, or a miss
+	Slot& slot = slotFor(b);
+	slot.key.store(-1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (int i = 0; i < blockRows; i++)
+		slot.values[i].store(blockValues[i], std::memory_order_relaxed);
+	slot.key.store(makeKey(column, b), std::memory_order_release);
+}
+
+void CsvStream::run()
+{
+	while (true)
+	{
+		int column = playColumn.load(std::memory_order_relaxed);
+		int64_t b = nextBlock(column, playRow.load(std::memory_order_relaxed));
+		if (b >= 0)
+			fill(column, b);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		if (quit)
+			break;
+		// Nothing to do, check on the playhead again shortly
+		if (b < 0)
+			wake.wait_for(lock, std::chrono::milliseconds(2), [this] { return quit; });
+	}
+}
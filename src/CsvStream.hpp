@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CsvLoader.hpp"
+#include "CsvReader.hpp"
+#include "Dataset.hpp"
+
+// Index a CSV file without keeping its rows, for files too big to load. The
+// dataset has every column's name, range and overview, and a stream that reads
+// rows in around the playhead. Throws on bad files.
+std::shared_ptr<Dataset> openCsvStream(const std::string& path, LoadProgress& progress);
+
+// Plays a CSV file straight from disk.
+//
+// A sparse index of row offsets is built once up front. After that a
+// background thread keeps a window of blocks of rows read in around wherever
+// the audio thread says it is playing, plus the first block so a reset is
+// always instant. Memory use is the same however long the file is: the index
+// and overviews are thinned out as they grow, and the window is a fixed size.
+//
+// The audio thread never waits. A row that hasn't been read in yet is just
+// reported as missing.
+struct CsvStream
+{
+	// Rows are read in and evicted a block at a time
+	static const int blockRows = 4096;
+	// How many blocks the window holds ahead of and behind the playhead
+	static const int blocksAhead = 47;
+	static const int blocksBehind = 16;
+
+	// Where parsing can start again: the row that starts at offset, counting
+	// the header as row 0
+	struct IndexEntry
+	{
+		int64_t row;
+		uint64_t offset;
+	};
+
+	CsvStream(const std::string& path, const CsvOptions& options, std::vector<IndexEntry> index, int rows);
+	~CsvStream();
+
+	// Audio thread. Tells the reader what is playing, it is never blocked.
+	void setPlayhead(int column, int row)
+	{
+		playColumn.store(column, std::memory_order_relaxed);
+		playRow.store(row, std::memory_order_relaxed);
+	}
+
+	// Any thread. Returns false if the row isn't in memory.
+	bool read(int column, int row, float& value) const;
+
+private:
+	CsvStream(const CsvStream&) = delete;
+	CsvStream& operator=(const CsvStream&) = delete;
+
+	// A block of one column. The key says which, or is -1 while the block is
+	// being replaced, and readers check it both sides of reading a value.
+	struct Slot
+	{
+		std::atomic<int64_t> key{-1};
+		std::unique_ptr<std::atomic<float>[]> values;
+	};
+
+	static int64_t makeKey(int column, int64_t block)
+	{
+		return (static_cast<int64_t>(column) << 40) | block;
+	}
+
+	// The first block has a slot of its own, the rest share a ring
+	Slot& slotFor(int64_t block) const
+	{
+		return slots[block == 0 ? numSlots : block % numSlots];
+	}
+
+	int64_t nextBlock(int column, int row) const;
+	void fill(int column, int64_t block);
+	void run();
+
+	static const int numSlots = blocksAhead + blocksBehind + 1;
+
+	FileReader file;
+	CsvOptions options;
+	std::vector<IndexEntry> index;
+	int rows;
+
+	std::unique_ptr<Slot[]> slots;
+
+	// Reader thread only: where the last fill stopped, to carry on from
+	IndexEntry cursor;
+	std::vector<char> buffer;
+	std::vector<float> blockValues;
+
+	std::atomic<int> playColumn{0};
+	std::atomic<int> playRow{0};
+
+	std::thread reader;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool quit = false;
+};
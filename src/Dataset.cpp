@@ -0,0 +1,369 @@
+#include "Dataset.hpp"
+#include "CsvStream.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cmath>
+
+
+bool Dataset::getStreamedValue(int colnum, int row, float& value) const
+{
+	return stream->read(colnum, row, value);
+}
+
+std::vector<float> makeTimeDeltas(const std::vector<double>& times)
+{
+	size_t n = times.size();
+	std::vector<float> deltas(n, 1.f);
+
+	// Rows before the first time play at the first time
+	size_t first = 0;
+	while (first < n && std::isnan(times[first]))
+		first++;
+	if (first == n)
+		return deltas;
+
+	std::vector<double> forward(n);
+	double latest = times[first];
+	for (size_t i = 0; i < n; i++)
+	{
+		if (times[i] > latest)
+			latest = times[i];
+		forward[i] = latest;
+	}
+
+	double span = forward[n - 1] - forward[0];
+	if (n < 2 || !(span > 0.0) || std::isinf(span))
+		return deltas;
+	double scale = (n - 1) / span;
+	for (size_t i = 0; i + 1 < n; i++)
+		deltas[i] = static_cast<float>((forward[i + 1] - forward[i]) * scale);
+	return deltas;
+}
+
+DatasetHandoff::~DatasetHandoff()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	owned.clear();
+}
+
+void DatasetHandoff::publish(std::shared_ptr<Dataset> dataset)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	dataset->generation = nextGeneration++;
+	owned.push_back(dataset);
+
+	// If nothing is playing yet there's no audio thread to wait for
+	Dataset* expected = NULL;
+	if (active.compare_exchange_strong(expected, dataset.get(), std::memory_order_release))
+		return;
+
+	// One still waiting can never be taken now, so it can go
+	Dataset* replaced = pending.exchange(dataset.get(), std::memory_order_acq_rel);
+	if (replaced)
+		skipped.push_back(replaced);
+}
+
+void DatasetHandoff::collect()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	const Dataset* playing = active.load(std::memory_order_acquire);
+	if (!playing)
+		return;
+
+	// The audio thread only ever moves forward to newer datasets, so anything
+	// older than the one it is playing can never be picked up again.
+	uint64_t oldest = playing->generation;
+	owned.erase(std::remove_if(owned.begin(), owned.end(),
+		[&](const std::shared_ptr<Dataset>& d) {
+			return d->generation < oldest || std::find(skipped.begin(), skipped.end(), d.get()) != skipped.end();
+		}),
+		owned.end());
+	skipped.clear();
+}
+
+const Dataset* DatasetHandoff::displayed()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (owned.empty())
+		return active.load(std::memory_order_acquire);
+	return owned.back().get();
+}
+
+std::shared_ptr<const Dataset> DatasetHandoff::latest()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (owned.empty())
+		return NULL;
+	return owned.back();
+}
+
+// Rows in the smallest runs of a loaded column's overview. Slices narrower
+// than this are drawn straight from the values, which is at most this many
+// rows a pixel.
+static const int overviewRows = 32;
+
+void ColumnOverview::addLevels()
+{
+	if (levels.empty())
+		return;
+	levels.resize(1);
+	while (levels.back().mins->size() > 1)
+	{
+		const std::vector<float>& mins = *levels.back().mins;
+		const std::vector<float>& maxs = *levels.back().maxs;
+		size_t n = mins.size();
+		Level level;
+		level.mins = std::make_shared<std::vector<float>>((n + 1) / 2);
+		level.maxs = std::make_shared<std::vector<float>>((n + 1) / 2);
+		for (size_t i = 0; i < n / 2; i++)
+		{
+			// fmin and fmax skip the empty runs
+			(*level.mins)[i] = std::fmin(mins[2 * i], mins[2 * i + 1]);
+			(*level.maxs)[i] = std::fmax(maxs[2 * i], maxs[2 * i + 1]);
+		}
+		if (n % 2) {
+			level.mins->back() = mins.back();
+			level.maxs->back() = maxs.back();
+		}
+		levels.push_back(level);
+	}
+	for (Level& level : levels)
+	{
+		level.size = level.mins->size();
+		if (level.size > 0) {
+			level.lastMin = level.mins->back();
+			level.lastMax = level.maxs->back();
+		}
+	}
+}
+
+// The lowest and highest number in rows first up to last, NaN if none are numbers
+static inline void findRange(const float* values, size_t first, size_t last, float& lowest, float& highest)
+{
+	// NaN fails both comparisons, so it's skipped
+	float low = INFINITY;
+	float high = -INFINITY;
+	for (size_t i = first; i < last; i++)
+	{
+		low = std::min(low, values[i]);
+		high = std::max(high, values[i]);
+	}
+	bool empty = low > high;
+	lowest = empty ? NAN : low;
+	highest = empty ? NAN : high;
+}
+
+// Makes room in a level's buffers for its whole runs, keeping the first keep
+// already there. Older overviews might be reading those, so when the buffers
+// are full or hold a run that isn't whole, the runs go to new buffers.
+static void reserveRuns(ColumnOverview::Level& level, size_t keep, size_t whole)
+{
+	if (level.mins && level.mins->size() == keep && level.mins->capacity() >= whole)
+		return;
+	std::shared_ptr<std::vector<float>> mins = std::make_shared<std::vector<float>>();
+	std::shared_ptr<std::vector<float>> maxs = std::make_shared<std::vector<float>>();
+	// A column that's grown once will probably grow again
+	size_t capacity = (keep == 0) ? whole : 2 * whole;
+	mins->reserve(capacity);
+	maxs->reserve(capacity);
+	if (keep > 0) {
+		mins->assign(level.mins->begin(), level.mins->begin() + keep);
+		maxs->assign(level.maxs->begin(), level.maxs->begin() + keep);
+	}
+	level.mins = mins;
+	level.maxs = maxs;
+}
+
+void extendOverview(ColumnOverview& overview, const float* values, size_t oldRows, size_t rows)
+{
+	overview.bucketRows = overviewRows;
+	size_t runRows = overviewRows;
+	size_t size = (rows + runRows - 1) / runRows;
+	for (size_t k = 0; size > 0; k++)
+	{
+		if (k == overview.levels.size())
+			overview.levels.emplace_back();
+		ColumnOverview::Level& level = overview.levels[k];
+		size_t first = oldRows / runRows;
+		size_t whole = rows / runRows;
+		reserveRuns(level, first, whole);
+		level.mins->resize(whole);
+		level.maxs->resize(whole);
+		float* mins = level.mins->data();
+		float* maxs = level.maxs->data();
+
+		if (k == 0) {
+			// Long columns are split up across the thread pool
+			const size_t chunkRuns = 1 << 14;
+			ThreadPool::shared().parallelFor((whole - first + chunkRuns - 1) / chunkRuns, [&](size_t chunk)
+			{
+				size_t end = std::min(whole, first + (chunk + 1) * chunkRuns);
+				for (size_t r = first + chunk * chunkRuns; r < end; r++)
+					findRange(values, r * overviewRows, (r + 1) * overviewRows, mins[r], maxs[r]);
+			});
+			if (size > whole) {
+				findRange(values, whole * overviewRows, rows, level.lastMin, level.lastMax);
+			} else {
+				level.lastMin = mins[whole - 1];
+				level.lastMax = maxs[whole - 1];
+			}
+		} else {
+			// Each run is the pair below it, fmin and fmax skip the empty ones
+			const ColumnOverview::Level& below = overview.levels[k - 1];
+			for (size_t r = first; r < whole; r++)
+			{
+				mins[r] = std::fmin((*below.mins)[2 * r], (*below.mins)[2 * r + 1]);
+				maxs[r] = std::fmax((*below.maxs)[2 * r], (*below.maxs)[2 * r + 1]);
+			}
+			size_t r = size - 1;
+			level.lastMin = below.getMin(2 * r);
+			level.lastMax = below.getMax(2 * r);
+			if (2 * r + 1 < below.size) {
+				level.lastMin = std::fmin(level.lastMin, below.getMin(2 * r + 1));
+				level.lastMax = std::fmax(level.lastMax, below.getMax(2 * r + 1));
+			}
+		}
+		level.size = size;
+
+		// The top level is a single run
+		if (size == 1)
+			break;
+		runRows *= 2;
+		size = (size + 1) / 2;
+	}
+}
+
+void makeOverviews(Dataset& dataset)
+{
+	if (dataset.stream)
+		return;
+	size_t rows = dataset.datalength;
+	for (DataColumn& column : dataset.data)
+	{
+		column.overview = ColumnOverview();
+		column.overview.bucketRows = overviewRows;
+		if (column.values)
+			extendOverview(column.overview, column.values, 0, rows);
+	}
+}
+
+void getColumnEnvelope(const Dataset& dataset, int colnum, int64_t first, int64_t last, int pixels, float* mins, float* maxs)
+{
+	const DataColumn& column = dataset.data[colnum];
+	const ColumnOverview& overview = column.overview;
+	int64_t rows = std::max<int64_t>(last - first, 1);
+	double rowsPerPixel = static_cast<double>(rows) / pixels;
+
+	// Streamed rows mostly aren't in memory, so they always come from the
+	// overview, however coarse it is
+	int level = -1;
+	while (level + 1 < static_cast<int>(overview.levels.size())
+		&& (static_cast<int64_t>(overview.bucketRows) << (level + 1)) <= rowsPerPixel)
+		level++;
+	if (level < 0 && (dataset.stream || !column.values))
+		level = 0;
+
+	for (int p = 0; p < pixels; p++)
+	{
+		int64_t start = first + rows * p / pixels;
+		int64_t end = std::max(first + rows * (p + 1) / pixels, start + 1);
+		float lowest = INFINITY;
+		float highest = -INFINITY;
+		if (level < 0) {
+			for (int64_t i = start; i < std::min<int64_t>(end, dataset.datalength); i++)
+			{
+				lowest = std::min(lowest, column.values[i]);
+				highest = std::max(highest, column.values[i]);
+			}
+		} else if (level < static_cast<int>(overview.levels.size())) {
+			const ColumnOverview::Level& runs = overview.levels[level];
+			int64_t runRows = static_cast<int64_t>(overview.bucketRows) << level;
+			int64_t lastRun = std::min<int64_t>((end - 1) / runRows, static_cast<int64_t>(runs.size) - 1);
+			for (int64_t r = start / runRows; r <= lastRun; r++)
+			{
+				lowest = std::fmin(lowest, runs.getMin(r));
+				highest = std::fmax(highest, runs.getMax(r));
+			}
+		}
+		bool empty = lowest > highest;
+		mins[p] = empty ? NAN : lowest;
+		maxs[p] = empty ? NAN : highest;
+	}
+}
+
+// Averages pairs of the level below, a NaN half of a pair counting as
+// missing rather than spoiling the average
+static std::vector<float> halveLevel(const float* values, size_t n, const float* counts, std::vector<float>& halvedCounts)
+{
+	size_t half = (n + 1) / 2;
+	std::vector<float> halved(half);
+	halvedCounts.assign(half, 0.f);
+	for (size_t i = 0; i < half; i++)
+	{
+		float sum = 0.f;
+		float count = 0.f;
+		for (size_t j = 2 * i; j < std::min(2 * i + 2, n); j++)
+		{
+			float c = counts ? counts[j] : 1.f;
+			if (!std::isnan(values[j]) && c > 0.f) {
+				sum += values[j] * c;
+				count += c;
+			}
+		}
+		halved[i] = (count > 0.f) ? sum / count : NAN;
+		halvedCounts[i] = count;
+	}
+	return halved;
+}
+
+void makeMipmaps(Dataset& dataset)
+{
+	if (dataset.stream)
+		return;
+	for (DataColumn& column : dataset.data)
+	{
+		column.mipmaps.levels.clear();
+		if (!column.loaded || !column.values)
+			continue;
+
+		// Each average is weighted by how many numbers went into it, so a
+		// run of blanks doesn't drag its neighbours around
+		const float* values = column.values;
+		size_t n = dataset.datalength;
+		std::vector<float> counts;
+		while (n > 1)
+		{
+			std::vector<float> halvedCounts;
+			column.mipmaps.levels.push_back(halveLevel(values, n, counts.empty() ? NULL : counts.data(), halvedCounts));
+			counts.swap(halvedCounts);
+			values = column.mipmaps.levels.back().data();
+			n = column.mipmaps.levels.back().size();
+		}
+	}
+}
+
+std::shared_ptr<Dataset> copyDataset(const std::shared_ptr<const Dataset>& dataset)
+{
+	std::shared_ptr<Dataset> copy = std::make_shared<Dataset>();
+	copy->path = dataset->path;
+	copy->columns = dataset->columns;
+	copy->datalength = dataset->datalength;
+	copy->stream = dataset->stream;
+	copy->mappedFile = dataset->mappedFile;
+	copy->timedeltas = dataset->timedeltas;
+	copy->followId = dataset->followId;
+	copy->base = dataset;
+	copy->data.resize(dataset->data.size());
+	for (size_t c = 0; c < dataset->data.size(); c++)
+	{
+		const DataColumn& from = dataset->data[c];
+		DataColumn& to = copy->data[c];
+		to.values = from.values;
+		to.shared = from.shared;
+		to.stats = from.stats;
+		to.loaded = from.loaded;
+		to.overview = from.overview;
+		to.mipmaps = from.mipmaps;
+	}
+	return copy;
+}
@@ -0,0 +1,236 @@
+#pragma once
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ColumnStats.hpp"
+
+struct CsvStream;
+struct MappedFile;
+
+// The lowest and highest number in runs of rows, at every scale from runs of
+// bucketRows rows up to the whole column, so a column of any length can be
+// drawn with a couple of points per pixel. levels[0] has runs of bucketRows
+// rows, and each level after has runs twice as long. Runs without numbers
+// are NaN.
+//
+// Loaded columns get one with makeOverviews(). Streamed ones get one as the
+// file is indexed, starting out coarser the longer the file.
+struct ColumnOverview
+{
+	// The runs of one length. Whole runs go in buffers that the overviews of
+	// a followed file share as it grows, each only reading the runs it had, so
+	// they never change once they're written. The last run might not be whole
+	// yet, so each overview keeps its own copy of that.
+	struct Level
+	{
+		std::shared_ptr<std::vector<float>> mins;
+		std::shared_ptr<std::vector<float>> maxs;
+		size_t size = 0; // runs, the last one included
+		float lastMin = NAN;
+		float lastMax = NAN;
+
+		float getMin(size_t r) const
+		{
+			return (r + 1 < size) ? (*mins)[r] : lastMin;
+		}
+
+		float getMax(size_t r) const
+		{
+			return (r + 1 < size) ? (*maxs)[r] : lastMax;
+		}
+	};
+	std::vector<Level> levels;
+	int bucketRows = 1;
+
+	// Makes the levels above the first by merging pairs of runs, once every
+	// run of the first is in its buffers
+	void addLevels();
+};
+
+// A column averaged down over and over, for playing it as a waveform faster
+// than a row a sample without aliasing. levels[k] has the averages of runs of
+// 2^(k+1) rows, so each is half as long as the one before, down to a single
+// number. Averages leave out NaN cells, runs with no numbers are NaN.
+struct ColumnMipmaps
+{
+	std::vector<std::vector<float>> levels;
+};
+
+// One column of numbers. Cells that aren't numbers are stored as NaN.
+//
+// The numbers are either held in storage, mapped straight from a cache or
+// Arrow file that the dataset keeps open, in a buffer shared with the datasets that
+// come after this one as a followed file grows, or in the dataset this one was
+// copied from. Either way values points at them, so columns can be moved but
+// not copied.
+struct DataColumn
+{
+	const float* values = NULL; // datalength of them, NULL if the dataset is streamed
+	std::vector<float> storage;
+	std::shared_ptr<const std::vector<float>> shared;
+	ColumnStats stats; // no count if the column has no numbers at all
+	bool loaded = true; // false if only the other columns were loaded
+	ColumnOverview overview; // empty until the load finishes
+	ColumnMipmaps mipmaps; // only if the load asked for them, see makeMipmaps()
+
+	DataColumn() {}
+	DataColumn(DataColumn&&) = default;
+	DataColumn& operator=(DataColumn&&) = default;
+	DataColumn(const DataColumn&) = delete;
+	DataColumn& operator=(const DataColumn&) = delete;
+
+	void setValues(std::vector<float> v)
+	{
+		storage = std::move(v);
+		values = storage.data();
+	}
+};
+
+// Every column of a parsed CSV file, ready to play. Datasets are never
+// modified once they have been published, so the audio and UI threads can
+// read them without locks, and picking a different column is just an index.
+struct Dataset
+{
+	std::string path; // empty for the built-in demo data
+	std::vector<std::string> columns;
+	std::vector<DataColumn> data; // one per column name
+	int datalength = 0; // rows, the same for every column
+
+	// Returns NULL if there's no such column or it has nothing to play
+	const DataColumn* getColumn(int colnum) const
+	{
+		if (colnum < 0 || colnum >= static_cast<int>(data.size()) || data[colnum].stats.count == 0)
+			return NULL;
+		return &data[colnum];
+	}
+
+	// Set if the rows stay on disk and are read in around the playhead
+	std::shared_ptr<CsvStream> stream;
+	// Set if the values point into a mapped file, the cache or an Arrow file
+	std::shared_ptr<MappedFile> mappedFile;
+
+	// Looks up a cell of a column returned by getColumn(). Returns false if
+	// the row is streamed and hasn't been read in yet, it never waits for it.
+	bool getValue(int colnum, int row, float& value) const
+	{
+		if (stream)
+			return getStreamedValue(colnum, row, value);
+		value = data[colnum].values[row];
+		return true;
+	}
+
+	// For playing rows at the times in a time column rather than on triggers.
+	// How long after each row the next one comes, see makeTimeDeltas(). Empty
+	// if the dataset wasn't loaded with a time column.
+	std::vector<float> timedeltas;
+
+	// Set by DatasetHandoff when published, newer datasets get bigger numbers
+	uint64_t generation = 0;
+	// The same for every dataset of one followed file, each has the rows of
+	// the one before plus some more. 0 if the file isn't followed.
+	uint64_t followId = 0;
+	// Set on a copy made by copyDataset(). Its values are this one's, so it's
+	// kept alive, and playing carries on across the swap from it.
+	std::shared_ptr<const Dataset> base;
+
+private:
+	bool getStreamedValue(int colnum, int row, float& value) const;
+};
+
+// Works out the gaps between rows from their times. The times are made to
+// only ever go forward first: a row without a time, or with one before the
+// row above's, comes straight after the row above.
+//
+// The gaps are in rows, scaled so the whole file lasts as many rows as it
+// has, which keeps the speed the same whatever units the times are in. The
+// last row's gap is 1, the time until the end of the data. Rows are spaced
+// evenly if the times don't cover any time at all.
+std::vector<float> makeTimeDeltas(const std::vector<double>& times);
+
+// Fills in the overview of every loaded column of a dataset that's about to
+// be published. They take an eighth as much memory as the columns. Streamed
+// datasets make their own as they're indexed.
+void makeOverviews(Dataset& dataset);
+
+// Brings a copy of an overview made by makeOverviews() up to date after
+// rows were added to the end of its column, which had oldRows and now has
+// rows. Only the new rows are looked at, and new runs go on the end of the
+// buffers the copy shares, so a growing file costs no more to keep up with
+// the longer it gets.
+void extendOverview(ColumnOverview& overview, const float* values, size_t oldRows, size_t rows);
+
+// The lowest and highest number in each of pixels equal slices of the rows
+// from first up to last, of a column returned by getColumn(). Slices without
+// numbers are NaN. Taken from the coarsest level of the overview that's
+// still finer than a slice, or from the values when a slice is narrower than
+// the first level, so it costs about the same however many rows there are.
+void getColumnEnvelope(const Dataset& dataset, int colnum, int64_t first, int64_t last, int pixels, float* mins, float* maxs);
+
+// Fills in the mipmaps of every loaded column of a dataset that's about to be
+// published. They take about as much memory again as the columns themselves.
+// Streamed datasets don't have their values in memory, so they don't get any.
+void makeMipmaps(Dataset& dataset);
+
+// A copy of a published dataset to add to, such as its mipmaps. The values
+// aren't copied, the copy points at them and keeps the original alive.
+std::shared_ptr<Dataset> copyDataset(const std::shared_ptr<const Dataset>& dataset);
+
+// Passes datasets from the loader thread to the audio thread.
+//
+// publish() can be called from any thread except the audio thread. The audio
+// thread calls acquire() between rows to swap in the newest published dataset,
+// which is a single atomic pointer exchange with no locks or frees. Old
+// datasets are freed later by collect() on the UI thread, once the audio
+// thread has moved past them. So are ones it never picked up because a newer
+// one came first, like while the module is bypassed and not processing.
+struct DatasetHandoff
+{
+	~DatasetHandoff();
+
+	void publish(std::shared_ptr<Dataset> dataset);
+
+	// Audio thread only. Returns true if a new dataset was swapped in.
+	bool acquire()
+	{
+		if (!pending.load(std::memory_order_relaxed))
+			return false;
+		Dataset* next = pending.exchange(NULL, std::memory_order_acquire);
+		if (!next)
+			return false;
+		active.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// The dataset the audio thread is playing. Safe to read from the audio and
+	// UI threads, it stays alive until a later collect() on the UI thread.
+	const Dataset* current() const
+	{
+		return active.load(std::memory_order_acquire);
+	}
+
+	// UI thread only. Frees datasets older than the one currently playing,
+	// and ones the audio thread skipped.
+	void collect();
+
+	// UI thread only. The newest published dataset, which is what the display
+	// and menus show even if the audio thread hasn't picked it up yet. It
+	// stays alive until the next collect().
+	const Dataset* displayed();
+
+	// The newest published dataset, which the audio thread might not have
+	// picked up yet. NULL if nothing has been published.
+	std::shared_ptr<const Dataset> latest();
+
+private:
+	std::atomic<Dataset*> pending{NULL};
+	std::atomic<Dataset*> active{NULL};
+
+	std::mutex mutex;
+	std::vector<std::shared_ptr<Dataset>> owned;
+	std::vector<const Dataset*> skipped; // replaced before the audio thread took them
+	uint64_t nextGeneration = 1;
+};
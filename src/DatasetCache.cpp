@@ -0,0 +1,358 @@
+#include "DatasetCache.hpp"
+#include "CsvReader.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+#endif
+
+
+// Bump this whenever parsing changes, so old caches get thrown away
+static const uint32_t cacheVersion = 2;
+static const char cacheMagic[8] = {'L', 'N', 'C', 'A', 'C', 'H', 'E', '\0'};
+
+// Everything's written in the machine's own byte order, a cache made on a
+// different kind of machine just won't match the magic
+struct CacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t numcolumns;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint64_t sourceHash;
+	uint64_t numrows;
+	uint64_t pathLength;
+	uint64_t valuesOffset; // the values start on a 64 byte boundary
+};
+
+static uint64_t fnv1a(const char* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static std::string cachePath(const std::string& cacheDir, const std::string& path)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.lnc", static_cast<unsigned long long>(fnv1a(path.data(), path.size())));
+	return cacheDir + "/" + name;
+}
+
+// A cache file in the directory, and when it was last used
+struct CacheEntry
+{
+	std::string path;
+	uint64_t size;
+	int64_t mtime;
+};
+
+#if defined(_WIN32)
+
+static std::FILE* openForWriting(const std::string& path)
+{
+	return _wfopen(widen(path).c_str(), L"wb");
+}
+
+static bool replaceFile(const std::string& from, const std::string& to)
+{
+	return MoveFileExW(widen(from).c_str(), widen(to).c_str(), MOVEFILE_REPLACE_EXISTING);
+}
+
+static void removeFile(const std::string& path)
+{
+	DeleteFileW(widen(path).c_str());
+}
+
+static std::string narrow(const wchar_t* wpath)
+{
+	int len = WideCharToMultiByte(CP_UTF8, 0, wpath, -1, NULL, 0, NULL, NULL);
+	std::string path(len, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, wpath, -1, &path[0], len, NULL, NULL);
+	path.resize(std::max(len - 1, 0));
+	return path;
+}
+
+static std::vector<CacheEntry> listCacheFiles(const std::string& cacheDir)
+{
+	std::vector<CacheEntry> entries;
+	WIN32_FIND_DATAW found;
+	HANDLE find = FindFirstFileW(widen(cacheDir + "/*.lnc").c_str(), &found);
+	if (find == INVALID_HANDLE_VALUE)
+		return entries;
+	do
+	{
+		if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		// File times count 100ns ticks from 1601, which is fine for putting them in order
+		uint64_t ticks = (static_cast<uint64_t>(found.ftLastWriteTime.dwHighDateTime) << 32) | found.ftLastWriteTime.dwLowDateTime;
+		uint64_t size = (static_cast<uint64_t>(found.nFileSizeHigh) << 32) | found.nFileSizeLow;
+		entries.push_back(CacheEntry{cacheDir + "/" + narrow(found.cFileName), size, static_cast<int64_t>(ticks)});
+	}
+	while (FindNextFileW(find, &found));
+	FindClose(find);
+	return entries;
+}
+
+// Marks a cache file as just used
+static void touchFile(const std::string& path)
+{
+	HANDLE file = CreateFileW(widen(path).c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	SetFileTime(file, NULL, NULL, &now);
+	CloseHandle(file);
+}
+
+#else
+
+static std::FILE* openForWriting(const std::string& path)
+{
+	return std::fopen(path.c_str(), "wb");
+}
+
+static bool replaceFile(const std::string& from, const std::string& to)
+{
+	return std::rename(from.c_str(), to.c_str()) == 0;
+}
+
+static void removeFile(const std::string& path)
+{
+	std::remove(path.c_str());
+}
+
+static std::vector<CacheEntry> listCacheFiles(const std::string& cacheDir)
+{
+	std::vector<CacheEntry> entries;
+	DIR* dir = opendir(cacheDir.c_str());
+	if (!dir)
+		return entries;
+	while (struct dirent* entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name.size() < 4 || name.compare(name.size() - 4, 4, ".lnc") != 0)
+			continue;
+		std::string path = cacheDir + "/" + name;
+		struct stat st;
+		if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+			entries.push_back(CacheEntry{path, static_cast<uint64_t>(st.st_size), static_cast<int64_t>(st.st_mtime)});
+	}
+	closedir(dir);
+	return entries;
+}
+
+// Marks a cache file as just used
+static void touchFile(const std::string& path)
+{
+	utime(path.c_str(), NULL);
+}
+
+#endif
+
+bool getCacheKey(const std::string& path, CacheKey& key)
+{
+	if (!getFileInfo(path, key.size, key.mtime))
+		return false;
+
+	// Small files are hashed whole. Big ones by their start, their end, and
+	// blocks spaced evenly in between.
+	try {
+		FileReader file(path);
+		const uint64_t blockSize = 4 << 10;
+		const uint64_t numblocks = 64;
+		std::vector<char> buffer(16 * blockSize);
+		uint64_t hash = fnv1a(reinterpret_cast<const char*>(&key.size), sizeof(key.size));
+
+		if (key.size <= numblocks * blockSize + 2 * buffer.size()) {
+			for (uint64_t offset = 0; offset < key.size; offset += buffer.size())
+			{
+				size_t got = file.read(offset, buffer.data(), buffer.size());
+				hash = fnv1a(buffer.data(), got, hash);
+			}
+		} else {
+			size_t got = file.read(0, buffer.data(), buffer.size());
+			hash = fnv1a(buffer.data(), got, hash);
+			got = file.read(key.size - buffer.size(), buffer.data(), buffer.size());
+			hash = fnv1a(buffer.data(), got, hash);
+			for (uint64_t i = 0; i < numblocks; i++)
+			{
+				got = file.read(key.size / numblocks * i, buffer.data(), blockSize);
+				hash = fnv1a(buffer.data(), got, hash);
+			}
+		}
+		key.hash = hash;
+	} catch (std::exception&) {
+		return false;
+	}
+	return true;
+}
+
+std::shared_ptr<Dataset> readDatasetCache(const std::string& cacheDir, const std::string& path, const CacheKey& key,
+	const std::atomic<bool>* cancelled)
+{
+	std::string filePath = cachePath(cacheDir, path);
+	std::shared_ptr<MappedFile> file;
+	try {
+		file = std::make_shared<MappedFile>(filePath, MappedFile::ACCESS_RANDOM);
+	} catch (std::exception&) {
+		return NULL;
+	}
+	const char* data = file->data();
+	size_t size = file->size();
+
+	CacheHeader header;
+	if (size < sizeof(header))
+		return NULL;
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion)
+		return NULL;
+	if (header.sourceSize != key.size || header.sourceTime != key.mtime || header.sourceHash != key.hash)
+		return NULL;
+	if (header.numrows > INT_MAX || header.valuesOffset % 64 != 0 || header.valuesOffset > size)
+		return NULL;
+	// A file with a header and no rows has no values at all
+	if (header.numrows > 0 && (size - header.valuesOffset) / sizeof(float) / header.numrows < header.numcolumns)
+		return NULL;
+
+	// Different paths can hash to the same cache file
+	const char* p = data + sizeof(header);
+	const char* end = data + header.valuesOffset;
+	if (header.pathLength > static_cast<uint64_t>(end - p) || path.compare(0, std::string::npos, p, header.pathLength) != 0)
+		return NULL;
+	p += header.pathLength;
+
+	std::shared_ptr<Dataset> dataset = std::make_shared<Dataset>();
+	dataset->path = path;
+	dataset->datalength = static_cast<int>(header.numrows);
+	dataset->mappedFile = file;
+	dataset->data.resize(header.numcolumns);
+	for (uint32_t c = 0; c < header.numcolumns; c++)
+	{
+		uint32_t nameLength;
+		if (end - p < static_cast<ptrdiff_t>(sizeof(nameLength)))
+			return NULL;
+		std::memcpy(&nameLength, p, sizeof(nameLength));
+		p += sizeof(nameLength);
+		if (static_cast<uint64_t>(end - p) < nameLength + sizeof(ColumnStats))
+			return NULL;
+		dataset->columns.push_back(std::string(p, nameLength));
+		p += nameLength;
+
+		DataColumn& column = dataset->data[c];
+		std::memcpy(&column.stats, p, sizeof(ColumnStats));
+		p += sizeof(ColumnStats);
+		column.values = reinterpret_cast<const float*>(data + header.valuesOffset) + c * header.numrows;
+	}
+
+	// The stats came from the header, so none of the values have been read
+	// yet. They're played straight from the map, so read them all in now
+	// rather than on the audio thread.
+	if (!file->prefault(header.valuesOffset, header.numcolumns * header.numrows * sizeof(float), cancelled))
+		return NULL;
+
+	// So it's the last to go when the cache is trimmed
+	touchFile(filePath);
+	return dataset;
+}
+
+bool writeDatasetCache(const std::string& cacheDir, const Dataset& dataset, const CacheKey& key, const std::atomic<bool>* cancelled)
+{
+	// The path, the column names and stats, then padding up to the values
+	std::string names(dataset.path);
+	for (size_t c = 0; c < dataset.columns.size(); c++)
+	{
+		const std::string& name = dataset.columns[c];
+		const DataColumn& column = dataset.data[c];
+		uint32_t nameLength = static_cast<uint32_t>(name.size());
+		names.append(reinterpret_cast<const char*>(&nameLength), sizeof(nameLength));
+		names += name;
+		names.append(reinterpret_cast<const char*>(&column.stats), sizeof(ColumnStats));
+	}
+	size_t valuesOffset = (sizeof(CacheHeader) + names.size() + 63) / 64 * 64;
+	names.resize(valuesOffset - sizeof(CacheHeader), '\0');
+
+	CacheHeader header;
+	std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+	header.version = cacheVersion;
+	header.numcolumns = static_cast<uint32_t>(dataset.columns.size());
+	header.sourceSize = key.size;
+	header.sourceTime = key.mtime;
+	header.sourceHash = key.hash;
+	header.numrows = dataset.datalength;
+	header.pathLength = dataset.path.size();
+	header.valuesOffset = valuesOffset;
+
+	// Each loader thread writes its own temporary file, then it's swapped in
+	std::string finalPath = cachePath(cacheDir, dataset.path);
+	std::string tempPath = finalPath + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	std::FILE* f = openForWriting(tempPath);
+	if (!f)
+		return false;
+	bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1
+		&& std::fwrite(names.data(), 1, names.size(), f) == names.size();
+	// The values a block at a time, so a huge file can be given up on part way
+	const size_t blockSize = 1 << 20;
+	for (size_t c = 0; ok && c < dataset.data.size(); c++)
+	{
+		const float* values = dataset.data[c].values;
+		for (size_t r = 0; ok && r < static_cast<size_t>(dataset.datalength); r += blockSize)
+		{
+			size_t n = std::min(blockSize, dataset.datalength - r);
+			ok = std::fwrite(values + r, sizeof(float), n, f) == n;
+			if (cancelled && cancelled->load(std::memory_order_relaxed))
+				ok = false;
+		}
+	}
+	ok = (std::fclose(f) == 0) && ok;
+
+	if (!ok || !replaceFile(tempPath, finalPath)) {
+		removeFile(tempPath);
+		return false;
+	}
+	return true;
+}
+
+void trimDatasetCache(const std::string& cacheDir, uint64_t maxBytes)
+{
+	std::vector<CacheEntry> entries = listCacheFiles(cacheDir);
+	std::sort(entries.begin(), entries.end(), [](const CacheEntry& a, const CacheEntry& b) {
+		return a.mtime > b.mtime;
+	});
+	uint64_t total = 0;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		total += entries[i].size;
+		if (i > 0 && total > maxBytes)
+			removeFile(entries[i].path);
+	}
+}
+
+uint64_t getDatasetCacheSize(const std::string& cacheDir)
+{
+	uint64_t total = 0;
+	for (const CacheEntry& entry : listCacheFiles(cacheDir))
+		total += entry.size;
+	return total;
+}
+
+void clearDatasetCache(const std::string& cacheDir)
+{
+	for (const CacheEntry& entry : listCacheFiles(cacheDir))
+		removeFile(entry.path);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "Dataset.hpp"
+
+// Parsed datasets are saved to a cache directory, so each file only has to be
+// parsed once however many patches use it. A source file gets one cache file,
+// named after a hash of its path, with every column and its range laid out to
+// be mapped straight back into memory.
+//
+// Cache files are as big as the data in them, so the directory is kept under
+// a size limit by throwing out the ones used longest ago. Using one marks it
+// as used by updating its modification time.
+
+// What a cache file has to match to be used. The hash is of samples spread
+// through the file rather than all of it, so checking is quick even for huge
+// files. Size and modification time catch the rest.
+struct CacheKey
+{
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	uint64_t hash = 0;
+};
+
+// Returns false if the file can't be read
+bool getCacheKey(const std::string& path, CacheKey& key);
+
+// Maps the cached dataset for a file, and reads all of it into memory so it
+// can be played without waiting on the disk. Returns NULL if there isn't one,
+// it was made from a different version of the file, or cancelled gets set.
+std::shared_ptr<Dataset> readDatasetCache(const std::string& cacheDir, const std::string& path, const CacheKey& key,
+	const std::atomic<bool>* cancelled = NULL);
+
+// Saves a dataset parsed from a file with the given key. It's written to a
+// temporary file first so nothing ever maps a half-written cache. Gives up if
+// cancelled gets set. Returns false if it didn't work, which is harmless.
+bool writeDatasetCache(const std::string& cacheDir, const Dataset& dataset, const CacheKey& key,
+	const std::atomic<bool>* cancelled = NULL);
+
+// The most the cache directory should hold
+static const uint64_t datasetCacheLimit = 4ULL << 30;
+
+// Removes the least recently used cache files until the rest fit in maxBytes.
+// The newest one is always kept, even if it's bigger than that on its own.
+void trimDatasetCache(const std::string& cacheDir, uint64_t maxBytes);
+
+// Bytes taken up by cache files
+uint64_t getDatasetCacheSize(const std::string& cacheDir);
+
+// Removes every cache file. Datasets already mapped carry on working, though
+// on Windows their files can't be removed until they're let go.
+void clearDatasetCache(const std::string& cacheDir);
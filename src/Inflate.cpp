@@ -0,0 +1,419 @@
+#include "Inflate.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+static const size_t windowMask = (1 << 15) - 1;
+
+// Gzip header flags
+static const int FLAG_HCRC = 2;
+static const int FLAG_EXTRA = 4;
+static const int FLAG_NAME = 8;
+static const int FLAG_COMMENT = 16;
+
+static const uint16_t lengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t lengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distanceBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+	6145, 8193, 12289, 16385, 24577};
+static const uint8_t distanceExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// The order the code length code lengths come in
+static const uint8_t codeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static std::runtime_error badData()
+{
+	return std::runtime_error("bad gzip data");
+}
+
+static bool startsWith(const char* data, size_t size, const uint8_t* magic, size_t length)
+{
+	return size >= length && std::memcmp(data, magic, length) == 0;
+}
+
+bool isGzipData(const char* data, size_t size)
+{
+	static const uint8_t magic[3] = {0x1f, 0x8b, 8};
+	return startsWith(data, size, magic, sizeof(magic));
+}
+
+bool isZstdData(const char* data, size_t size)
+{
+	static const uint8_t magic[4] = {0x28, 0xb5, 0x2f, 0xfd};
+	return startsWith(data, size, magic, sizeof(magic));
+}
+
+static uint32_t crcTable[256];
+
+static void makeCrcTable()
+{
+	for (uint32_t n = 0; n < 256; n++)
+	{
+		uint32_t c = n;
+		for (int k = 0; k < 8; k++)
+			c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		crcTable[n] = c;
+	}
+}
+
+static uint32_t updateCrc(uint32_t crc, const uint8_t* data, size_t size)
+{
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+void GzipReader::Huffman::build(const uint8_t* lengths, int count)
+{
+	std::memset(counts, 0, sizeof(counts));
+	for (int s = 0; s < count; s++)
+		counts[lengths[s]]++;
+	counts[0] = 0;
+
+	// Too many codes of some length can't be decoded. Too few is allowed,
+	// since a block with a single distance code has one, and anything that
+	// lands in a gap is caught when decoding.
+	int left = 1;
+	for (int length = 1; length < 16; length++)
+	{
+		left = (left << 1) - counts[length];
+		if (left < 0)
+			throw badData();
+	}
+
+	uint16_t offsets[16];
+	offsets[1] = 0;
+	for (int length = 1; length < 15; length++)
+		offsets[length + 1] = offsets[length] + counts[length];
+	for (int s = 0; s < count; s++)
+	{
+		if (lengths[s])
+			symbols[offsets[lengths[s]]++] = static_cast<uint16_t>(s);
+	}
+
+	// Deflate sends codes starting from their top bit, so they're reversed in
+	// the bit buffer
+	std::memset(fast, 0, sizeof(fast));
+	int code = 0;
+	int index = 0;
+	for (int length = 1; length <= fastBits; length++)
+	{
+		for (int i = 0; i < counts[length]; i++, code++, index++)
+		{
+			int reversed = 0;
+			for (int b = 0; b < length; b++)
+				reversed |= ((code >> b) & 1) << (length - 1 - b);
+			for (int e = reversed; e < (1 << fastBits); e += 1 << length)
+				fast[e] = static_cast<uint16_t>((symbols[index] << 4) | length);
+		}
+		code <<= 1;
+	}
+}
+
+// The codes of blocks that don't bring their own
+struct FixedCodes
+{
+	GzipReader::Huffman lengths;
+	GzipReader::Huffman distances;
+
+	FixedCodes()
+	{
+		uint8_t l[288];
+		std::fill(l, l + 144, 8);
+		std::fill(l + 144, l + 256, 9);
+		std::fill(l + 256, l + 280, 7);
+		std::fill(l + 280, l + 288, 8);
+		lengths.build(l, 288);
+		std::fill(l, l + 30, 5);
+		distances.build(l, 30);
+	}
+};
+
+GzipReader::GzipReader(const char* data, size_t size)
+	: data(reinterpret_cast<const uint8_t*>(data))
+	, end(size)
+{
+	static bool crcReady = (makeCrcTable(), true);
+	(void) crcReady;
+}
+
+void GzipReader::checkEnd() const
+{
+	// Bits read ahead past the end are fine as long as they aren't used
+	if (pos > end + count / 8)
+		throw std::runtime_error("gzip data cut short");
+}
+
+uint8_t GzipReader::getByte()
+{
+	if (pos >= end)
+		throw std::runtime_error("gzip data cut short");
+	return data[pos++];
+}
+
+void GzipReader::readHeader()
+{
+	alignToByte();
+	checkEnd();
+	// Some programs pad the end with zeros, anything that isn't another member
+	// is ignored like gzip does
+	if (end - pos < 10 || data[pos] != 0x1f || data[pos + 1] != 0x8b) {
+		if (!anyMembers)
+			throw badData();
+		state = STATE_DONE;
+		return;
+	}
+	if (data[pos + 2] != 8)
+		throw badData();
+	int flags = data[pos + 3];
+	pos += 10;
+	if (flags & FLAG_EXTRA) {
+		size_t length = getByte();
+		length |= getByte() << 8;
+		if (length > end - pos)
+			throw std::runtime_error("gzip data cut short");
+		pos += length;
+	}
+	if (flags & FLAG_NAME) {
+		while (getByte())
+			;
+	}
+	if (flags & FLAG_COMMENT) {
+		while (getByte())
+			;
+	}
+	if (flags & FLAG_HCRC) {
+		getByte();
+		getByte();
+	}
+
+	anyMembers = true;
+	lastBlock = false;
+	written = 0;
+	crc = 0;
+	state = STATE_BLOCK;
+}
+
+void GzipReader::readBlockHeader()
+{
+	checkEnd();
+	if (lastBlock) {
+		state = STATE_TRAILER;
+		return;
+	}
+	lastBlock = getBits(1);
+	int type = getBits(2);
+	if (type == 0) {
+		alignToByte();
+		uint32_t length = getByte();
+		length |= getByte() << 8;
+		uint32_t inverse = getByte();
+		inverse |= getByte() << 8;
+		if (length != (~inverse & 0xffff))
+			throw badData();
+		storedLeft = length;
+		state = STATE_STORED;
+	} else if (type == 1) {
+		// The fixed codes are the same every time
+		static const FixedCodes fixed;
+		lengths = fixed.lengths;
+		distances = fixed.distances;
+		state = STATE_CODES;
+	} else if (type == 2) {
+		readDynamicTables();
+		state = STATE_CODES;
+	} else {
+		throw badData();
+	}
+}
+
+void GzipReader::readDynamicTables()
+{
+	int numLengths = getBits(5) + 257;
+	int numDistances = getBits(5) + 1;
+	int numCodeLengths = getBits(4) + 4;
+	if (numLengths > 286 || numDistances > 30)
+		throw badData();
+
+	uint8_t l[320] = {};
+	for (int i = 0; i < numCodeLengths; i++)
+		l[codeLengthOrder[i]] = static_cast<uint8_t>(getBits(3));
+	Huffman codeLengths;
+	codeLengths.build(l, 19);
+
+	// The lengths of both codes come as one run, and repeats can cross from
+	// one to the other
+	int total = numLengths + numDistances;
+	std::memset(l, 0, sizeof(l));
+	for (int i = 0; i < total; )
+	{
+		int symbol = decode(codeLengths);
+		if (symbol < 16) {
+			l[i++] = static_cast<uint8_t>(symbol);
+			continue;
+		}
+		uint8_t length = 0;
+		int repeat;
+		if (symbol == 16) {
+			if (i == 0)
+				throw badData();
+			length = l[i - 1];
+			repeat = 3 + getBits(2);
+		} else if (symbol == 17) {
+			repeat = 3 + getBits(3);
+		} else {
+			repeat = 11 + getBits(7);
+		}
+		if (i + repeat > total)
+			throw badData();
+		while (repeat--)
+			l[i++] = length;
+	}
+	// Without an end of block code nothing could end the block
+	if (l[256] == 0)
+		throw badData();
+	lengths.build(l, numLengths);
+	distances.build(l + numLengths, numDistances);
+}
+
+void GzipReader::readTrailer()
+{
+	alignToByte();
+	uint32_t expected = 0;
+	uint32_t size = 0;
+	for (int i = 0; i < 4; i++)
+		expected |= static_cast<uint32_t>(getByte()) << (8 * i);
+	for (int i = 0; i < 4; i++)
+		size |= static_cast<uint32_t>(getByte()) << (8 * i);
+	if (expected != crc || size != static_cast<uint32_t>(written))
+		throw std::runtime_error("gzip data is corrupt");
+	state = STATE_HEADER;
+}
+
+int GzipReader::decode(const Huffman& huffman)
+{
+	if (count < 15)
+		refill();
+	uint16_t entry = huffman.fast[bits & ((1 << Huffman::fastBits) - 1)];
+	if (entry) {
+		int length = entry & 15;
+		bits >>= length;
+		count -= length;
+		return entry >> 4;
+	}
+
+	// Longer codes a bit at a time
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for (int length = 1; length < 16; length++)
+	{
+		code |= (bits >> (length - 1)) & 1;
+		int n = huffman.counts[length];
+		if (code - first < n) {
+			bits >>= length;
+			count -= length;
+			return huffman.symbols[index + code - first];
+		}
+		index += n;
+		first = (first + n) << 1;
+		code <<= 1;
+	}
+	throw badData();
+}
+
+// Decodes symbols into out until it's full or the block ends
+size_t GzipReader::decodeCodes(uint8_t* out, size_t size)
+{
+	size_t n = 0;
+	while (n < size)
+	{
+		if (matchLeft) {
+			size_t length = std::min<size_t>(matchLeft, size - n);
+			for (size_t i = 0; i < length; i++)
+			{
+				uint8_t byte = window[(written - matchDistance) & windowMask];
+				window[written++ & windowMask] = byte;
+				out[n++] = byte;
+			}
+			matchLeft -= static_cast<uint32_t>(length);
+			continue;
+		}
+
+		refill();
+		int symbol = decode(lengths);
+		if (symbol < 256) {
+			window[written++ & windowMask] = static_cast<uint8_t>(symbol);
+			out[n++] = static_cast<uint8_t>(symbol);
+			continue;
+		}
+		if (symbol == 256) {
+			state = STATE_BLOCK;
+			break;
+		}
+		symbol -= 257;
+		if (symbol >= 29)
+			throw badData();
+		matchLeft = lengthBase[symbol] + getBits(lengthExtra[symbol]);
+		int d = decode(distances);
+		if (d >= 30)
+			throw badData();
+		matchDistance = distanceBase[d] + getBits(distanceExtra[d]);
+		// Nothing can refer back past the start of the member
+		if (matchDistance > written)
+			throw badData();
+	}
+	return n;
+}
+
+size_t GzipReader::read(char* outChars, size_t size)
+{
+	uint8_t* out = reinterpret_cast<uint8_t*>(outChars);
+	size_t n = 0;
+	size_t crcFrom = 0;
+	while (n < size && state != STATE_DONE)
+	{
+		switch (state)
+		{
+			case STATE_HEADER:
+				readHeader();
+				break;
+			case STATE_BLOCK:
+				readBlockHeader();
+				break;
+			case STATE_STORED: {
+				size_t length = std::min<size_t>(storedLeft, size - n);
+				if (length > end - pos)
+					throw std::runtime_error("gzip data cut short");
+				std::memcpy(out + n, data + pos, length);
+				for (size_t i = 0; i < length; i++)
+					window[(written + i) & windowMask] = out[n + i];
+				pos += length;
+				n += length;
+				written += length;
+				storedLeft -= static_cast<uint32_t>(length);
+				if (storedLeft == 0)
+					state = STATE_BLOCK;
+				break;
+			}
+			case STATE_CODES:
+				n += decodeCodes(out + n, size - n);
+				break;
+			case STATE_TRAILER:
+				// The member's output is all in, so its check can be done
+				crc = updateCrc(crc, out + crcFrom, n - crcFrom);
+				crcFrom = n;
+				readTrailer();
+				break;
+			default:
+				break;
+		}
+	}
+	crc = updateCrc(crc, out + crcFrom, n - crcFrom);
+	checkEnd();
+	return n;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// True if the start of a file looks like gzip data
+bool isGzipData(const char* data, size_t size);
+// True if the start of a file looks like Zstandard data, which we can't read
+bool isZstdData(const char* data, size_t size);
+
+// Decompresses gzip data a piece at a time, so the whole of a big file never
+// has to be in memory at once. Files made of several gzip members, like ones
+// joined with cat, come out as one.
+//
+// The compressed data has to stay put while it's read, usually it's a
+// MappedFile. Only the last 32 KiB of output is kept, which is as far back as
+// deflate can refer.
+struct GzipReader
+{
+	GzipReader(const char* data, size_t size);
+
+	// Decompresses up to size more bytes into out and returns how many. Only
+	// returns fewer than asked for at the end. Throws std::runtime_error if the
+	// data is bad or cut short.
+	size_t read(char* out, size_t size);
+
+	// How much of the compressed data has been used, roughly
+	size_t getPosition() const
+	{
+		return pos;
+	}
+
+	// Canonical Huffman code for decoding deflate symbols. Codes up to fastBits
+	// long are looked up in one go, longer ones a bit at a time.
+	struct Huffman
+	{
+		static const int fastBits = 10;
+		uint16_t fast[1 << fastBits]; // symbol << 4 | length, 0 if longer than fastBits
+		uint16_t counts[16]; // how many codes of each length
+		uint16_t symbols[288]; // ordered by code
+
+		void build(const uint8_t* lengths, int count);
+	};
+
+private:
+	enum State
+	{
+		STATE_HEADER,
+		STATE_BLOCK,
+		STATE_STORED,
+		STATE_CODES,
+		STATE_TRAILER,
+		STATE_DONE,
+	};
+
+	void readHeader();
+	void readBlockHeader();
+	void readDynamicTables();
+	void readTrailer();
+	size_t decodeCodes(uint8_t* out, size_t size);
+	int decode(const Huffman& huffman);
+
+	void refill()
+	{
+		while (count <= 56)
+		{
+			// Past the end it's zeros, see checkEnd()
+			uint64_t byte = (pos < end) ? data[pos] : 0;
+			pos++;
+			bits |= byte << count;
+			count += 8;
+		}
+	}
+
+	uint32_t getBits(int n)
+	{
+		if (count < n)
+			refill();
+		uint32_t value = static_cast<uint32_t>(bits & ((uint64_t(1) << n) - 1));
+		bits >>= n;
+		count -= n;
+		return value;
+	}
+
+	// Drops the bits to the next byte, and anything read ahead, so pos is where
+	// the next whole byte is
+	void alignToByte()
+	{
+		pos -= count / 8;
+		bits = 0;
+		count = 0;
+	}
+
+	uint8_t getByte();
+	void checkEnd() const;
+
+	const uint8_t* data;
+	size_t end;
+	size_t pos = 0;
+	uint64_t bits = 0;
+	int count = 0;
+
+	State state = STATE_HEADER;
+	bool lastBlock = false;
+	bool anyMembers = false;
+	uint32_t storedLeft = 0;
+	uint32_t matchLeft = 0;
+	uint32_t matchDistance = 0;
+	Huffman lengths;
+	Huffman distances;
+
+	// The last 32 KiB of output of the current member
+	uint8_t window[1 << 15];
+	uint64_t written = 0;
+	uint32_t crc = 0;
+};
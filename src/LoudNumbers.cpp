@@ -4,12 +4,16 @@
 #include <iterator>
 #include <math.h>
 #include <osdialog.h>
-#define HAS_CODECVT
-#include "rapidcsv.h" //https://github.com/d99kris/rapidcsv
+#include "Dataset.hpp"
+#include "CsvLoader.hpp"
+#include "CsvStream.hpp"
+#include "DatasetCache.hpp"
+#include "ColumnCodec.hpp"
+#include "UdpSource.hpp"
+#include "Wavetable.hpp"
 
 std::vector<float> defaultdata{-0.267,-0.007,0.046,0.017,-0.049,0.038,0.014,0.048,-0.223,-0.14,-0.068,-0.074,-0.113,0.032,-0.027,-0.186,-0.065,0.062,-0.214,-0.149,-0.241,0.047,-0.062,0.057,0.092,0.14,0.011,0.194,-0.014,-0.03,0.045,0.192,0.198,0.118,0.296,0.254,0.105,0.148,0.208,0.325,0.183,0.39,0.539,0.306,0.294,0.441,0.496,0.505,0.447,0.545,0.506,0.491,0.395,0.506,0.56,0.425,0.47,0.514,0.579,0.763,0.797,0.677,0.597,0.736};
-float defaultdatamin = *std::min_element(defaultdata.begin(), defaultdata.end());
-float defaultdatamax = *std::max_element(defaultdata.begin(), defaultdata.end());
+ColumnStats defaultstats = computeColumnStats(defaultdata.data(), defaultdata.size());
 int defaultdatalength = static_cast<int>(defaultdata.size());
 
 // This function scales a number from one range to another
@@ -25,12 +29,16 @@ struct LoudNumbers : Module
 	{
 		RANGE_PARAM,
 		LENGTH_PARAM,
+		SPEED_PARAM,
+		FREQ_PARAM,
 		PARAMS_LEN
 	};
 	enum InputId
 	{
 		TRIG_INPUT,
 		RESET_INPUT,
+		PITCH_INPUT,
+		POSITION_INPUT,
 		INPUTS_LEN
 	};
 	enum OutputId
@@ -53,35 +61,129 @@ struct LoudNumbers : Module
 		configParam(RANGE_PARAM, 1, 8, 2, "Octave range", " octaves");
 		getParamQuantity(RANGE_PARAM)->snapEnabled = true;
 		configParam(LENGTH_PARAM, 0.001f, 1.f, 0.1f, "Gate length", " s");
+		// Only used when playing at the times in a column
+		configParam(SPEED_PARAM, -4.f, 7.f, 2.f, "Speed", " rows/s", 2.f);
+		// Only used in oscillator mode, the whole column makes one cycle
+		configParam(FREQ_PARAM, -4.f, 4.f, 0.f, "Frequency", " Hz", 2.f, dsp::FREQ_C4);
 		configInput(TRIG_INPUT, "Trigger");
 		configInput(RESET_INPUT, "Reset");
+		configInput(PITCH_INPUT, "Oscillator pitch (V/oct)");
+		configInput(POSITION_INPUT, "Row position (0 to 10V)");
 		configOutput(END_OUTPUT, "End of Data Trigger");
 		configOutput(MINUSFIVETOFIVE_OUTPUT, "-5V to 5V");
 		configOutput(ZEROTOTEN_OUTPUT, "0 to 10V");
 		configOutput(VOCT_OUTPUT, "Volts per octave");
 		configOutput(GATE_OUTPUT, "Gate");
+
+		// Parsed files are cached here, so patches open quickly next time
+		std::string cacheDir = asset::user("LoudNumbers/cache");
+		system::createDirectories(cacheDir);
+		loader.setCacheDir(cacheDir);
+
+		for (std::atomic<int>& column : polycolumns)
+			column.store(-1, std::memory_order_relaxed);
+
+		// Start out playing the built-in temperature data
+		std::shared_ptr<Dataset> dataset = std::make_shared<Dataset>();
+		DataColumn column;
+		column.setValues(defaultdata);
+		column.stats = defaultstats;
+		dataset->columns = {"Temps 1956-2019"};
+		dataset->data.push_back(std::move(column));
+		dataset->datalength = defaultdatalength;
+		makeOverviews(*dataset);
+		makeMipmaps(*dataset);
+		datasets.publish(dataset);
 	}
 
-	// Data variables
+	// Data variables. The path is what was last asked for, the dataset
+	// actually playing lives in the handoff. colnum is read by the audio thread.
 	std::string currentpath = "none";
-	std::vector<std::string> columns{"Temps 1956-2019"};
-	std::vector<float> data{-0.267,-0.007,0.046,0.017,-0.049,0.038,0.014,0.048,-0.223,-0.14,-0.068,-0.074,-0.113,0.032,-0.027,-0.186,-0.065,0.062,-0.214,-0.149,-0.241,0.047,-0.062,0.057,0.092,0.14,0.011,0.194,-0.014,-0.03,0.045,0.192,0.198,0.118,0.296,0.254,0.105,0.148,0.208,0.325,0.183,0.39,0.539,0.306,0.294,0.441,0.496,0.505,0.447,0.545,0.506,0.491,0.395,0.506,0.56,0.425,0.47,0.514,0.579,0.763,0.797,0.677,0.597,0.736};
+	std::atomic<int> colnum{0};
+	bool csvloaded = false;
+	std::atomic<bool> badcsv{false};
+	// Read huge files from disk as they play rather than loading them
+	bool streaming = false;
+	// Save the playing column in the patch, so it opens without the file
+	bool embed = false;
+	// Only load the playing column, for files with lots of columns
+	bool onecolumn = false;
+	// Keep loading rows as they're added to the end of the file
+	bool follow = false;
+	// Play rows at the times in this column rather than on triggers, -1 for triggers
+	int timecolumn = -1;
+
+	// Columns played at once in polyphonic mode, one per channel, in column
+	// order. Empty for the usual single column. The audio thread gets a copy
+	// through setPolyColumns().
+	static const int maxpolychannels = 16;
+	std::vector<int> polyselection;
+	std::atomic<int> polycolumns[maxpolychannels];
+	std::atomic<int> polycount{0};
+	std::atomic<int> polyversion{0};
+
+	// Glide between rows when the position input lands between them
+	std::atomic<bool> smoothposition{false};
 
-	// Calculate minmax from the stripped vector	
-	float datamin = *std::min_element(data.begin(), data.end());
-	float datamax = *std::max_element(data.begin(), data.end());
+	// Play the column as a waveform at audio rate instead of a row per trigger
+	std::atomic<bool> oscillator{false};
+	std::atomic<int> interpolation{INTERPOLATION_CUBIC};
+
+	// Parsed data is handed to the audio thread through here
+	DatasetHandoff datasets;
+	// Destroyed before the handoff, so a load can't finish into a dead module
+	CsvLoader loader;
+
+	// Live mode plays numbers sent over UDP instead of a file, one per trigger
+	std::atomic<bool> live{false};
+	int liveport = 7400;
+	SpscRing<float> livevalues{4096};
+	// Destroyed before the ring it fills
+	std::unique_ptr<UdpSource> udp;
+	std::string liveerror;
+	// The range of the live values so far, audio thread only
+	float livemin = INFINITY;
+	float livemax = -INFINITY;
 
 	int row = -1; // because the first thing we do is increment it
-	int datalength = static_cast<int>(data.size());
-	int columnslength = static_cast<int>(columns.size());
-	int colnum = 0;
-	bool csvloaded = false;
-	bool badcsv = false;
+	int playingcolnum = 0;
+	// Playing at the times in a column, in rows at the average spacing since
+	// the start, and when the next row is due
+	double timeclock = 0.0;
+	double nextdue = 0.0;
+	// Rows per second for the speed slider's setting, worked out again only
+	// when it moves. Starts at the slider's default.
+	float speedparam = 2.f;
+	float speedrate = 4.f;
+
+	// Polyphonic mode, audio thread only. The columns playing, the range of
+	// each, and how long each channel's gate has left, four channels at a time.
+	int playingpolyversion = -1;
+	int polychannels = 0; // 0 when playing a single column
+	int polyplaying[maxpolychannels];
+	simd::float_4 polymin[maxpolychannels / 4];
+	simd::float_4 polyrange[maxpolychannels / 4];
+	simd::float_4 polygate[maxpolychannels / 4];
+
+	// Oscillator mode, audio thread only. Samples come out of the oscillator
+	// four at a time, already scaled from 0 to 1, and are played one by one.
+	WavetableOscillator wavetable;
+	simd::float_4 oscblock = 0.f;
+	int oscindex = 4;
 
 	// Style variables
-	std::string main = "#003380";
-	std::string faded = "#805279";
-	std::string white = "#FFFBE4";
+	NVGcolor main = color::fromHexString("#003380");
+	NVGcolor faded = color::fromHexString("#805279");
+	NVGcolor white = color::fromHexString("#FFFBE4");
+
+	// What the display shows, UI thread only. viewrows is how many rows are
+	// in view, 0 for the whole column. While following the playhead the view
+	// turns a page whenever the playhead runs off either end of it.
+	static const int minviewrows = 8;
+	int viewrows = 0;
+	bool viewfollow = true;
+	int viewstart = 0; // worked out by updateView() each frame
+	int viewcount = 0;
 
 	// Variables to track what's happening
 	bool firstrun = true;
@@ -89,29 +191,268 @@ struct LoudNumbers : Module
 
 	// Save and retrieve menu choice(s).
 	json_t* dataToJson() override {
+		json_t* rootJ = json_object();
+		json_object_set_new(rootJ, "live", json_boolean(live));
+		json_object_set_new(rootJ, "liveport", json_integer(liveport));
+		json_object_set_new(rootJ, "oscillator", json_boolean(oscillator));
+		json_object_set_new(rootJ, "interpolation", json_integer(interpolation));
+		json_object_set_new(rootJ, "smoothposition", json_boolean(smoothposition));
+		json_object_set_new(rootJ, "viewrows", json_integer(viewrows));
+		json_object_set_new(rootJ, "viewfollow", json_boolean(viewfollow));
 		if (csvloaded) {
-			json_t* rootJ = json_object();
 			json_object_set_new(rootJ, "default_path", json_string(currentpath.c_str()));
-			json_object_set_new(rootJ, "default_column", json_integer(colnum));
-			return rootJ;
-		} else {
-			return json_object();
+			json_object_set_new(rootJ, "default_column", json_integer(colnum.load()));
+			json_object_set_new(rootJ, "streaming", json_boolean(streaming));
+			json_object_set_new(rootJ, "embed", json_boolean(embed));
+			json_object_set_new(rootJ, "onecolumn", json_boolean(onecolumn));
+			json_object_set_new(rootJ, "follow", json_boolean(follow));
+			json_object_set_new(rootJ, "timecolumn", json_integer(timecolumn));
+			json_t* polyJ = json_array();
+			for (int c : polyselection)
+				json_array_append_new(polyJ, json_integer(c));
+			json_object_set_new(rootJ, "polycolumns", polyJ);
+			if (embed) {
+				json_t* embeddedJ = embedDataset();
+				if (embeddedJ)
+					json_object_set_new(rootJ, "embedded", embeddedJ);
+			}
 		}
+		return rootJ;
 	}
 	
 	void dataFromJson(json_t* rootJ) override {
 		json_t* default_colJ = json_object_get(rootJ, "default_column");
 		json_t* default_pathJ = json_object_get(rootJ, "default_path");
+		json_t* streamingJ = json_object_get(rootJ, "streaming");
+		json_t* embedJ = json_object_get(rootJ, "embed");
+		json_t* embeddedJ = json_object_get(rootJ, "embedded");
+		json_t* onecolumnJ = json_object_get(rootJ, "onecolumn");
+		json_t* followJ = json_object_get(rootJ, "follow");
+		json_t* timecolumnJ = json_object_get(rootJ, "timecolumn");
+		json_t* polyJ = json_object_get(rootJ, "polycolumns");
+		json_t* liveJ = json_object_get(rootJ, "live");
+		json_t* liveportJ = json_object_get(rootJ, "liveport");
+		json_t* oscillatorJ = json_object_get(rootJ, "oscillator");
+		json_t* interpolationJ = json_object_get(rootJ, "interpolation");
+		json_t* smoothpositionJ = json_object_get(rootJ, "smoothposition");
+		json_t* viewrowsJ = json_object_get(rootJ, "viewrows");
+		json_t* viewfollowJ = json_object_get(rootJ, "viewfollow");
 		if (default_colJ) {
 			colnum = json_integer_value(default_colJ);
 		}
+		if (streamingJ) {
+			streaming = json_boolean_value(streamingJ);
+		}
+		if (embedJ) {
+			embed = json_boolean_value(embedJ);
+		}
+		if (onecolumnJ) {
+			onecolumn = json_boolean_value(onecolumnJ);
+		}
+		if (followJ) {
+			follow = json_boolean_value(followJ);
+		}
+		if (timecolumnJ) {
+			timecolumn = json_integer_value(timecolumnJ);
+		}
+		if (polyJ) {
+			std::vector<int> columns;
+			for (size_t i = 0; i < json_array_size(polyJ); i++)
+				columns.push_back(json_integer_value(json_array_get(polyJ, i)));
+			setPolyColumns(columns);
+		}
+		if (oscillatorJ) {
+			oscillator = json_boolean_value(oscillatorJ);
+		}
+		if (interpolationJ) {
+			interpolation = clamp((int) json_integer_value(interpolationJ), 0, INTERPOLATION_LEN - 1);
+		}
+		if (smoothpositionJ) {
+			smoothposition = json_boolean_value(smoothpositionJ);
+		}
+		if (viewrowsJ) {
+			viewrows = json_integer_value(viewrowsJ);
+		}
+		if (viewfollowJ) {
+			viewfollow = json_boolean_value(viewfollowJ);
+		}
+		if (liveportJ) {
+			liveport = json_integer_value(liveportJ);
+		}
+		if (liveJ && json_boolean_value(liveJ)) {
+			startLive();
+		}
 		if (default_pathJ) {
 			std::string p = json_string_value(default_pathJ);
-			INFO("LOADING PATH: %s", p.c_str());
 			currentpath = p;
-			processCSV(currentpath);
 			csvloaded = true;
+
+			// Data saved in the patch doesn't need the file at all
+			std::shared_ptr<Dataset> dataset = embeddedJ ? unembedDataset(embeddedJ) : NULL;
+			if (dataset) {
+				INFO("LOADING EMBEDDED DATA: %s", p.c_str());
+				dataset->path = p;
+				datasets.publish(dataset);
+				badcsv = false;
+			} else {
+				INFO("LOADING PATH: %s", p.c_str());
+				processCSV(currentpath);
+			}
+		}
+	}
+
+	// Pack the playing column, and any played polyphonically, into JSON.
+	// Returns NULL if there's nothing to pack, or it's streamed and not in
+	// memory.
+	json_t* embedDataset()
+	{
+		const Dataset* dataset = datasets.current();
+		std::vector<int> cols = polyselection;
+		if (std::find(cols.begin(), cols.end(), colnum.load()) == cols.end())
+			cols.insert(cols.begin(), colnum.load());
+		if (!dataset->getColumn(cols[0]) || dataset->stream)
+			return NULL;
+
+		json_t* embeddedJ = json_object();
+		json_object_set_new(embeddedJ, "length", json_integer(dataset->datalength));
+
+		// All the names go in, so the column menu stays the same
+		json_t* columnsJ = json_array();
+		for (const std::string& name : dataset->columns)
+			json_array_append_new(columnsJ, json_string(name.c_str()));
+		json_object_set_new(embeddedJ, "columns", columnsJ);
+
+		json_t* dataJ = json_array();
+		for (int col : cols)
+		{
+			const DataColumn* column = dataset->getColumn(col);
+			if (!column)
+				continue;
+			std::vector<uint8_t> packed = encodeColumn(column->values, dataset->datalength);
+			json_t* columnJ = json_object();
+			json_object_set_new(columnJ, "column", json_integer(col));
+			json_object_set_new(columnJ, "values", json_string(string::toBase64(packed.data(), packed.size()).c_str()));
+			json_array_append_new(dataJ, columnJ);
+		}
+		json_object_set_new(embeddedJ, "data", dataJ);
+		return embeddedJ;
+	}
+
+	// Rebuild a dataset from embedDataset(). Columns that weren't packed are
+	// there but not loaded. Returns NULL if the JSON doesn't make sense.
+	std::shared_ptr<Dataset> unembedDataset(json_t* embeddedJ)
+	{
+		json_t* lengthJ = json_object_get(embeddedJ, "length");
+		json_t* columnsJ = json_object_get(embeddedJ, "columns");
+		json_t* dataJ = json_object_get(embeddedJ, "data");
+		if (!lengthJ || !columnsJ || !dataJ)
+			return NULL;
+
+		std::shared_ptr<Dataset> dataset = std::make_shared<Dataset>();
+		dataset->datalength = json_integer_value(lengthJ);
+		for (size_t i = 0; i < json_array_size(columnsJ); i++)
+		{
+			const char* name = json_string_value(json_array_get(columnsJ, i));
+			dataset->columns.push_back(name ? name : "");
+		}
+		dataset->data.resize(dataset->columns.size());
+		for (DataColumn& column : dataset->data)
+			column.loaded = false;
+
+		for (size_t i = 0; i < json_array_size(dataJ); i++)
+		{
+			json_t* columnJ = json_array_get(dataJ, i);
+			int col = json_integer_value(json_object_get(columnJ, "column"));
+			const char* valuesS = json_string_value(json_object_get(columnJ, "values"));
+			if (col < 0 || col >= static_cast<int>(dataset->data.size()) || !valuesS)
+				return NULL;
+
+			std::vector<uint8_t> packed = string::fromBase64(valuesS);
+			std::vector<float> values;
+			if (!decodeColumn(packed.data(), packed.size(), values) || static_cast<int>(values.size()) != dataset->datalength)
+				return NULL;
+
+			DataColumn& column = dataset->data[col];
+			column.setValues(std::move(values));
+			column.stats = computeColumnStats(column.values, dataset->datalength);
+			column.loaded = true;
+		}
+		makeOverviews(*dataset);
+		makeMipmaps(*dataset);
+		return dataset;
+	}
+
+	// Start or stop listening for live data. UI thread only.
+	void startLive()
+	{
+		stopLive();
+		try {
+			udp.reset(new UdpSource(liveport, livevalues));
+			liveerror.clear();
+		} catch (std::exception& e) {
+			liveerror = e.what();
+			WARN("Live data: %s", liveerror.c_str());
+		}
+		live = true;
+	}
+
+	void stopLive()
+	{
+		live = false;
+		udp.reset();
+	}
+
+	// Works out which rows are in view this frame, see viewrows
+	void updateView()
+	{
+		int datalength = datasets.displayed()->datalength;
+		if (viewrows <= 0 || viewrows >= datalength) {
+			viewstart = 0;
+			viewcount = datalength;
+			return;
+		}
+		viewcount = viewrows;
+		int playhead = row;
+		if (viewfollow && playhead >= 0 && (playhead < viewstart || playhead >= viewstart + viewcount))
+			viewstart = playhead - viewcount / 4;
+		viewstart = std::max(0, std::min(viewstart, datalength - viewcount));
+	}
+
+	// Zooms the display in or out by factor, keeping the anchor row where it
+	// is. Zooming out past the whole column shows the whole column.
+	void zoomView(float factor, int anchor)
+	{
+		int datalength = datasets.displayed()->datalength;
+		int count = std::max(viewcount, 1);
+		int newcount = std::max(static_cast<int>(count * factor), minviewrows);
+		if (newcount >= datalength) {
+			viewrows = 0;
+			return;
 		}
+		viewstart = anchor - static_cast<int>(static_cast<int64_t>(anchor - viewstart) * newcount / count);
+		viewrows = newcount;
+	}
+
+	// Moves the view along, which stops it following the playhead
+	void scrollView(int rows)
+	{
+		viewfollow = false;
+		viewstart += rows;
+	}
+
+	// Pick the columns for polyphonic mode, or none for a single column.
+	// UI thread only.
+	void setPolyColumns(std::vector<int> columns)
+	{
+		std::sort(columns.begin(), columns.end());
+		columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+		if (columns.size() > maxpolychannels)
+			columns.resize(maxpolychannels);
+		polyselection = columns;
+		for (size_t c = 0; c < columns.size(); c++)
+			polycolumns[c].store(columns[c], std::memory_order_relaxed);
+		polycount.store(static_cast<int>(columns.size()), std::memory_order_relaxed);
+		polyversion.fetch_add(1, std::memory_order_release);
 	}
 
 	// Trigger for incoming gate detection
@@ -123,31 +464,79 @@ struct LoudNumbers : Module
 	// On a loop
 	void process(const ProcessArgs &args) override
 	{	
+		// Swap in a freshly loaded dataset before any rows get read. Every
+		// call starts on a row boundary, so this is always a safe point.
+		// A column change starts the data from the beginning again too, but
+		// new rows on the end of a followed file just carry on.
+		if (live.load(std::memory_order_relaxed)) {
+			processLive(args);
+			return;
+		}
+
+		int col = colnum.load(std::memory_order_relaxed);
+		const Dataset* previous = datasets.current();
+		uint64_t followId = previous->followId;
+		bool swapped = datasets.acquire();
+		// More rows of a followed file, or the same rows with mipmaps added,
+		// carry on from where they were
+		bool continued = (followId != 0 && datasets.current()->followId == followId) || datasets.current()->base.get() == previous;
+		if ((swapped && !continued) || col != playingcolnum)
+		{
+			playingcolnum = col;
+			firstrun = true;
+			row = -1; // because the first thing we do is increment it
+			rowadvanced = false;
+			timeclock = 0.0;
+			nextdue = 0.0;
+		}
+
+		const Dataset* dataset = datasets.current();
+		const DataColumn* column = dataset->getColumn(col);
+
+		if (oscillator.load(std::memory_order_relaxed) && !badcsv && column && !dataset->stream) {
+			processOscillator(args, dataset, column);
+			return;
+		}
+
+		int polyv = polyversion.load(std::memory_order_acquire);
+		if (swapped || polyv != playingpolyversion) {
+			playingpolyversion = polyv;
+			updatePoly(dataset);
+		}
+		if (polychannels > 0 && !badcsv) {
+			processPoly(args, dataset);
+			return;
+		}
+		setOutputChannels(1);
+
+		// Let the reader know where we are, if the rows are coming from disk
+		if (dataset->stream)
+			dataset->stream->setPlayhead(col, row);
+
 		// As long as it's not a bad CSV
-		if (!badcsv) {
+		if (!badcsv && column) {
+			const float datamin = column->stats.min;
+			const float datamax = column->stats.max;
+			const int datalength = dataset->datalength;
 
 			// Log some info about the data on first run.
 			if (firstrun)
 			{
 				INFO("data min: %f", datamin);
 				INFO("data max: %f", datamax);
+				INFO("data mean: %f, standard deviation: %f", column->stats.mean, column->stats.stddev());
 				INFO("data length: %i", datalength);
 				firstrun = false;
 			}
-			
-			// If a gate is high in the trigger input, advance the row and set rowadvanced flag
-			if (ingate.process(inputs[TRIG_INPUT].getVoltage()))
-			{	
-				// Increment the row number
-				row++;
 
-				// Check if row has hit max and trigger an end pulse if so
-				if (row >= datalength)
-				{
-					endPulse.trigger(0.01);
-				}
-				
-				// Get ready to play a note
+			if (inputs[POSITION_INPUT].isConnected()) {
+				processPosition(args, dataset, col);
+				return;
+			}
+			
+			// Get ready to play a note if the row moved on
+			if (advanceRow(args, dataset))
+			{
 				rowadvanced = true;
 			}
 
@@ -158,29 +547,20 @@ struct LoudNumbers : Module
 			// If a reset gate is received, set reset flag
 			if (resetgate.process(inputs[RESET_INPUT].getVoltage()))
 			{
-				row = 0;
-				rowadvanced = true;
+				restartRows(dataset);
 
 				// Calculate v/oct min and max
 				float voctmin;
 				float voctmax;
-
-				if (params[RANGE_PARAM].getValue() < 4)
-				{
-					voctmin = 0;
-					voctmax = params[RANGE_PARAM].getValue();
-				}
-				else
-				{
-					voctmin = 4 - params[RANGE_PARAM].getValue();
-					voctmax = 4;
-				}
+				getVoctRange(voctmin, voctmax);
 
 				// Reset the outputs to the first datapoint if it's a number
-				if (!std::isnan(data[0])) {
-					outputs[MINUSFIVETOFIVE_OUTPUT].setVoltage(scalemap(data[0], datamin, datamax, -5.f, 5.f));
-					outputs[ZEROTOTEN_OUTPUT].setVoltage(scalemap(data[0], datamin, datamax, 0.f, 10.f));
-					outputs[VOCT_OUTPUT].setVoltage(scalemap(data[0], datamin, datamax, voctmin, voctmax));
+				float first = NAN;
+				dataset->getValue(col, 0, first);
+				if (!std::isnan(first)) {
+					outputs[MINUSFIVETOFIVE_OUTPUT].setVoltage(scalemap(first, datamin, datamax, -5.f, 5.f));
+					outputs[ZEROTOTEN_OUTPUT].setVoltage(scalemap(first, datamin, datamax, 0.f, 10.f));
+					outputs[VOCT_OUTPUT].setVoltage(scalemap(first, datamin, datamax, voctmin, voctmax));
 				} else { // If not, reset to 0.
 					outputs[MINUSFIVETOFIVE_OUTPUT].setVoltage(0.f);
 					outputs[ZEROTOTEN_OUTPUT].setVoltage(0.f);
@@ -189,7 +569,10 @@ struct LoudNumbers : Module
 			} 
 
 			// If rowadvanced flag is set
-			if (rowadvanced) 
+			// A streamed row that hasn't been read in yet holds the note back
+			// until it has, rather than waiting for the disk here
+			float value = NAN;
+			if (rowadvanced && (row >= datalength || dataset->getValue(col, row, value)))
 			{
 				if (row < datalength) {
 					rowadvanced = false;
@@ -197,24 +580,14 @@ struct LoudNumbers : Module
 					// Get v/oct min and max
 					float voctmin;
 					float voctmax;
-
-					if (params[RANGE_PARAM].getValue() < 4)
-					{
-						voctmin = 0;
-						voctmax = params[RANGE_PARAM].getValue();
-					}
-					else
-					{
-						voctmin = 4 - params[RANGE_PARAM].getValue();
-						voctmax = 4;
-					}
+					getVoctRange(voctmin, voctmax);
 
 					// If it's not a NaN value and it's within the range of the data
-					if (!std::isnan(data[row]) || row >= datalength) {
+					if (!std::isnan(value) || row >= datalength) {
 						// Set the voltages to the data
-						outputs[MINUSFIVETOFIVE_OUTPUT].setVoltage(scalemap(data[row], datamin, datamax, -5.f, 5.f));
-						outputs[ZEROTOTEN_OUTPUT].setVoltage(scalemap(data[row], datamin, datamax, 0.f, 10.f));
-						outputs[VOCT_OUTPUT].setVoltage(scalemap(data[row], datamin, datamax, voctmin, voctmax));
+						outputs[MINUSFIVETOFIVE_OUTPUT].setVoltage(scalemap(value, datamin, datamax, -5.f, 5.f));
+						outputs[ZEROTOTEN_OUTPUT].setVoltage(scalemap(value, datamin, datamax, 0.f, 10.f));
+						outputs[VOCT_OUTPUT].setVoltage(scalemap(value, datamin, datamax, voctmin, voctmax));
 						gatePulse.trigger(params[LENGTH_PARAM].getValue());
 					}
 				}
@@ -227,6 +600,343 @@ struct LoudNumbers : Module
 		}
 	};
 
+	// The v/oct range the RANGE knob sets. Up to 4 octaves it starts at 0V,
+	// wider ranges end at 4V instead.
+	void getVoctRange(float& min, float& max)
+	{
+		float range = params[RANGE_PARAM].getValue();
+		if (range < 4)
+		{
+			min = 0;
+			max = range;
+		}
+		else
+		{
+			min = 4 - range;
+			max = 4;
+		}
+	}
+
+	// Moves on a row on a trigger, or when the next row's time comes round if
+	// the file was loaded with a time column. Returns true if it moved, and
+	// starts the end pulse if that ran off the end of the data.
+	bool advanceRow(const ProcessArgs &args, const Dataset* dataset)
+	{
+		const int datalength = dataset->datalength;
+		bool advanced = false;
+		if (!dataset->timedeltas.empty())
+		{
+			// Just one comparison most samples. Rows due in the same sample
+			// are skipped over, and only the last of them is heard.
+			float speed = params[SPEED_PARAM].getValue();
+			if (speed != speedparam) {
+				speedparam = speed;
+				speedrate = std::pow(2.f, speed);
+			}
+			timeclock += speedrate * args.sampleTime;
+			while (row < datalength && timeclock >= nextdue)
+			{
+				row++;
+				if (row < datalength)
+					nextdue += dataset->timedeltas[row];
+				advanced = true;
+			}
+		}
+		// If a gate is high in the trigger input, advance the row
+		else if (ingate.process(inputs[TRIG_INPUT].getVoltage()))
+		{
+			row++;
+			advanced = true;
+		}
+
+		// Check if row has hit max and trigger an end pulse if so
+		if (advanced && row >= datalength)
+			endPulse.trigger(0.01);
+		return advanced;
+	}
+
+	// Back to the first row, which plays straight away
+	void restartRows(const Dataset* dataset)
+	{
+		row = 0;
+		rowadvanced = true;
+		timeclock = 0.0;
+		nextdue = dataset->timedeltas.empty() ? 0.0 : dataset->timedeltas[0];
+	}
+
+	void setOutputChannels(int channels)
+	{
+		outputs[MINUSFIVETOFIVE_OUTPUT].setChannels(channels);
+		outputs[ZEROTOTEN_OUTPUT].setChannels(channels);
+		outputs[VOCT_OUTPUT].setChannels(channels);
+		outputs[GATE_OUTPUT].setChannels(channels);
+	}
+
+	// Picks up the columns for polyphonic mode and works out their ranges,
+	// whenever they or the dataset change. Streamed files only have the
+	// playing column read in, so they stay on it.
+	void updatePoly(const Dataset* dataset)
+	{
+		polychannels = dataset->stream ? 0 : polycount.load(std::memory_order_relaxed);
+		float mins[maxpolychannels];
+		float ranges[maxpolychannels];
+		for (int c = 0; c < maxpolychannels; c++)
+		{
+			polyplaying[c] = (c < polychannels) ? polycolumns[c].load(std::memory_order_relaxed) : -1;
+			const DataColumn* column = dataset->getColumn(polyplaying[c]);
+			// A column that's all one number sits at the bottom of the range
+			mins[c] = column ? column->stats.min : 0.f;
+			ranges[c] = (column && column->stats.max > column->stats.min) ? column->stats.max - column->stats.min : 1.f;
+		}
+		for (int g = 0; g < maxpolychannels / 4; g++)
+		{
+			polymin[g] = simd::float_4::load(mins + 4 * g);
+			polyrange[g] = simd::float_4::load(ranges + 4 * g);
+			polygate[g] = 0.f;
+		}
+	}
+
+	// Plays the same row of every polyphonic column at once, one per channel.
+	// The scaling and gates are done four channels at a time, so sixteen
+	// columns cost little more than one.
+	void processPoly(const ProcessArgs &args, const Dataset* dataset)
+	{
+		using simd::float_4;
+		const int channels = polychannels;
+		setOutputChannels(channels);
+
+		// The position input picks the row, otherwise it moves on as usual
+		int seekrow;
+		if (seekPosition(dataset->datalength, seekrow, NULL)) {
+			if (seekrow != row) {
+				row = seekrow;
+				rowadvanced = true;
+			}
+		} else {
+			if (advanceRow(args, dataset))
+				rowadvanced = true;
+			if (resetgate.process(inputs[RESET_INPUT].getVoltage()))
+				restartRows(dataset);
+		}
+		bool epulse = endPulse.process(args.sampleTime);
+		outputs[END_OUTPUT].setVoltage(epulse ? 10.0 : 0.0);
+
+		if (rowadvanced && row < dataset->datalength)
+		{
+			rowadvanced = false;
+
+			// Channels without a number, or without a column, stay silent
+			alignas(16) float values[maxpolychannels];
+			for (int c = 0; c < maxpolychannels; c++)
+			{
+				const DataColumn* column = dataset->getColumn(polyplaying[c]);
+				values[c] = column ? column->values[row] : NAN;
+			}
+
+			// Get v/oct min and max
+			float voctmin;
+			float voctmax;
+			getVoctRange(voctmin, voctmax);
+
+			float_4 gatelength = params[LENGTH_PARAM].getValue();
+			for (int c = 0; c < channels; c += 4)
+			{
+				int g = c / 4;
+				float_4 value = float_4::load(values + c);
+				// NaN isn't equal to itself, and those channels keep their last note
+				float_4 number = (value == value);
+				float_4 position = (value - polymin[g]) / polyrange[g];
+				outputs[MINUSFIVETOFIVE_OUTPUT].setVoltageSimd(simd::ifelse(number, position * 10.f - 5.f,
+					outputs[MINUSFIVETOFIVE_OUTPUT].getVoltageSimd<float_4>(c)), c);
+				outputs[ZEROTOTEN_OUTPUT].setVoltageSimd(simd::ifelse(number, position * 10.f,
+					outputs[ZEROTOTEN_OUTPUT].getVoltageSimd<float_4>(c)), c);
+				outputs[VOCT_OUTPUT].setVoltageSimd(simd::ifelse(number, voctmin + position * (voctmax - voctmin),
+					outputs[VOCT_OUTPUT].getVoltageSimd<float_4>(c)), c);
+				polygate[g] = simd::ifelse(number, gatelength, polygate[g]);
+			}
+		}
+
+		// The gates all count down together
+		for (int c = 0; c < channels; c += 4)
+		{
+			int g = c / 4;
+			polygate[g] -= args.sampleTime;
+			outputs[GATE_OUTPUT].setVoltageSimd(simd::ifelse(polygate[g] > 0.f, 10.f, 0.f), c);
+		}
+	}
+
+	// Maps the position input to a row, 0V the first and 10V the last, and
+	// how far it is towards the next one. Returns false if nothing's patched.
+	bool seekPosition(int datalength, int& seekrow, float* fraction)
+	{
+		if (!inputs[POSITION_INPUT].isConnected())
+			return false;
+		// Doubles, since a float can't tell the rows of a long file apart
+		double position = clamp(inputs[POSITION_INPUT].getVoltage() / 10.f, 0.f, 1.f) * (double) std::max(datalength - 1, 0);
+		seekrow = std::min(static_cast<int>(position), std::max(datalength - 1, 0));
+		if (fraction)
+			*fraction = static_cast<float>(position - seekrow);
+		return true;
+	}
+
+	// Plays whichever row the position input points at, updating the outputs
+	// every sample so it can be swept through a file of any length. Triggers,
+	// reset and times are ignored while it's patched. Moving onto another row
+	// opens the gate.
+	void processPosition(const ProcessArgs &args, const Dataset* dataset, int col)
+	{
+		const DataColumn* column = dataset->getColumn(col);
+		const int datalength = dataset->datalength;
+		int seekrow;
+		float fraction;
+		seekPosition(datalength, seekrow, &fraction);
+
+		bool moved = (seekrow != row);
+		row = seekrow;
+		rowadvanced = false;
+
+		// Streamed rows that haven't been read in yet keep the last value,
+		// as do rows without a number
+		float value = NAN;
+		if (row < datalength && dataset->getValue(col, row, value) && !std::isnan(value))
+		{
+			// Glide towards the next row if it has a number too
+			float next;
+			if (smoothposition.load(std::memory_order_relaxed) && row + 1 < datalength
+				&& dataset->getValue(col, row + 1, next) && !std::isnan(next))
+				value += fraction * (next - value);
+
+			// Get v/oct min and max
+			float voctmin;
+			float voctmax;
+			getVoctRange(voctmin, voctmax);
+
+			outputs[MINUSFIVETOFIVE_OUTPUT].setVoltage(scalemap(value, column->stats.min, column->stats.max, -5.f, 5.f));
+			outputs[ZEROTOTEN_OUTPUT].setVoltage(scalemap(value, column->stats.min, column->stats.max, 0.f, 10.f));
+			outputs[VOCT_OUTPUT].setVoltage(scalemap(value, column->stats.min, column->stats.max, voctmin, voctmax));
+			if (moved)
+				gatePulse.trigger(params[LENGTH_PARAM].getValue());
+		}
+
+		bool gpulse = gatePulse.process(args.sampleTime);
+		outputs[GATE_OUTPUT].setVoltage(gpulse ? 10.0 : 0.0);
+		bool epulse = endPulse.process(args.sampleTime);
+		outputs[END_OUTPUT].setVoltage(epulse ? 10.0 : 0.0);
+	}
+
+	// Plays the column as a waveform, the whole of it making one cycle. The
+	// pitch is picked up every four samples, which are worked out together.
+	// Triggers are ignored, reset restarts the cycle, and the end output
+	// pulses as each cycle ends.
+	void processOscillator(const ProcessArgs &args, const Dataset* dataset, const DataColumn* column)
+	{
+		setOutputChannels(1);
+		if (resetgate.process(inputs[RESET_INPUT].getVoltage()))
+		{
+			wavetable.reset();
+			oscindex = 4;
+		}
+
+		if (oscindex >= 4)
+		{
+			float pitch = clamp(params[FREQ_PARAM].getValue() + inputs[PITCH_INPUT].getVoltage(), -10.f, 10.f);
+			double step = dsp::FREQ_C4 * std::pow(2.f, pitch) * dataset->datalength * args.sampleTime;
+			Interpolation interp = static_cast<Interpolation>(interpolation.load(std::memory_order_relaxed));
+			simd::float_4 values;
+			if (wavetable.process(*column, dataset->datalength, step, interp, values))
+				endPulse.trigger(1e-3f);
+
+			// A column that's all one number sits at the bottom of the range
+			float datamin = column->stats.min;
+			float datarange = (column->stats.max > column->stats.min) ? column->stats.max - column->stats.min : 1.f;
+			oscblock = (values - datamin) / datarange;
+			oscindex = 0;
+
+			// For the display
+			row = static_cast<int>(wavetable.phase);
+		}
+
+		// Get v/oct min and max
+		float voctmin;
+		float voctmax;
+		getVoctRange(voctmin, voctmax);
+
+		// Rows without numbers play as silence in the middle of the range,
+		// with the gate low
+		float position = oscblock[oscindex++];
+		bool number = !std::isnan(position);
+		if (!number)
+			position = 0.5f;
+		outputs[MINUSFIVETOFIVE_OUTPUT].setVoltage(scalemap(position, 0.f, 1.f, -5.f, 5.f));
+		outputs[ZEROTOTEN_OUTPUT].setVoltage(scalemap(position, 0.f, 1.f, 0.f, 10.f));
+		outputs[VOCT_OUTPUT].setVoltage(scalemap(position, 0.f, 1.f, voctmin, voctmax));
+		outputs[GATE_OUTPUT].setVoltage(number ? 10.f : 0.f);
+
+		bool epulse = endPulse.process(args.sampleTime);
+		outputs[END_OUTPUT].setVoltage(epulse ? 10.0 : 0.0);
+	}
+
+	// Band-limited oscillators need the column's mipmaps. They're made as a
+	// file loads if they're wanted by then, otherwise from the rows already
+	// in memory, on the loader thread, so the file isn't read again.
+	void checkMipmaps()
+	{
+		if (!wantsMipmaps())
+			return;
+		// A load under way starts again, this time making them
+		if (loader.isBusy()) {
+			processCSV(currentpath);
+			return;
+		}
+		std::shared_ptr<const Dataset> dataset = datasets.latest();
+		const DataColumn* column = dataset ? dataset->getColumn(colnum) : NULL;
+		if (column && column->mipmaps.levels.empty() && dataset->datalength > 1 && !dataset->stream && dataset->followId == 0)
+			loader.addMipmaps(dataset, [this](std::shared_ptr<Dataset> dataset, const std::string& error) {
+				loaded(dataset, error);
+			});
+	}
+
+	bool wantsMipmaps() const
+	{
+		return oscillator && interpolation == INTERPOLATION_BANDLIMITED;
+	}
+
+	// Each trigger plays the next value that's come in, scaled to the range
+	// of the values so far. Nothing here waits or allocates, an empty ring
+	// just means no note.
+	void processLive(const ProcessArgs &args)
+	{
+		setOutputChannels(1);
+		if (resetgate.process(inputs[RESET_INPUT].getVoltage())) {
+			livemin = INFINITY;
+			livemax = -INFINITY;
+			livevalues.clear();
+		}
+
+		float value;
+		if (ingate.process(inputs[TRIG_INPUT].getVoltage()) && livevalues.pop(value) && !std::isnan(value))
+		{
+			livemin = std::min(livemin, value);
+			livemax = std::max(livemax, value);
+
+			// Get v/oct min and max
+			float voctmin;
+			float voctmax;
+			getVoctRange(voctmin, voctmax);
+
+			// Until there's a range, sit in the middle of it
+			float position = (livemax > livemin) ? scalemap(value, livemin, livemax, 0.f, 1.f) : 0.5f;
+			outputs[MINUSFIVETOFIVE_OUTPUT].setVoltage(scalemap(position, 0.f, 1.f, -5.f, 5.f));
+			outputs[ZEROTOTEN_OUTPUT].setVoltage(scalemap(position, 0.f, 1.f, 0.f, 10.f));
+			outputs[VOCT_OUTPUT].setVoltage(scalemap(position, 0.f, 1.f, voctmin, voctmax));
+			gatePulse.trigger(params[LENGTH_PARAM].getValue());
+		}
+
+		bool gpulse = gatePulse.process(1.0 / args.sampleRate);
+		outputs[GATE_OUTPUT].setVoltage(gpulse ? 10.0 : 0.0);
+		outputs[END_OUTPUT].setVoltage(0.f);
+	}
+
 	// Function to load a CSV file
 	void loadCSV()
 	{
@@ -235,7 +945,7 @@ struct LoudNumbers : Module
 		std::string dir = asset::user("../");
 
 		// Get a path from the user
-		char *pathC = osdialog_file(OSDIALOG_OPEN, dir.c_str(), NULL, osdialog_filters_parse("Source:csv"));
+		char *pathC = osdialog_file(OSDIALOG_OPEN, dir.c_str(), NULL, osdialog_filters_parse("Source:csv,gz,arrow,feather,arrows"));
 
 		// If nothing gets chosen, don't do anything
 		if (!pathC)
@@ -255,83 +965,91 @@ struct LoudNumbers : Module
 		csvloaded = true;
 	}
 
-	// Do some stuff with the CSV
+	// Start loading the CSV in the background. The audio thread picks the
+	// new data up once it has been parsed.
 	void processCSV(std::string path)
 	{
 		INFO("Processing CSV");
-		
-		try {
-			// Setting values that aren't numbers to NaN (rather than throwing error)
-			rapidcsv::Document doc(path, 
-								rapidcsv::LabelParams(),
-							rapidcsv::SeparatorParams(),
-							rapidcsv::ConverterParams(true /* pHasDefaultConverter */,
-														NAN /* pDefaultFloat */,
-														NAN /* pDefaultInteger */));
-			columns = doc.GetColumnNames();
-			data = doc.GetColumn<float>(columns[colnum]);
-
-			// Copy data to a new minmax vector
-			std::vector<float> minmax_data(data);
-
-			// Strip NaN values from it
-			minmax_data.erase(std::remove_if(std::begin(minmax_data), std::end(minmax_data),[](const float& value) { return std::isnan(value); }),std::end(minmax_data));
-
-			// Calculate minmax from the stripped vector	
-			datamin = *std::min_element(minmax_data.begin(), minmax_data.end());
-			datamax = *std::max_element(minmax_data.begin(), minmax_data.end());
 
-			firstrun = true;
-			row = -1; // because the first thing we do is increment it
-			datalength = static_cast<int>(data.size());
-			columnslength = static_cast<int>(columns.size());
-			if (currentpath != path) {
-				colnum = 0;
-				currentpath = path;
-			}
-			badcsv = false;
+		if (currentpath != path) {
+			colnum = 0;
+			timecolumn = -1;
+			setPolyColumns(std::vector<int>());
+			currentpath = path;
+		}
+		csvloaded = true;
 
-		} catch (...) {
-			badcsv = true;
-			WARN("ERROR: CSV file could not be read.");
+		LoadOptions options;
+		options.stream = streaming;
+		options.follow = follow;
+		options.timecolumn = timecolumn;
+		options.mipmaps = wantsMipmaps();
+		if (onecolumn) {
+			options.columns = polyselection;
+			options.columns.push_back(colnum);
 		}
+		loader.start(path, options, [this](std::shared_ptr<Dataset> dataset, const std::string& error) {
+			loaded(dataset, error);
+		});
  	}
+
+	// Called back on the loader thread when a load finishes
+	void loaded(std::shared_ptr<Dataset> dataset, const std::string& error)
+	{
+		if (dataset) {
+			datasets.publish(dataset);
+			badcsv = false;
+		} else {
+			badcsv = true;
+			WARN("ERROR: CSV file could not be read: %s", error.c_str());
+		}
+	}
 };
 
-// This is the dataviz display
-struct DataViz : Widget
+// True if the display shows the playing column, rather than a message
+static bool showsData(LoudNumbers* module)
 {
-	LoudNumbers *module; // NEW
+	return !module->live && !module->loader.isBusy() && !module->badcsv
+		&& module->datasets.displayed()->getColumn(module->colnum);
+}
+
+// The data line. It only changes with the data, so it's drawn into a
+// framebuffer by DataCurveBuffer rather than every frame.
+struct DataCurve : Widget
+{
+	LoudNumbers *module;
 
 	const float margin = mm2px(2.0);
 
-	void drawLayer(const DrawArgs &args, int layer) override
+	// The range of each pixel's rows
+	std::vector<float> envelopemins;
+	std::vector<float> envelopemaxs;
+
+	void draw(const DrawArgs &args) override
 	{
 		float width = box.size.x - 2 * margin;
 		float height = box.size.y - 2 * margin;
-		float circ_size = 1.f;
-		// The API states that the module  should only write to layer 1.
-		// And we don't want to run this until 'module' has actually been set.
-		if (layer == 1 && module)
-		{	
-			if (module->badcsv) {
-				nvgFillColor(args.vg, color::fromHexString(module->white));
-				nvgFontSize(args.vg, 14);
-				nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
-				nvgText(args.vg, width/2, height/2, "Invalid CSV", NULL);
-			} else {
-				// Draw the line
-				nvgBeginPath(args.vg);
-				bool firstpoint = true;
-				nvgMoveTo(args.vg, margin, height);
+		if (module && showsData(module))
+		{
+			const Dataset* dataset = module->datasets.displayed();
+			const DataColumn* column = dataset->getColumn(module->colnum);
+			const int first = module->viewstart;
+			const int count = std::min(module->viewcount, dataset->datalength - first);
+			const int pixels = std::max(static_cast<int>(width), 1);
 
-				for (int d = 0; d < module->datalength; d++)
+			// Draw the line
+			nvgBeginPath(args.vg);
+			bool firstpoint = true;
+			if (count <= pixels && !dataset->stream)
+			{
+				// Few enough rows in view for a point per row
+				for (int d = first; d < first + count; d++)
 				{
-					if (!std::isnan(module->data[d])) {
+					if (!std::isnan(column->values[d])) {
 						// Calculate x and y coords
-						float x = margin + (d * width / (module->datalength - 1));
+						float x = margin + ((d - first) * width / std::max(count - 1, 1));
 						// Y == zero at the TOP of the box.
-						float y = (height - 3) - (scalemap(module->data[d], module->datamin, module->datamax,
+						float y = (height - 3) - (scalemap(column->values[d], column->stats.min, column->stats.max,
 													0.f, height-6));
 
 						if (firstpoint) {
@@ -341,35 +1059,37 @@ struct DataViz : Widget
 							nvgLineTo(args.vg, x, y);
 						}
 					}
-					
 				}
-
-				nvgStrokeColor(args.vg, color::fromHexString(module->faded));
-				nvgStrokeWidth(args.vg, mm2px(0.3));
-				nvgStroke(args.vg);
-				nvgClosePath(args.vg);
-
-				// Draw the circle
-				for (int d = 0; d < module->datalength; d++)
+			}
+			else
+			{
+				// Otherwise draw the range of the rows under each pixel, from
+				// the overview, so long files and wide views cost no more than
+				// short ones
+				envelopemins.resize(pixels);
+				envelopemaxs.resize(pixels);
+				getColumnEnvelope(*dataset, module->colnum, first, first + count, pixels, envelopemins.data(), envelopemaxs.data());
+				for (int p = 0; p < pixels; p++)
 				{
-					if (d == module->row)
-					{
-						// Calculate x and y coords
-						float x = margin + (d * width / (module->datalength - 1));
-						// Y == zero at the TOP of the box.
-						float y = (height - 3) - (scalemap(module->data[d], module->datamin, module->datamax,
-														0.f, height-6));
-						// Draw a circle for each
-						nvgBeginPath(args.vg);
-						nvgCircle(args.vg, x, y, mm2px(circ_size));
-						nvgFillColor(args.vg, color::fromHexString(module->main));
-						nvgFill(args.vg);
-						nvgClosePath(args.vg);
+					if (std::isnan(envelopemins[p]))
+						continue;
+					float x = margin + ((p + 0.5f) * width / pixels);
+					float ymin = (height - 3) - (scalemap(envelopemins[p], column->stats.min, column->stats.max, 0.f, height-6));
+					float ymax = (height - 3) - (scalemap(envelopemaxs[p], column->stats.min, column->stats.max, 0.f, height-6));
+					if (firstpoint) {
+						nvgMoveTo(args.vg, x, ymin);
+						firstpoint = false;
+					} else {
+						nvgLineTo(args.vg, x, ymin);
 					}
+					nvgLineTo(args.vg, x, ymax);
 				}
-
 			}
-		} else {
+			nvgStrokeColor(args.vg, module->faded);
+			nvgStrokeWidth(args.vg, mm2px(0.3));
+			nvgStroke(args.vg);
+			nvgClosePath(args.vg);
+		} else if (!module) {
 			// Draw the line
 				nvgBeginPath(args.vg);
 				bool firstpoint = true;
@@ -380,7 +1100,7 @@ struct DataViz : Widget
 					// Calculate x and y coords
 					float x = margin + (d * width / defaultdatalength);
 					// Y == zero at the TOP of the box.
-					float y = (height - 3) - (scalemap(defaultdata[d], defaultdatamin, defaultdatamax,
+					float y = (height - 3) - (scalemap(defaultdata[d], defaultstats.min, defaultstats.max,
 												0.f, height-6));
 					if (firstpoint) {
 						nvgMoveTo(args.vg, x, y);
@@ -397,8 +1117,158 @@ struct DataViz : Widget
 				nvgClosePath(args.vg);
 
 		}
+	}
+};
+
+// Keeps the data line in a framebuffer, and only draws it again when the
+// dataset, column or size changes. The framebuffer goes on the light layer
+// like the rest of the display, so it stays bright with the room lights down.
+struct DataCurveBuffer : FramebufferWidget
+{
+	LoudNumbers *module;
+	DataCurve *curve;
+
+	// What the framebuffer was last drawn for
+	uint64_t drawngeneration = 0;
+	int drawncolumn = -1;
+	bool drawnshown = false;
+	int drawnstart = 0;
+	int drawncount = 0;
+	Vec drawnsize;
+
+	DataCurveBuffer(LoudNumbers *module)
+		: module(module)
+	{
+		curve = new DataCurve;
+		curve->module = module;
+		addChild(curve);
+	}
+
+	void step() override
+	{
+		if (module) {
+			uint64_t generation = module->datasets.displayed()->generation;
+			int column = module->colnum;
+			bool shown = showsData(module);
+			if (generation != drawngeneration || column != drawncolumn || shown != drawnshown
+				|| module->viewstart != drawnstart || module->viewcount != drawncount) {
+				drawngeneration = generation;
+				drawncolumn = column;
+				drawnshown = shown;
+				drawnstart = module->viewstart;
+				drawncount = module->viewcount;
+				setDirty();
+			}
+		}
+		if (box.size.x != drawnsize.x || box.size.y != drawnsize.y) {
+			drawnsize = box.size;
+			curve->box.size = box.size;
+			setDirty();
+		}
+		FramebufferWidget::step();
+	}
+
+	// Nothing on the usual layer, it would be dimmed with the room lights
+	void draw(const DrawArgs &args) override
+	{
+	}
+
+	void drawLayer(const DrawArgs &args, int layer) override
+	{
+		if (layer == 1)
+			FramebufferWidget::draw(args);
+	}
+};
+
+// This is the dataviz display. The line is drawn under it by DataCurveBuffer,
+// this only draws what changes every frame: the playhead and any messages.
+struct DataViz : Widget
+{
+	LoudNumbers *module; // NEW
+
+	const float margin = mm2px(2.0);
+
+	void drawLayer(const DrawArgs &args, int layer) override
+	{
+		float width = box.size.x - 2 * margin;
+		float height = box.size.y - 2 * margin;
+		float circ_size = 1.f;
+		// The API states that the module  should only write to layer 1.
+		// And we don't want to run this until 'module' has actually been set.
+		if (layer == 1 && module)
+		{	
+			if (module->live) {
+				std::string text = module->udp ? string::f("Live on UDP port %d", module->liveport) : module->liveerror;
+				nvgFillColor(args.vg, module->white);
+				nvgFontSize(args.vg, 14);
+				nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
+				nvgText(args.vg, width/2, height/2, text.c_str(), NULL);
+			} else if (module->loader.isBusy()) {
+				std::string text = string::f("Loading %d%%", (int) (module->loader.getProgress() * 100));
+				nvgFillColor(args.vg, module->white);
+				nvgFontSize(args.vg, 14);
+				nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
+				nvgText(args.vg, width/2, height/2, text.c_str(), NULL);
+			} else if (module->badcsv) {
+				nvgFillColor(args.vg, module->white);
+				nvgFontSize(args.vg, 14);
+				nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
+				nvgText(args.vg, width/2, height/2, "Invalid CSV", NULL);
+			} else if (!module->datasets.displayed()->getColumn(module->colnum)) {
+				const Dataset* dataset = module->datasets.displayed();
+				int col = module->colnum;
+				bool loaded = col < 0 || col >= static_cast<int>(dataset->data.size()) || dataset->data[col].loaded;
+				nvgFillColor(args.vg, module->white);
+				nvgFontSize(args.vg, 14);
+				nvgTextAlign(args.vg, NVG_ALIGN_CENTER);
+				nvgText(args.vg, width/2, height/2, loaded ? "No numbers in column" : "Column not loaded", NULL);
+			} else {
+				const Dataset* dataset = module->datasets.displayed();
+				const DataColumn* column = dataset->getColumn(module->colnum);
+				const int first = module->viewstart;
+				const int count = std::min(module->viewcount, dataset->datalength - first);
+
+				// Draw the circle, if its row is in view, has a number and has
+				// been read in
+				float value;
+				int row = module->row;
+				if (row >= first && row < first + count && dataset->getValue(module->colnum, row, value) && !std::isnan(value)) {
+					// Y == zero at the TOP of the box.
+					float x = margin + ((row - first) * width / std::max(count - 1, 1));
+					float y = (height - 3) - (scalemap(value, column->stats.min, column->stats.max, 0.f, height-6));
+					nvgBeginPath(args.vg);
+					nvgCircle(args.vg, x, y, mm2px(circ_size));
+					nvgFillColor(args.vg, module->main);
+					nvgFill(args.vg);
+					nvgClosePath(args.vg);
+				}
+			}
+		}
 		Widget::drawLayer(args, layer);
 	}
+
+	// The scroll wheel zooms in and out, around the playhead while the view
+	// follows it and around the mouse otherwise. Shift-scrolling moves along.
+	void onHoverScroll(const event::HoverScroll &e) override
+	{
+		if (!module || !showsData(module))
+			return;
+		int count = std::max(module->viewcount, 1);
+		float width = box.size.x - 2 * margin;
+		bool shift = (APP->window->getMods() & RACK_MOD_MASK) == GLFW_MOD_SHIFT;
+		if (shift || e.scrollDelta.x != 0.f) {
+			float delta = (e.scrollDelta.x != 0.f) ? e.scrollDelta.x : e.scrollDelta.y;
+			module->scrollView((delta > 0.f ? -1 : 1) * std::max(count / 8, 1));
+		} else if (e.scrollDelta.y != 0.f) {
+			int anchor;
+			if (module->viewfollow && module->row >= 0)
+				anchor = module->row;
+			else
+				anchor = module->viewstart + static_cast<int>(clamp((e.pos.x - margin) / width, 0.f, 1.f) * (count - 1));
+			module->zoomView(e.scrollDelta.y > 0.f ? 0.5f : 2.f, anchor);
+		}
+		e.consume(this);
+	}
 };
 
 struct LoudNumbersWidget : ModuleWidget
@@ -418,6 +1288,8 @@ struct LoudNumbersWidget : ModuleWidget
 
 		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(10, 78.221)), module, LoudNumbers::TRIG_INPUT));
 		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(25.34, 78.221)), module, LoudNumbers::RESET_INPUT));
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(40.69, 78.221)), module, LoudNumbers::POSITION_INPUT));
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(10, 106.5)), module, LoudNumbers::PITCH_INPUT));
 
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(10, 96.195)), module, LoudNumbers::END_OUTPUT));
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(25.34, 96.195)), module, LoudNumbers::MINUSFIVETOFIVE_OUTPUT));
@@ -425,23 +1297,44 @@ struct LoudNumbersWidget : ModuleWidget
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(56.03, 96.195)), module, LoudNumbers::VOCT_OUTPUT));
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(71.36, 96.195)), module, LoudNumbers::GATE_OUTPUT));
 
-		// Load and display dataviz widget
+		// Load and display dataviz widget, over the cached data line
+		DataCurveBuffer *data_curve = new DataCurveBuffer(module);
+		data_curve->box.pos = mm2px(Vec(6.736, 17.647));
+		data_curve->box.size = mm2px(Vec(67.832, 46.438));
+		addChild(data_curve);
+
 		DataViz *data_viz = createWidget<DataViz>(mm2px(Vec(6.736, 17.647)));
 		data_viz->box.size = mm2px(Vec(67.832, 46.438));
 		data_viz->module = module;
 		addChild(data_viz);
 	}
 
+	void step() override
+	{
+		// Before the display steps, so it draws the rows in view this frame
+		LoudNumbers* module = dynamic_cast<LoudNumbers*>(this->module);
+		if (module)
+			module->updateView();
+
+		ModuleWidget::step();
+
+		// Free any datasets the audio thread has finished with
+		if (module)
+			module->datasets.collect();
+	}
+
 	struct ColumnMenuItem : MenuItem 
 	{
 		LoudNumbers *module;
 		int val;
 		void onAction(const event::Action &e) override {
-			if (module->csvloaded)
-			{
-				module->colnum = val;
+			// Usually every column is already loaded, so this is just an index
+			// change. Data from the patch, or a file loaded a column at a time,
+			// might not have this one, so then it comes from the file.
+			module->colnum = val;
+			const Dataset* dataset = module->datasets.displayed();
+			if (val < static_cast<int>(dataset->data.size()) && !dataset->data[val].loaded)
 				module->processCSV(module->currentpath);
-			}
 		}
 		void step() override {
 			rightText = (module->colnum == val) ? "✔" : "";
@@ -463,13 +1356,237 @@ struct LoudNumbersWidget : ModuleWidget
 										  module->loadCSV();
 									  }));
 
+		// Read huge files from disk as they play, reloading whatever is loaded
+		menu->addChild(createBoolMenuItem("Stream from disk (huge files)", "",
+										  [=]()
+										  {
+											  return module->streaming;
+										  },
+										  [=](bool streaming)
+										  {
+											  module->streaming = streaming;
+											  if (module->csvloaded)
+												  module->processCSV(module->currentpath);
+										  }));
+
+		// Wide files load much faster a column at a time, at the cost of a
+		// reload whenever the column changes
+		menu->addChild(createBoolMenuItem("Load playing column only", "",
+										  [=]()
+										  {
+											  return module->onecolumn;
+										  },
+										  [=](bool onecolumn)
+										  {
+											  module->onecolumn = onecolumn;
+											  if (module->csvloaded && !onecolumn)
+												  module->processCSV(module->currentpath);
+										  }));
+
+		// Pick up rows as they're added to the file, for logs and live feeds
+		menu->addChild(createBoolMenuItem("Follow file as it grows", "",
+										  [=]()
+										  {
+											  return module->follow;
+										  },
+										  [=](bool follow)
+										  {
+											  module->follow = follow;
+											  if (module->csvloaded)
+												  module->processCSV(module->currentpath);
+										  }));
+
+		// Play numbers sent from another program instead of the file
+		menu->addChild(createBoolMenuItem(string::f("Live data on UDP port %d", module->liveport), "",
+										  [=]()
+										  {
+											  return module->live.load();
+										  },
+										  [=](bool live)
+										  {
+											  if (live)
+												  module->startLive();
+											  else
+												  module->stopLive();
+										  }));
+		if (module->live && module->udp)
+		{
+			// How many values came in, and how many were lost because the
+			// ring was full or there was nothing there for a trigger
+			menu->addChild(createMenuLabel(string::f("Received %llu, overruns %llu, underruns %llu",
+				(unsigned long long) module->udp->getValues(),
+				(unsigned long long) module->livevalues.getOverruns(),
+				(unsigned long long) module->livevalues.getUnderruns())));
+			if (module->udp->getMalformed())
+				menu->addChild(createMenuLabel(string::f("Unreadable packets %llu", (unsigned long long) module->udp->getMalformed())));
+		}
+
+		// Space the rows out like the times in one of the columns, instead of
+		// playing them on triggers. The times are read when the file loads.
+		std::vector<std::string> names = module->datasets.displayed()->columns;
+		int timecolumn = module->timecolumn;
+		std::string timename = (timecolumn >= 0 && timecolumn < static_cast<int>(names.size())) ? names[timecolumn] : "Off";
+		menu->addChild(createSubmenuItem("Play at times from column", timename,
+										 [=](Menu* menu)
+										 {
+											 menu->addChild(createCheckMenuItem("Off (play on triggers)", "",
+																				[=]()
+																				{
+																					return module->timecolumn < 0;
+																				},
+																				[=]()
+																				{
+																					module->timecolumn = -1;
+																					if (module->csvloaded)
+																						module->processCSV(module->currentpath);
+																				}));
+											 for (int i = 0; i < static_cast<int>(names.size()); i++)
+											 {
+												 menu->addChild(createCheckMenuItem(names[i], "",
+																					[=]()
+																					{
+																						return module->timecolumn == i;
+																					},
+																					[=]()
+																					{
+																						module->timecolumn = i;
+																						if (module->csvloaded)
+																							module->processCSV(module->currentpath);
+																					}));
+											 }
+										 }));
+		if (timecolumn >= 0)
+		{
+			ui::Slider* speed = new ui::Slider;
+			speed->quantity = module->getParamQuantity(LoudNumbers::SPEED_PARAM);
+			speed->box.size.x = 200.f;
+			menu->addChild(speed);
+		}
+
+		// Play several columns at once, one on each channel of the outputs.
+		// The menu stays open so a few can be picked in one go.
+		std::string polyname = module->polyselection.empty() ? "Off" : string::f("%d channels", (int) module->polyselection.size());
+		menu->addChild(createSubmenuItem("Polyphonic columns", polyname,
+										 [=](Menu* menu)
+										 {
+											 menu->addChild(createCheckMenuItem("Off (play one column)", "",
+																				[=]()
+																				{
+																					return module->polyselection.empty();
+																				},
+																				[=]()
+																				{
+																					module->setPolyColumns(std::vector<int>());
+																				}));
+											 for (int i = 0; i < static_cast<int>(names.size()); i++)
+											 {
+												 bool picked = std::find(module->polyselection.begin(), module->polyselection.end(), i) != module->polyselection.end();
+												 bool full = module->polyselection.size() >= LoudNumbers::maxpolychannels;
+												 menu->addChild(createCheckMenuItem(names[i], "",
+																					[=]()
+																					{
+																						const std::vector<int>& picked = module->polyselection;
+																						return std::find(picked.begin(), picked.end(), i) != picked.end();
+																					},
+																					[=]()
+																					{
+																						std::vector<int> columns = module->polyselection;
+																						std::vector<int>::iterator it = std::find(columns.begin(), columns.end(), i);
+																						if (it != columns.end())
+																							columns.erase(it);
+																						else
+																							columns.push_back(i);
+																						module->setPolyColumns(columns);
+
+																						// A file loaded a column at a time needs this one too
+																						const Dataset* dataset = module->datasets.displayed();
+																						if (module->csvloaded && i < static_cast<int>(dataset->data.size()) && !dataset->data[i].loaded)
+																							module->processCSV(module->currentpath);
+																					},
+																					full && !picked, true));
+											 }
+										 }));
+
+		// Sweeping the position input slowly steps through the rows, unless
+		// this smooths it out
+		menu->addChild(createBoolMenuItem("Glide between rows on position input", "",
+										  [=]()
+										  {
+											  return module->smoothposition.load();
+										  },
+										  [=](bool smooth)
+										  {
+											  module->smoothposition = smooth;
+										  }));
+
+		// Play the column as a waveform, for using data as a sound source
+		menu->addChild(createBoolMenuItem("Oscillator mode", "",
+										  [=]()
+										  {
+											  return module->oscillator.load();
+										  },
+										  [=](bool oscillator)
+										  {
+											  module->oscillator = oscillator;
+											  module->checkMipmaps();
+										  }));
+		if (module->oscillator)
+		{
+			menu->addChild(createIndexSubmenuItem("Interpolation", {"Linear", "Cubic", "Band-limited"},
+												  [=]()
+												  {
+													  return module->interpolation.load();
+												  },
+												  [=](int interpolation)
+												  {
+													  module->interpolation = interpolation;
+													  module->checkMipmaps();
+												  }));
+			ui::Slider* freq = new ui::Slider;
+			freq->quantity = module->getParamQuantity(LoudNumbers::FREQ_PARAM);
+			freq->box.size.x = 200.f;
+			menu->addChild(freq);
+		}
+
+		// Scrolling over the display zooms in, these go back to the whole
+		// column and pick whether the view keeps up with the playhead
+		menu->addChild(createMenuItem("Show whole column", "",
+									  [=]()
+									  {
+										  module->viewrows = 0;
+									  },
+									  module->viewrows == 0));
+		menu->addChild(createBoolPtrMenuItem("Display follows playhead", "", &module->viewfollow));
+
+		// Keep the playing column in the patch, in case the file goes missing
+		menu->addChild(createBoolPtrMenuItem("Save data in patch", "", &module->embed));
+
+		// The cache keeps itself under a limit, but it can be big
+		uint64_t cachesize = getDatasetCacheSize(module->loader.getCacheDir());
+		menu->addChild(createMenuItem("Clear cached files", string::f("%.1f MB", cachesize / 1e6),
+									  [=]()
+									  {
+										  clearDatasetCache(module->loader.getCacheDir());
+									  }));
+
+		// Give up on a slow load
+		if (module->loader.isBusy())
+		{
+			menu->addChild(createMenuItem("Cancel loading", "",
+										  [=]()
+										  {
+											  module->loader.cancel();
+										  }));
+		}
+
 		// Spacer
 		menu->addChild(new MenuSeparator());
 
-		for (int i = 0; i < module->columnslength; i++) 
+		const Dataset* dataset = module->datasets.displayed();
+		for (int i = 0; i < static_cast<int>(dataset->columns.size()); i++) 
 		{
 			ColumnMenuItem *item = new ColumnMenuItem();
-			item->text = module->columns[i];
+			item->text = dataset->columns[i];
 			item->val = i;
 			item->module = module;
 			menu->addChild(item);
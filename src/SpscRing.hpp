@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// A fixed-size queue between one producer thread and one consumer thread,
+// like the network thread and the audio thread. Neither side ever locks,
+// waits or allocates.
+//
+// The positions only ever count up, and are wrapped into the buffer when
+// used, so full and empty are easy to tell apart. Each side keeps its own
+// position on its own cache line.
+template <typename T>
+struct SpscRing
+{
+	// The capacity is rounded up to a power of two
+	explicit SpscRing(size_t capacity)
+	{
+		size_t size = 1;
+		while (size < capacity)
+			size *= 2;
+		items.reset(new T[size]);
+		mask = size - 1;
+	}
+
+	size_t getCapacity() const
+	{
+		return mask + 1;
+	}
+
+	// Producer only. Returns false, and counts an overrun, if it's full.
+	bool push(const T& item)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) > mask) {
+			overruns.store(overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return false;
+		}
+		items[h & mask] = item;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only. Returns false, and counts an underrun, if it's empty.
+	bool pop(T& item)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) {
+			underruns.store(underruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return false;
+		}
+		item = items[t & mask];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only. Throws away everything waiting.
+	void clear()
+	{
+		tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+	// Any thread, roughly how many are waiting
+	size_t size() const
+	{
+		// The tail can't pass the head, as long as it's read first
+		size_t t = tail.load(std::memory_order_acquire);
+		return head.load(std::memory_order_acquire) - t;
+	}
+
+	// Any thread. Pushes that found it full, and pops that found it empty.
+	uint64_t getOverruns() const
+	{
+		return overruns.load(std::memory_order_relaxed);
+	}
+
+	uint64_t getUnderruns() const
+	{
+		return underruns.load(std::memory_order_relaxed);
+	}
+
+private:
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	std::unique_ptr<T[]> items;
+	size_t mask;
+
+	// Written by the producer
+	std::atomic<size_t> head{0};
+	std::atomic<uint64_t> overruns{0};
+	char producerPadding[64];
+	// Written by the consumer
+	std::atomic<size_t> tail{0};
+	std::atomic<uint64_t> underruns{0};
+	char consumerPadding[64];
+};
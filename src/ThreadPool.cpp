@@ -0,0 +1,140 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(int threads)
+{
+	threads = std::max(threads, 1);
+	for (int i = 0; i < threads; i++)
+		queues.emplace_back(new Queue);
+	for (int i = 0; i < threads; i++)
+		workers.emplace_back(&ThreadPool::work, this, static_cast<size_t>(i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	// Never deleted, so nothing waits on the workers while the plugin is being
+	// unloaded. On Windows they're already gone by then and joining them hangs.
+	static ThreadPool* pool = new ThreadPool(std::min(std::max(static_cast<int>(std::thread::hardware_concurrency()), 1), 8));
+	return *pool;
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+	if (count == 0)
+		return;
+	if (count == 1) {
+		fn(0);
+		return;
+	}
+
+	Batch batch;
+	batch.fn = &fn;
+	batch.remaining = count;
+	batch.failed = false;
+
+	// Deal the tasks out round robin, then wake everyone up. They're counted
+	// before any of them can be taken, or a worker taking one could count
+	// below zero and never sleep again.
+	{
+		std::lock_guard<std::mutex> sleepLock(sleepMutex);
+		queued += count;
+		for (size_t i = 0; i < count; i++)
+		{
+			Queue& queue = *queues[i % queues.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back(Task{&batch, i});
+		}
+	}
+	wake.notify_all();
+
+	// Help out until there's nothing left to take, then wait for the stragglers
+	Task task;
+	while (batch.remaining.load() > 0 && pop(queues.size(), task))
+		runTask(task);
+	{
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		finished.wait(lock, [&] { return batch.remaining.load() == 0; });
+	}
+
+	if (batch.error)
+		std::rethrow_exception(batch.error);
+}
+
+bool ThreadPool::pop(size_t self, Task& task)
+{
+	// Our own queue first, from the front
+	if (self < queues.size()) {
+		Queue& queue = *queues[self];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+			queued--;
+			return true;
+		}
+	}
+
+	// Then steal from the back of everyone else's
+	for (size_t i = 1; i <= queues.size(); i++)
+	{
+		Queue& queue = *queues[(self + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+			queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::runTask(const Task& task)
+{
+	Batch& batch = *task.batch;
+	if (!batch.failed.load()) {
+		try {
+			(*batch.fn)(task.index);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(batch.errorMutex);
+			if (!batch.error)
+				batch.error = std::current_exception();
+			batch.failed = true;
+		}
+	}
+
+	if (--batch.remaining == 0) {
+		// Take the lock so the waiting thread can't miss this
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		finished.notify_all();
+	}
+}
+
+void ThreadPool::work(size_t self)
+{
+	while (true)
+	{
+		Task task;
+		if (pop(self, task)) {
+			runTask(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [&] { return quit || queued.load() > 0; });
+		if (quit)
+			return;
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing thread pool for splitting up big loads.
+//
+// Each worker has its own queue and takes work from the front of it. A worker
+// that runs dry steals from the back of the others, so uneven tasks still
+// keep every thread busy. The thread waiting on a batch helps run it rather
+// than sitting idle.
+struct ThreadPool
+{
+	explicit ThreadPool(int threads);
+	~ThreadPool();
+
+	// Runs fn(0) to fn(count - 1) across the pool and returns when they're all
+	// done. If any of them throw, the rest are skipped and the first exception
+	// is rethrown here.
+	void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+	int getThreads() const
+	{
+		return static_cast<int>(workers.size());
+	}
+
+	// Shared by all modules. Sized to the machine, up to 8 threads, since
+	// loading is mostly memory bound beyond that. It lasts until Rack quits.
+	static ThreadPool& shared();
+
+private:
+	struct Batch
+	{
+		const std::function<void(size_t)>* fn;
+		std::atomic<size_t> remaining;
+		std::atomic<bool> failed;
+		std::exception_ptr error;
+		std::mutex errorMutex;
+	};
+
+	struct Task
+	{
+		Batch* batch;
+		size_t index;
+	};
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	bool pop(size_t self, Task& task);
+	void runTask(const Task& task);
+	void work(size_t self);
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<Queue>> queues; // one per worker
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	std::atomic<size_t> queued{0};
+	bool quit = false;
+};
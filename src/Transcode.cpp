@@ -0,0 +1,318 @@
+#include "Transcode.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+// Windows-1252 differs from Latin-1 only in 0x80 to 0x9F. The five bytes it
+// leaves undefined map to the matching control characters, like browsers do.
+static const uint16_t cp1252High[32] = {
+	0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+	0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+	0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+	0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178,
+};
+
+static inline char* putUtf8(char* o, uint32_t c)
+{
+	if (c < 0x80) {
+		*o++ = static_cast<char>(c);
+	} else if (c < 0x800) {
+		*o++ = static_cast<char>(0xC0 | (c >> 6));
+		*o++ = static_cast<char>(0x80 | (c & 0x3F));
+	} else if (c < 0x10000) {
+		*o++ = static_cast<char>(0xE0 | (c >> 12));
+		*o++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+		*o++ = static_cast<char>(0x80 | (c & 0x3F));
+	} else {
+		*o++ = static_cast<char>(0xF0 | (c >> 18));
+		*o++ = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+		*o++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+		*o++ = static_cast<char>(0x80 | (c & 0x3F));
+	}
+	return o;
+}
+
+// True if the text is UTF-8, allowing for a character cut off at the end
+static bool isUtf8(const unsigned char* s, size_t size, bool truncated)
+{
+	size_t i = 0;
+	while (i < size)
+	{
+		unsigned char c = s[i];
+		if (c < 0x80) {
+			i++;
+			continue;
+		}
+
+		size_t length;
+		unsigned char lo = 0x80, hi = 0xBF; // allowed range of the second byte
+		if (c >= 0xC2 && c <= 0xDF) {
+			length = 2;
+		} else if (c >= 0xE0 && c <= 0xEF) {
+			length = 3;
+			if (c == 0xE0)
+				lo = 0xA0;
+			else if (c == 0xED)
+				hi = 0x9F;
+		} else if (c >= 0xF0 && c <= 0xF4) {
+			length = 4;
+			if (c == 0xF0)
+				lo = 0x90;
+			else if (c == 0xF4)
+				hi = 0x8F;
+		} else {
+			return false;
+		}
+
+		if (i + length > size)
+			return truncated;
+		if (s[i + 1] < lo || s[i + 1] > hi)
+			return false;
+		for (size_t k = 2; k < length; k++)
+		{
+			if ((s[i + k] & 0xC0) != 0x80)
+				return false;
+		}
+		i += length;
+	}
+	return true;
+}
+
+TextEncoding detectEncoding(const char* data, size_t size, size_t& bomLength)
+{
+	const unsigned char* s = reinterpret_cast<const unsigned char*>(data);
+	bomLength = 0;
+	if (size >= 3 && s[0] == 0xEF && s[1] == 0xBB && s[2] == 0xBF) {
+		bomLength = 3;
+		return ENCODING_UTF8;
+	}
+	if (size >= 2 && s[0] == 0xFF && s[1] == 0xFE) {
+		bomLength = 2;
+		return ENCODING_UTF16LE;
+	}
+	if (size >= 2 && s[0] == 0xFE && s[1] == 0xFF) {
+		bomLength = 2;
+		return ENCODING_UTF16BE;
+	}
+
+	// Mostly-ASCII UTF-16 has a zero in every other byte
+	size_t sample = std::min<size_t>(size, 64 << 10);
+	size_t evenZeros = 0, oddZeros = 0;
+	for (size_t i = 0; i < sample; i++)
+	{
+		if (s[i] == 0)
+			(i & 1 ? oddZeros : evenZeros)++;
+	}
+	if (evenZeros + oddZeros > sample / 4) {
+		if (oddZeros > 4 * evenZeros)
+			return ENCODING_UTF16LE;
+		if (evenZeros > 4 * oddZeros)
+			return ENCODING_UTF16BE;
+	}
+
+	if (!isUtf8(s, sample, sample < size))
+		return ENCODING_WINDOWS1252;
+	return ENCODING_UTF8;
+}
+
+const char* getEncodingName(TextEncoding encoding)
+{
+	switch (encoding)
+	{
+		case ENCODING_UTF16LE: return "UTF-16LE";
+		case ENCODING_UTF16BE: return "UTF-16BE";
+		case ENCODING_WINDOWS1252: return "Windows-1252";
+		default: return "UTF-8";
+	}
+}
+
+template <bool bigEndian>
+static inline uint16_t loadUnit(const unsigned char* p)
+{
+	return bigEndian ? static_cast<uint16_t>(p[0] << 8 | p[1]) : static_cast<uint16_t>(p[1] << 8 | p[0]);
+}
+
+template <bool bigEndian>
+static size_t utf16ToUtf8(const char* data, size_t size, bool final, std::string& out)
+{
+	const unsigned char* s = reinterpret_cast<const unsigned char*>(data);
+	size_t start = out.size();
+	// At most 3 bytes per unit, and a stray byte at the end
+	out.resize(start + size / 2 * 3 + 3);
+	char* o = &out[start];
+
+	size_t i = 0;
+	bool cut = false; // stopped at half a surrogate pair
+	while (i + 2 <= size && !cut)
+	{
+		size_t groupEnd = i + 32;
+#if defined(__SSE2__)
+		if (groupEnd <= size) {
+			// 16 units at once, if they're all ASCII they pack straight down to bytes
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + 16));
+			if (bigEndian) {
+				a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+				b = _mm_or_si128(_mm_slli_epi16(b, 8), _mm_srli_epi16(b, 8));
+			}
+			__m128i high = _mm_and_si128(_mm_or_si128(a, b), _mm_set1_epi16(static_cast<short>(0xFF80)));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) == 0xFFFF) {
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(o), _mm_packus_epi16(a, b));
+				o += 16;
+				i = groupEnd;
+				continue;
+			}
+		}
+#endif
+		// Otherwise a character at a time up to the end of the group
+		groupEnd = std::min(groupEnd, size);
+		while (i + 2 <= groupEnd)
+		{
+			uint32_t c = loadUnit<bigEndian>(s + i);
+			if (c < 0x80) {
+				*o++ = static_cast<char>(c);
+				i += 2;
+				continue;
+			}
+			if ((c & 0xFC00) == 0xD800) {
+				if (i + 4 > size) {
+					// The other half might be in the next piece
+					if (!final) {
+						cut = true;
+						break;
+					}
+					c = 0xFFFD;
+					i += 2;
+				} else {
+					uint32_t d = loadUnit<bigEndian>(s + i + 2);
+					if ((d & 0xFC00) == 0xDC00) {
+						c = 0x10000 + ((c - 0xD800) << 10) + (d - 0xDC00);
+						i += 4;
+					} else {
+						c = 0xFFFD;
+						i += 2;
+					}
+				}
+			} else {
+				if ((c & 0xFC00) == 0xDC00)
+					c = 0xFFFD;
+				i += 2;
+			}
+			o = putUtf8(o, c);
+		}
+	}
+	if (final && i < size) {
+		o = putUtf8(o, 0xFFFD);
+		i = size;
+	}
+
+	out.resize(o - out.data());
+	return i;
+}
+
+static size_t cp1252ToUtf8(const char* data, size_t size, std::string& out)
+{
+	const unsigned char* s = reinterpret_cast<const unsigned char*>(data);
+	size_t start = out.size();
+	out.resize(start + size * 3);
+	char* o = &out[start];
+
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t groupEnd = i + 16;
+#if defined(__SSE2__)
+		if (groupEnd <= size) {
+			// ASCII copies straight across, 16 bytes at a time
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+			if (_mm_movemask_epi8(v) == 0) {
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(o), v);
+				o += 16;
+				i = groupEnd;
+				continue;
+			}
+		}
+#endif
+		groupEnd = std::min(groupEnd, size);
+		for (; i < groupEnd; i++)
+		{
+			unsigned char c = s[i];
+			if (c < 0x80)
+				*o++ = static_cast<char>(c);
+			else if (c < 0xA0)
+				o = putUtf8(o, cp1252High[c - 0x80]);
+			else
+				o = putUtf8(o, c);
+		}
+	}
+
+	out.resize(o - out.data());
+	return size;
+}
+
+size_t transcodeToUtf8(TextEncoding encoding, const char* data, size_t size, bool final, std::string& out)
+{
+	switch (encoding)
+	{
+		case ENCODING_UTF16LE: return utf16ToUtf8<false>(data, size, final, out);
+		case ENCODING_UTF16BE: return utf16ToUtf8<true>(data, size, final, out);
+		case ENCODING_WINDOWS1252: return cp1252ToUtf8(data, size, out);
+		default:
+			out.append(data, size);
+			return size;
+	}
+}
+
+size_t transcodedLength(TextEncoding encoding, const char* utf8, size_t size)
+{
+	if (encoding == ENCODING_UTF8)
+		return size;
+
+	// Count characters by their first byte. In UTF-16 those beyond the
+	// basic plane, four bytes in UTF-8, took a pair of units.
+	size_t length = 0;
+	for (size_t i = 0; i < size; i++)
+	{
+		unsigned char c = static_cast<unsigned char>(utf8[i]);
+		if ((c & 0xC0) == 0x80)
+			continue;
+		if (encoding == ENCODING_WINDOWS1252)
+			length += 1;
+		else
+			length += (c >= 0xF0) ? 4 : 2;
+	}
+	return length;
+}
+
+size_t findNewline(TextEncoding encoding, const char* data, size_t from, size_t size)
+{
+	if (encoding != ENCODING_UTF16LE && encoding != ENCODING_UTF16BE) {
+		const char* p = static_cast<const char*>(std::memchr(data + from, '\n', size - from));
+		return p ? p - data : size;
+	}
+
+	// A newline unit is 0A 00 or 00 0A, starting on an even byte
+	size_t low = (encoding == ENCODING_UTF16LE) ? 0 : 1;
+	size_t i = from + low;
+	while (i < size)
+	{
+		const char* p = static_cast<const char*>(std::memchr(data + i, '\n', size - i));
+		if (!p)
+			break;
+		size_t at = p - data;
+		size_t unit = at - low;
+		if ((unit & 1) == 0 && unit + 1 < size && data[unit + (1 - low)] == 0)
+			return unit;
+		i = at + 1;
+	}
+	return size;
+}
+
+size_t newlineLength(TextEncoding encoding)
+{
+	return (encoding == ENCODING_UTF16LE || encoding == ENCODING_UTF16BE) ? 2 : 1;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Text encodings we can read. Everything is converted to UTF-8 before parsing.
+enum TextEncoding
+{
+	ENCODING_UTF8,
+	ENCODING_UTF16LE,
+	ENCODING_UTF16BE,
+	ENCODING_WINDOWS1252,
+};
+
+// Works out the encoding from the start of a file. A byte order mark decides
+// it if there is one, and bomLength is set to its size. Otherwise UTF-16 is
+// spotted by its zero bytes, and anything that isn't valid UTF-8 is taken to
+// be Windows-1252, which is what Excel saves "CSV" as on Windows.
+TextEncoding detectEncoding(const char* data, size_t size, size_t& bomLength);
+
+const char* getEncodingName(TextEncoding encoding);
+
+// Converts text to UTF-8, appending it to out. A character cut off at the end
+// of the input is left for the next call unless final is set, in which case
+// it becomes U+FFFD. Returns the number of input bytes used.
+//
+// Runs of ASCII, which is most of any CSV, are converted 16 characters at a
+// time with SSE2 when it's available.
+size_t transcodeToUtf8(TextEncoding encoding, const char* data, size_t size, bool final, std::string& out);
+
+// How many bytes of the original encoding some converted text came from
+size_t transcodedLength(TextEncoding encoding, const char* utf8, size_t size);
+
+// The offset of the first newline at or after `from`, or size if there isn't
+// one. `from` has to be on a character boundary.
+size_t findNewline(TextEncoding encoding, const char* data, size_t from, size_t size);
+
+// Bytes per newline: 2 in UTF-16, 1 otherwise
+size_t newlineLength(TextEncoding encoding);
@@ -0,0 +1,262 @@
+#include "UdpSource.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+
+// Bundles inside bundles are only followed this deep
+static const int maxBundleDepth = 8;
+
+static uint32_t readBig32(const uint8_t* p)
+{
+	return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64_t readBig64(const uint8_t* p)
+{
+	return (static_cast<uint64_t>(readBig32(p)) << 32) | readBig32(p + 4);
+}
+
+// Length of an OSC string with its terminator and padding, or 0 if it runs
+// off the end
+static size_t oscStringLength(const uint8_t* p, size_t size)
+{
+	const void* end = std::memchr(p, '\0', size);
+	if (!end)
+		return 0;
+	size_t length = (static_cast<const uint8_t*>(end) - p + 4) & ~size_t(3);
+	return (length <= size) ? length : 0;
+}
+
+#if defined(_WIN32)
+
+static void closeSocket(uintptr_t sock)
+{
+	closesocket(static_cast<SOCKET>(sock));
+}
+
+#else
+
+static void closeSocket(int sock)
+{
+	::close(sock);
+}
+
+#endif
+
+UdpSource::UdpSource(int port, SpscRing<float>& ring)
+	: port(port)
+	, ring(ring)
+{
+#if defined(_WIN32)
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		throw std::runtime_error("could not start networking");
+	SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s == INVALID_SOCKET) {
+		WSACleanup();
+		throw std::runtime_error("could not open a socket");
+	}
+	sock = static_cast<uintptr_t>(s);
+	// Wake up regularly to see if it's time to stop
+	DWORD timeout = 100;
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+#else
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0)
+		throw std::runtime_error("could not open a socket");
+	// Wake up regularly to see if it's time to stop
+	timeval timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 100000;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+
+	// Only programs on this computer can send to it
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<uint16_t>(port));
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(sock, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+		closeSocket(sock);
+#if defined(_WIN32)
+		WSACleanup();
+#endif
+		throw std::runtime_error("could not listen on UDP port " + std::to_string(port));
+	}
+
+	worker = std::thread(&UdpSource::run, this);
+}
+
+UdpSource::~UdpSource()
+{
+	quit = true;
+	worker.join();
+	closeSocket(sock);
+#if defined(_WIN32)
+	WSACleanup();
+#endif
+}
+
+void UdpSource::run()
+{
+	std::vector<uint8_t> buffer(65536);
+	while (!quit)
+	{
+		int got = recv(sock, reinterpret_cast<char*>(buffer.data()), static_cast<int>(buffer.size()), 0);
+		if (got > 0)
+			receive(buffer.data(), got);
+	}
+}
+
+void UdpSource::receive(const uint8_t* data, size_t size)
+{
+	if (size >= 4 && std::memcmp(data, "LNUM", 4) == 0) {
+		if ((size - 4) % 4 != 0) {
+			malformed++;
+			return;
+		}
+		for (size_t i = 4; i < size; i += 4)
+		{
+			uint32_t bits = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16) | (static_cast<uint32_t>(data[i + 3]) << 24);
+			float value;
+			std::memcpy(&value, &bits, sizeof(value));
+			ring.push(value);
+			values++;
+		}
+		return;
+	}
+
+	if (!receiveOsc(data, size, 0))
+		malformed++;
+}
+
+// Queues the values in an OSC packet. Returns false if it isn't valid OSC,
+// though any values before the problem are still queued.
+bool UdpSource::receiveOsc(const uint8_t* data, size_t size, int depth)
+{
+	if (size >= 16 && std::memcmp(data, "#bundle", 8) == 0) {
+		if (depth >= maxBundleDepth)
+			return false;
+		// Skip the time tag, then each element comes with its size
+		size_t p = 16;
+		while (p < size)
+		{
+			if (size - p < 4)
+				return false;
+			size_t length = readBig32(data + p);
+			p += 4;
+			if (length > size - p || !receiveOsc(data + p, length, depth + 1))
+				return false;
+			p += length;
+		}
+		return true;
+	}
+
+	if (size == 0 || data[0] != '/')
+		return false;
+	size_t p = oscStringLength(data, size);
+	if (p == 0 || p == size || data[p] != ',')
+		return false;
+	const uint8_t* tags = data + p + 1;
+	size_t tagsLength = oscStringLength(data + p, size - p);
+	if (tagsLength == 0)
+		return false;
+	p += tagsLength;
+
+	for (const uint8_t* tag = tags; *tag; tag++)
+	{
+		size_t left = size - p;
+		switch (*tag)
+		{
+			case 'i':
+				if (left < 4)
+					return false;
+				ring.push(static_cast<float>(static_cast<int32_t>(readBig32(data + p))));
+				values++;
+				p += 4;
+				break;
+			case 'f': {
+				if (left < 4)
+					return false;
+				uint32_t bits = readBig32(data + p);
+				float value;
+				std::memcpy(&value, &bits, sizeof(value));
+				ring.push(value);
+				values++;
+				p += 4;
+				break;
+			}
+			case 'h':
+				if (left < 8)
+					return false;
+				ring.push(static_cast<float>(static_cast<int64_t>(readBig64(data + p))));
+				values++;
+				p += 8;
+				break;
+			case 'd': {
+				if (left < 8)
+					return false;
+				uint64_t bits = readBig64(data + p);
+				double value;
+				std::memcpy(&value, &bits, sizeof(value));
+				ring.push(static_cast<float>(value));
+				values++;
+				p += 8;
+				break;
+			}
+			// Everything else is skipped over
+			case 's':
+			case 'S': {
+				size_t length = oscStringLength(data + p, left);
+				if (length == 0)
+					return false;
+				p += length;
+				break;
+			}
+			case 'b': {
+				if (left < 4)
+					return false;
+				size_t length = (static_cast<size_t>(readBig32(data + p)) + 3) & ~size_t(3);
+				if (length > left - 4)
+					return false;
+				p += 4 + length;
+				break;
+			}
+			case 'c':
+			case 'r':
+			case 'm':
+				if (left < 4)
+					return false;
+				p += 4;
+				break;
+			case 't':
+				if (left < 8)
+					return false;
+				p += 8;
+				break;
+			case 'T':
+			case 'F':
+			case 'N':
+			case 'I':
+			case '[':
+			case ']':
+				break;
+			default:
+				return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include "SpscRing.hpp"
+
+// Receives numbers sent to a UDP port on this computer and queues them for
+// the audio thread, for playing live data from another program.
+//
+// Packets can be OSC or bare frames. Every int, float and double argument of
+// an OSC message is a value, whatever the address, and bundles are unpacked.
+// A bare frame is the four bytes "LNUM" followed by any number of 32 bit
+// little-endian floats.
+//
+// Values that arrive when the ring is full are dropped and counted as
+// overruns by the ring.
+struct UdpSource
+{
+	// Starts listening straight away. Throws std::runtime_error if the port
+	// can't be opened.
+	UdpSource(int port, SpscRing<float>& ring);
+	~UdpSource();
+
+	int getPort() const
+	{
+		return port;
+	}
+
+	// Any thread
+	uint64_t getValues() const
+	{
+		return values.load(std::memory_order_relaxed);
+	}
+
+	// Packets that were neither OSC nor a frame, or were cut short
+	uint64_t getMalformed() const
+	{
+		return malformed.load(std::memory_order_relaxed);
+	}
+
+private:
+	UdpSource(const UdpSource&) = delete;
+	UdpSource& operator=(const UdpSource&) = delete;
+
+	void run();
+	void receive(const uint8_t* data, size_t size);
+	bool receiveOsc(const uint8_t* data, size_t size, int depth);
+
+	int port;
+	SpscRing<float>& ring;
+	std::atomic<bool> quit{false};
+	std::atomic<uint64_t> values{0};
+	std::atomic<uint64_t> malformed{0};
+	std::thread worker;
+#if defined(_WIN32)
+	uintptr_t sock;
+#else
+	int sock = -1;
+#endif
+};
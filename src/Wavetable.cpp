@@ -0,0 +1,97 @@
+#include "Wavetable.hpp"
+#include <cmath>
+
+using simd::float_4;
+
+// Reads four positions of one level with linear or Catmull-Rom cubic
+// interpolation. The positions are doubles so rows far into a long column
+// still land in the right place, only the fractions go into the vectors.
+static float_4 readLevel(const float* values, int64_t length, const double* positions, bool cubic)
+{
+	alignas(16) float before[4];
+	alignas(16) float at[4];
+	alignas(16) float after[4];
+	alignas(16) float after2[4];
+	alignas(16) float fractions[4];
+	for (int i = 0; i < 4; i++)
+	{
+		double whole = std::floor(positions[i]);
+		int64_t index = static_cast<int64_t>(whole) % length;
+		if (index < 0)
+			index += length;
+		int64_t next = (index + 1 < length) ? index + 1 : 0;
+		before[i] = values[(index > 0) ? index - 1 : length - 1];
+		at[i] = values[index];
+		after[i] = values[next];
+		after2[i] = values[(next + 1 < length) ? next + 1 : 0];
+		fractions[i] = static_cast<float>(positions[i] - whole);
+	}
+
+	float_4 t = float_4::load(fractions);
+	float_4 y0 = float_4::load(at);
+	float_4 y1 = float_4::load(after);
+	if (!cubic)
+		return y0 + t * (y1 - y0);
+
+	float_4 ym1 = float_4::load(before);
+	float_4 y2 = float_4::load(after2);
+	float_4 c1 = 0.5f * (y1 - ym1);
+	float_4 c2 = ym1 - 2.5f * y0 + 2.f * y1 - 0.5f * y2;
+	float_4 c3 = 0.5f * (y2 - ym1) + 1.5f * (y0 - y1);
+	return ((c3 * t + c2) * t + c1) * t + y0;
+}
+
+// Reads level k of the mipmaps, where each value is the average of 2^k rows
+// centred halfway along them
+static float_4 readMipmap(const DataColumn& column, int length, int level, const double* rows)
+{
+	if (level == 0)
+		return readLevel(column.values, length, rows, true);
+
+	const std::vector<float>& values = column.mipmaps.levels[level - 1];
+	double scale = std::ldexp(1.0, -level);
+	double offset = 0.5 - 0.5 * scale;
+	double positions[4];
+	for (int i = 0; i < 4; i++)
+		positions[i] = rows[i] * scale - offset;
+	return readLevel(values.data(), values.size(), positions, true);
+}
+
+bool WavetableOscillator::process(const DataColumn& column, int length, double step, Interpolation interpolation, float_4& out)
+{
+	// A new dataset might be shorter than the last one
+	if (phase >= length)
+		phase = 0.0;
+
+	double rows[4];
+	bool wrapped = false;
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = phase;
+		phase += step;
+		if (phase >= length) {
+			phase = std::fmod(phase, static_cast<double>(length));
+			wrapped = true;
+		}
+	}
+
+	if (interpolation != INTERPOLATION_BANDLIMITED || column.mipmaps.levels.empty() || step <= 1.0) {
+		out = readLevel(column.values, length, rows, interpolation != INTERPOLATION_LINEAR);
+		return wrapped;
+	}
+
+	// Average over about as many rows as go by each sample, fading between
+	// the two nearest levels so sweeping the pitch doesn't step
+	double octave = std::log2(step);
+	int levels = static_cast<int>(column.mipmaps.levels.size());
+	int level = static_cast<int>(octave);
+	if (level >= levels) {
+		out = readMipmap(column, length, levels, rows);
+		return wrapped;
+	}
+	float blend = static_cast<float>(octave - level);
+	float_4 lower = readMipmap(column, length, level, rows);
+	float_4 upper = readMipmap(column, length, level + 1, rows);
+	out = lower + blend * (upper - lower);
+	return wrapped;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "plugin.hpp"
+#include "Dataset.hpp"
+
+// How to read between the rows of a column played as a waveform
+enum Interpolation
+{
+	INTERPOLATION_LINEAR,
+	INTERPOLATION_CUBIC,
+	// Cubic, but from the column's mipmaps once more than a row goes by each
+	// sample, so it doesn't alias. Plain cubic if there aren't any mipmaps.
+	INTERPOLATION_BANDLIMITED,
+	INTERPOLATION_LEN
+};
+
+// Plays a whole column as one cycle of a waveform, wrapping round from the
+// last row to the first. Samples are worked out four at a time, one in each
+// lane of a float_4, so the interpolation is vectorized across them.
+struct WavetableOscillator
+{
+	double phase = 0.0; // rows into the cycle
+
+	// Fills out with the next four samples, moving on step rows each. Returns
+	// true if the cycle wrapped round. Rows without numbers come out as NaN.
+	bool process(const DataColumn& column, int length, double step, Interpolation interpolation, simd::float_4& out);
+
+	void reset()
+	{
+		phase = 0.0;
+	}
+};
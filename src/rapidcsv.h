@@ -15,7 +15,13 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <clocale>
 #include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #ifdef HAS_CODECVT
 #include <codecvt>
 #include <locale>
@@ -23,9 +29,13 @@
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <system_error>
+#include <type_traits>
 #include <typeinfo>
 #include <vector>
 
@@ -57,15 +67,20 @@ namespace rapidcsv
      * @param   pDefaultInteger       integer default value to represent invalid numbers.
      * @param   pNumericLocale        specifies whether to honor LC_NUMERIC locale (default
      *                                true).
+     * @param   pDecimalPoint         decimal point character, e.g. ',' for decimal-comma data.
+     *                                Default '\0' takes it from LC_NUMERIC if pNumericLocale is
+     *                                set, and uses '.' otherwise.
      */
     explicit ConverterParams(const bool pHasDefaultConverter = false,
                              const long double pDefaultFloat = std::numeric_limits<long double>::signaling_NaN(),
                              const long long pDefaultInteger = 0,
-                             const bool pNumericLocale = true)
+                             const bool pNumericLocale = true,
+                             const char pDecimalPoint = '\0')
       : mHasDefaultConverter(pHasDefaultConverter)
       , mDefaultFloat(pDefaultFloat)
       , mDefaultInteger(pDefaultInteger)
       , mNumericLocale(pNumericLocale)
+      , mDecimalPoint(pDecimalPoint)
     {
     }
 
@@ -89,8 +104,322 @@ namespace rapidcsv
      * @brief   specifies whether to honor LC_NUMERIC locale.
      */
     bool mNumericLocale;
+
+    /**
+     * @brief   decimal point character, '\0' for the default.
+     */
+    char mDecimalPoint;
+  };
+
+  /**
+   * @brief     Result of a numerical conversion, modelled on std::from_chars_result.
+   */
+  struct FromCharsResult
+  {
+    /**
+     * @brief   first character not part of the parsed number.
+     */
+    const char* ptr;
+
+    /**
+     * @brief   std::errc() on success, invalid_argument or result_out_of_range otherwise.
+     */
+    std::errc ec;
   };
 
+  /**
+   * @brief     Parses a decimal integer, std::from_chars style. Does not skip whitespace, accepts
+   *            a leading '-' for signed types only, and never throws.
+   * @param     pFirst                start of characters to parse.
+   * @param     pLast                 end of characters to parse.
+   * @param     pVal                  parsed value, left unchanged on failure.
+   * @returns   end of the parsed number and error code.
+   */
+  template<typename T>
+  FromCharsResult FromCharsInteger(const char* pFirst, const char* pLast, T& pVal)
+  {
+    typedef typename std::make_unsigned<T>::type U;
+    const char* p = pFirst;
+    bool negative = false;
+    if (std::is_signed<T>::value && (p < pLast) && (*p == '-'))
+    {
+      negative = true;
+      ++p;
+    }
+
+    const U limit = negative ? static_cast<U>(std::numeric_limits<T>::max()) + 1
+                             : static_cast<U>(std::numeric_limits<T>::max());
+    const char* digits = p;
+    U value = 0;
+    bool overflow = false;
+    for (; (p < pLast) && (*p >= '0') && (*p <= '9'); ++p)
+    {
+      const U digit = static_cast<U>(*p - '0');
+      if (value > (limit - digit) / 10)
+      {
+        overflow = true;
+      }
+      else
+      {
+        value = value * 10 + digit;
+      }
+    }
+
+    if (p == digits)
+    {
+      return FromCharsResult{ pFirst, std::errc::invalid_argument };
+    }
+    if (overflow)
+    {
+      return FromCharsResult{ p, std::errc::result_out_of_range };
+    }
+
+    if (negative && (value != 0))
+    {
+      // negate without overflowing on the most negative value
+      pVal = static_cast<T>(-static_cast<T>(value - 1) - 1);
+    }
+    else
+    {
+      pVal = static_cast<T>(value);
+    }
+    return FromCharsResult{ p, std::errc() };
+  }
+
+  /**
+   * @brief     Skips the leading whitespace and '+' sign that std::stof and friends accept, but
+   *            the FromChars functions don't.
+   * @param     pFirst                start of characters to parse.
+   * @param     pLast                 end of characters to parse.
+   * @returns   start of the number itself.
+   */
+  inline const char* SkipNumberPrefix(const char* pFirst, const char* pLast)
+  {
+    while ((pFirst < pLast) && std::isspace(static_cast<unsigned char>(*pFirst)))
+    {
+      ++pFirst;
+    }
+    if (((pLast - pFirst) >= 2) && (*pFirst == '+') && (pFirst[1] != '-') && (pFirst[1] != '+'))
+    {
+      ++pFirst;
+    }
+    return pFirst;
+  }
+
+  /**
+   * @brief     Falls back to the C library for numbers the fast path can't convert exactly.
+   */
+  template<typename T>
+  FromCharsResult FromCharsFloatSlow(const char* pFirst, const char* pLast, T& pVal, char pDecimalPoint)
+  {
+    // strto* need a terminated string using the C locale's decimal point
+    const char localePoint = std::localeconv()->decimal_point[0];
+    std::string str(pFirst, pLast);
+    if (pDecimalPoint != localePoint)
+    {
+      std::replace(str.begin(), str.end(), pDecimalPoint, localePoint);
+    }
+
+    char* end = nullptr;
+    errno = 0;
+    long double val = 0;
+    if (std::is_same<T, float>::value)
+    {
+      val = std::strtof(str.c_str(), &end);
+    }
+    else if (std::is_same<T, double>::value)
+    {
+      val = std::strtod(str.c_str(), &end);
+    }
+    else
+    {
+      val = std::strtold(str.c_str(), &end);
+    }
+
+    if (end == str.c_str())
+    {
+      return FromCharsResult{ pFirst, std::errc::invalid_argument };
+    }
+    const char* ptr = pFirst + (end - str.c_str());
+    if (errno == ERANGE)
+    {
+      return FromCharsResult{ ptr, std::errc::result_out_of_range };
+    }
+    pVal = static_cast<T>(val);
+    return FromCharsResult{ ptr, std::errc() };
+  }
+
+  /**
+   * @brief     Parses a floating-point number, std::from_chars style. Accepts decimal and
+   *            exponent notation, inf, infinity and nan, plus hex floats via the C library. Does
+   *            not skip whitespace or accept a leading '+', and never throws. Results are
+   *            correctly rounded.
+   * @param     pFirst                start of characters to parse.
+   * @param     pLast                 end of characters to parse.
+   * @param     pVal                  parsed value, left unchanged on failure.
+   * @param     pDecimalPoint         decimal point character.
+   * @returns   end of the parsed number and error code.
+   */
+  template<typename T>
+  FromCharsResult FromCharsFloat(const char* pFirst, const char* pLast, T& pVal, char pDecimalPoint = '.')
+  {
+    const char* p = pFirst;
+    const bool negative = (p < pLast) && (*p == '-');
+    if (negative)
+    {
+      ++p;
+    }
+
+    // inf, infinity, nan and nan(...), in any case
+    struct Word
+    {
+      static bool Match(const char* pStr, const char* pEnd, const char* pWord)
+      {
+        for (; *pWord; ++pStr, ++pWord)
+        {
+          if ((pStr >= pEnd) || ((*pStr | 0x20) != *pWord))
+          {
+            return false;
+          }
+        }
+        return true;
+      }
+    };
+    if (Word::Match(p, pLast, "inf"))
+    {
+      p += Word::Match(p, pLast, "infinity") ? 8 : 3;
+      pVal = negative ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::infinity();
+      return FromCharsResult{ p, std::errc() };
+    }
+    if (Word::Match(p, pLast, "nan"))
+    {
+      p += 3;
+      if ((p < pLast) && (*p == '('))
+      {
+        const char* close = p + 1;
+        while ((close < pLast) && (std::isalnum(static_cast<unsigned char>(*close)) || (*close == '_')))
+        {
+          ++close;
+        }
+        if ((close < pLast) && (*close == ')'))
+        {
+          p = close + 1;
+        }
+      }
+      pVal = std::numeric_limits<T>::quiet_NaN();
+      return FromCharsResult{ p, std::errc() };
+    }
+    if (((pLast - p) >= 2) && (p[0] == '0') && ((p[1] | 0x20) == 'x'))
+    {
+      return FromCharsFloatSlow(pFirst, pLast, pVal, pDecimalPoint);
+    }
+
+    // Collect up to 19 significant digits, which always fit in 64 bits
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+    bool inexact = false;
+    for (; (p < pLast) && (*p >= '0') && (*p <= '9'); ++p)
+    {
+      anyDigits = true;
+      if (digits < 19)
+      {
+        mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+        digits += (mantissa != 0);
+      }
+      else
+      {
+        ++exponent;
+        inexact |= (*p != '0');
+      }
+    }
+    if ((p < pLast) && (*p == pDecimalPoint))
+    {
+      const char* q = p + 1;
+      for (; (q < pLast) && (*q >= '0') && (*q <= '9'); ++q)
+      {
+        anyDigits = true;
+        if (digits < 19)
+        {
+          mantissa = mantissa * 10 + static_cast<uint64_t>(*q - '0');
+          digits += (mantissa != 0);
+          --exponent;
+        }
+        else
+        {
+          inexact |= (*q != '0');
+        }
+      }
+      if (anyDigits)
+      {
+        p = q;
+      }
+    }
+    if (!anyDigits)
+    {
+      return FromCharsResult{ pFirst, std::errc::invalid_argument };
+    }
+
+    // The exponent is only consumed if it has digits
+    if ((p < pLast) && ((*p | 0x20) == 'e'))
+    {
+      const char* q = p + 1;
+      const bool negativeExp = (q < pLast) && (*q == '-');
+      if ((q < pLast) && ((*q == '-') || (*q == '+')))
+      {
+        ++q;
+      }
+      if ((q < pLast) && (*q >= '0') && (*q <= '9'))
+      {
+        int exp = 0;
+        for (; (q < pLast) && (*q >= '0') && (*q <= '9'); ++q)
+        {
+          exp = std::min(exp * 10 + (*q - '0'), 100000);
+        }
+        exponent += negativeExp ? -exp : exp;
+        p = q;
+      }
+    }
+
+    if (mantissa == 0)
+    {
+      pVal = negative ? -static_cast<T>(0) : static_cast<T>(0);
+      return FromCharsResult{ p, std::errc() };
+    }
+
+    // Exact fast path: both the mantissa and the power of ten are exact doubles, so a single
+    // multiply or divide gives the correctly rounded result.
+    static const double powers[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    if (!inexact && (mantissa <= (uint64_t(1) << 53)) && (exponent >= -22) && (exponent <= 22) &&
+        !std::is_same<T, long double>::value)
+    {
+      double val = static_cast<double>(mantissa);
+      val = (exponent < 0) ? (val / powers[-exponent]) : (val * powers[exponent]);
+
+      // Rounding to double then to float is only wrong when the double lands exactly halfway
+      // between two floats, so those few go the slow way.
+      uint64_t bits;
+      std::memcpy(&bits, &val, sizeof(bits));
+      if (!std::is_same<T, float>::value || ((bits & 0x1fffffffULL) != 0x10000000ULL))
+      {
+        pVal = static_cast<T>(negative ? -val : val);
+        return FromCharsResult{ p, std::errc() };
+      }
+    }
+
+    T val;
+    FromCharsResult result = FromCharsFloatSlow(pFirst, p, val, pDecimalPoint);
+    if (result.ec == std::errc())
+    {
+      pVal = val;
+    }
+    return result;
+  }
+
   /**
    * @brief     Exception thrown when attempting to access Document data in a datatype which
    *            is not supported by the Converter class.
@@ -123,6 +452,7 @@ namespace rapidcsv
      */
     Converter(const ConverterParams& pConverterParams)
       : mConverterParams(pConverterParams)
+      , mDecimalPoint(DecimalPoint(pConverterParams))
     {
     }
 
@@ -156,119 +486,102 @@ namespace rapidcsv
 
     /**
      * @brief   Converts string holding a numerical value to numerical datatype representation.
+     *          The conversion is picked at compile time, and invalid values never throw when
+     *          a default converter is set.
      * @param   pVal                  numerical value
      * @param   pStr                  output string
      */
     void ToVal(const std::string& pStr, T& pVal) const
     {
-      try
+      ToVal(pStr, pVal, Kind());
+    }
+
+  private:
+    typedef std::integral_constant<int, 0> Unsupported;
+    typedef std::integral_constant<int, 1> Integer;
+    typedef std::integral_constant<int, 2> Floating;
+    typedef std::integral_constant<int, 3> Character;
+    typedef std::integral_constant<int, std::is_same<T, char>::value ? 3 :
+                                        std::is_floating_point<T>::value ? 2 :
+                                        (std::is_integral<T>::value && !std::is_same<T, bool>::value) ? 1 :
+                                        0> Kind;
+
+    static char DecimalPoint(const ConverterParams& pConverterParams)
+    {
+      if (pConverterParams.mDecimalPoint != '\0')
       {
-        if (typeid(T) == typeid(int))
-        {
-          pVal = static_cast<T>(std::stoi(pStr));
-          return;
-        }
-        else if (typeid(T) == typeid(long))
-        {
-          pVal = static_cast<T>(std::stol(pStr));
-          return;
-        }
-        else if (typeid(T) == typeid(long long))
-        {
-          pVal = static_cast<T>(std::stoll(pStr));
-          return;
-        }
-        else if (typeid(T) == typeid(unsigned))
-        {
-          pVal = static_cast<T>(std::stoul(pStr));
-          return;
-        }
-        else if (typeid(T) == typeid(unsigned long))
-        {
-          pVal = static_cast<T>(std::stoul(pStr));
-          return;
-        }
-        else if (typeid(T) == typeid(unsigned long long))
-        {
-          pVal = static_cast<T>(std::stoull(pStr));
-          return;
-        }
+        return pConverterParams.mDecimalPoint;
       }
-      catch (...)
+      return pConverterParams.mNumericLocale ? std::localeconv()->decimal_point[0] : '.';
+    }
+
+    static void ThrowError(const FromCharsResult& pResult, const std::string& pStr)
+    {
+      if (pResult.ec == std::errc::result_out_of_range)
       {
-        if (!mConverterParams.mHasDefaultConverter)
-        {
-          throw;
-        }
-        else
-        {
-          pVal = static_cast<T>(mConverterParams.mDefaultInteger);
-          return;
-        }
+        throw std::out_of_range("value out of range: " + pStr);
       }
+      throw std::invalid_argument("no conversion: " + pStr);
+    }
 
-      try
+    void ToVal(const std::string& pStr, T& pVal, Integer) const
+    {
+      const char* last = pStr.data() + pStr.size();
+      T val = 0;
+      const FromCharsResult result = FromCharsInteger(SkipNumberPrefix(pStr.data(), last), last, val);
+      if (result.ec == std::errc())
       {
-        if (mConverterParams.mNumericLocale)
-        {
-          if (typeid(T) == typeid(float))
-          {
-            pVal = static_cast<T>(std::stof(pStr));
-            return;
-          }
-          else if (typeid(T) == typeid(double))
-          {
-            pVal = static_cast<T>(std::stod(pStr));
-            return;
-          }
-          else if (typeid(T) == typeid(long double))
-          {
-            pVal = static_cast<T>(std::stold(pStr));
-            return;
-          }
-        }
-        else
-        {
-          if ((typeid(T) == typeid(float)) ||
-              (typeid(T) == typeid(double)) ||
-              (typeid(T) == typeid(long double)))
-          {
-            std::istringstream iss(pStr);
-            iss >> pVal;
-            if (iss.fail() || iss.bad() || !iss.eof())
-            {
-              throw std::invalid_argument("istringstream: no conversion");
-            }
-            return;
-          }
-        }
+        pVal = val;
       }
-      catch (...)
+      else if (!mConverterParams.mHasDefaultConverter)
       {
-        if (!mConverterParams.mHasDefaultConverter)
-        {
-          throw;
-        }
-        else
-        {
-          pVal = static_cast<T>(mConverterParams.mDefaultFloat);
-          return;
-        }
+        ThrowError(result, pStr);
       }
+      else
+      {
+        pVal = static_cast<T>(mConverterParams.mDefaultInteger);
+      }
+    }
 
-      if (typeid(T) == typeid(char))
+    void ToVal(const std::string& pStr, T& pVal, Floating) const
+    {
+      const char* last = pStr.data() + pStr.size();
+      T val = 0;
+      FromCharsResult result = FromCharsFloat(SkipNumberPrefix(pStr.data(), last), last, val, mDecimalPoint);
+
+      // Without the numeric locale this used to go through istringstream, which insists on
+      // consuming the whole string
+      if ((result.ec == std::errc()) && !mConverterParams.mNumericLocale && (result.ptr != last))
       {
-        pVal = static_cast<T>(pStr[0]);
-        return;
+        result.ec = std::errc::invalid_argument;
+      }
+
+      if (result.ec == std::errc())
+      {
+        pVal = val;
+      }
+      else if (!mConverterParams.mHasDefaultConverter)
+      {
+        ThrowError(result, pStr);
       }
       else
       {
-        throw no_converter();
+        pVal = static_cast<T>(mConverterParams.mDefaultFloat);
       }
     }
 
-  private:
+    void ToVal(const std::string& pStr, T& pVal, Character) const
+    {
+      pVal = static_cast<T>(pStr[0]);
+    }
+
+    void ToVal(const std::string& /*pStr*/, T& /*pVal*/, Unsupported) const
+    {
+      throw no_converter();
+    }
+
     const ConverterParams& mConverterParams;
+    const char mDecimalPoint;
   };
 
   /**